@@ -15,6 +15,7 @@
 #include "settings.h"
 #include "delayed_reset.h"
 #include "netdata.h"
+#include "app_timer.h"
 
 
 #define NRF_LOG_MODULE_NAME app_cmd
@@ -212,28 +213,116 @@ static data_frame_tx_t *cmd_processor_set_ble_pairing_enable(uint16_t cmd, uint1
 
 #if defined(PROJECT_CHAMELEON_ULTRA)
 
+// Idle time after which an open reader session turns the field off, when the host gives none
+#define HF_READER_SESSION_IDLE_MS_DEFAULT       (3000)
+// Most tags a HF14A_SCAN reports, a full response holds at least this many 4 byte UID tags with a small ATS
+#define HF14A_SCAN_TAGS_MAX                     (8)
+
+APP_TIMER_DEF(m_hf_session_timer);
+static bool m_hf_session_timer_created = false;
+static bool m_hf_session_open = false;
+static volatile bool m_hf_session_expired = false;
+static uint16_t m_hf_session_idle_ms = HF_READER_SESSION_IDLE_MS_DEFAULT;
+
+extern bool g_is_reader_antenna_on;
+
+static void hf_session_timeout_handle(void *ctx) {
+    // only flag it, the session is closed from the main loop, never in the middle of a command
+    m_hf_session_expired = true;
+}
+
+static void hf_session_idle_stop(void) {
+    app_timer_stop(m_hf_session_timer);
+    m_hf_session_expired = false;
+}
+
+static void hf_session_idle_start(void) {
+    hf_session_idle_stop();
+    ret_code_t err_code = app_timer_start(m_hf_session_timer, APP_TIMER_TICKS(m_hf_session_idle_ms), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void hf_session_close(void) {
+    hf_session_idle_stop();
+    m_hf_session_open = false;
+    mf1_toolbox_session_enable(false);
+    // the reader may already be powered down if the device left the reader mode
+    if (get_device_mode() == DEVICE_MODE_READER) {
+        pcd_14a_reader_antenna_off();
+    }
+}
+
+static data_frame_tx_t *cmd_processor_hf14a_session_open(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (length != 0 && length != sizeof(uint16_t)) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    uint16_t idle_ms = length ? bytes_to_num(data, 2) : 0;
+    m_hf_session_idle_ms = idle_ms ? idle_ms : HF_READER_SESSION_IDLE_MS_DEFAULT;
+    if (!m_hf_session_timer_created) {
+        ret_code_t err_code = app_timer_create(&m_hf_session_timer, APP_TIMER_MODE_SINGLE_SHOT, hf_session_timeout_handle);
+        APP_ERROR_CHECK(err_code);
+        m_hf_session_timer_created = true;
+    }
+    if (!m_hf_session_open || !g_is_reader_antenna_on) {
+        pcd_14a_reader_reset();
+        pcd_14a_reader_antenna_on();
+        bsp_delay_ms(8);
+        mf1_toolbox_session_enable(true);
+        m_hf_session_open = true;
+    }
+    hf_session_idle_start();
+    return data_frame_make(cmd, STATUS_SUCCESS, 0, NULL);
+}
+
+static data_frame_tx_t *cmd_processor_hf14a_session_close(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (m_hf_session_open) {
+        hf_session_close();
+    }
+    return data_frame_make(cmd, STATUS_SUCCESS, 0, NULL);
+}
+
 static data_frame_tx_t *cmd_processor_hf14a_scan(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
-    picc_14a_tag_t taginfo;
-    status = pcd_14a_reader_scan_auto(&taginfo);
+    static picc_14a_tag_t taginfos[HF14A_SCAN_TAGS_MAX];
+    uint8_t count;
+    status = pcd_14a_reader_scan_all(taginfos, ARRAYLEN(taginfos), &count);
     if (status != STATUS_HF_TAG_OK) {
         return data_frame_make(cmd, status, 0, NULL);
     }
-    // uidlen[1]|uid[uidlen]|atqa[2]|sak[1]|atslen[1]|ats[atslen]
+    // one entry per tag: uidlen[1]|uid[uidlen]|atqa[2]|sak[1]|atslen[1]|ats[atslen]
     // dynamic length, so no struct
-    uint8_t payload[1 + sizeof(taginfo.uid) + sizeof(taginfo.atqa) + sizeof(taginfo.sak) + 1 + 254];
+    static uint8_t payload[NETDATA_MAX_DATA_LENGTH];
     uint16_t offset = 0;
-    payload[offset++] = taginfo.uid_len;
-    memcpy(&payload[offset], taginfo.uid, taginfo.uid_len);
-    offset += taginfo.uid_len;
-    memcpy(&payload[offset], taginfo.atqa, sizeof(taginfo.atqa));
-    offset += sizeof(taginfo.atqa);
-    payload[offset++] = taginfo.sak;
-    payload[offset++] = taginfo.ats_len;
-    memcpy(&payload[offset], taginfo.ats, taginfo.ats_len);
-    offset += taginfo.ats_len;
+    for (uint8_t i = 0; i < count; i++) {
+        picc_14a_tag_t *taginfo = &taginfos[i];
+        uint16_t entry_len = 1 + taginfo->uid_len + sizeof(taginfo->atqa) + sizeof(taginfo->sak) + 1 + taginfo->ats_len;
+        if (offset + entry_len > sizeof(payload)) {
+            break;
+        }
+        payload[offset++] = taginfo->uid_len;
+        memcpy(&payload[offset], taginfo->uid, taginfo->uid_len);
+        offset += taginfo->uid_len;
+        memcpy(&payload[offset], taginfo->atqa, sizeof(taginfo->atqa));
+        offset += sizeof(taginfo->atqa);
+        payload[offset++] = taginfo->sak;
+        payload[offset++] = taginfo->ats_len;
+        memcpy(&payload[offset], taginfo->ats, taginfo->ats_len);
+        offset += taginfo->ats_len;
+    }
     return data_frame_make(cmd, STATUS_HF_TAG_OK, offset, payload);
 }
 
+static data_frame_tx_t *cmd_processor_hf14a_select(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (length != 4 && length != 7 && length != 10) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    uint8_t sak;
+    status = mf1_toolbox_session_select(data, length, &sak);
+    if (status != STATUS_HF_TAG_OK) {
+        return data_frame_make(cmd, status, 0, NULL);
+    }
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, sizeof(sak), &sak);
+}
+
 static data_frame_tx_t *cmd_processor_mf1_detect_support(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     status = check_std_mifare_nt_support();
     return data_frame_make(cmd, status, 0, NULL);
@@ -273,22 +362,28 @@ static data_frame_tx_t *cmd_processor_mf1_static_nested_acquire(uint16_t cmd, ui
 }
 
 static data_frame_tx_t *cmd_processor_mf1_darkside_acquire(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
-    if (length != 4) {
+    // type|block|first_recover|sync_max, then optional flags
+    if (length != 4 && length != 5) {
         return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
     }
     struct {
         uint8_t darkside_status;
         // DarksideCore_t is PACKED and comprises only bytes so we can use it directly
         DarksideCore_t dc;
+        // only sent when flags were given, older clients expect the core alone
+        DarksideStats_t stats;
     } PACKED payload;
-    status = darkside_recover_key(data[1], data[0], data[2], data[3], &payload.dc, (mf1_darkside_status_t *)&payload.darkside_status);
+    uint8_t flags = length == 5 ? data[4] : 0;
+    status = darkside_recover_key(data[1], data[0], data[2], data[3], flags, &payload.dc, &payload.stats,
+                                  (mf1_darkside_status_t *)&payload.darkside_status);
     if (status != STATUS_HF_TAG_OK) {
         return data_frame_make(cmd, status, 0, NULL);
     }
     if (payload.darkside_status != DARKSIDE_OK) {
         return data_frame_make(cmd, STATUS_HF_TAG_OK, sizeof(payload.darkside_status), &payload.darkside_status);
     }
-    return data_frame_make(cmd, STATUS_HF_TAG_OK, sizeof(payload), (uint8_t *)&payload);
+    uint16_t resp_length = length == 5 ? sizeof(payload) : sizeof(payload) - sizeof(payload.stats);
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, resp_length, (uint8_t *)&payload);
 }
 
 static data_frame_tx_t *cmd_processor_mf1_detect_nt_dist(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
@@ -331,6 +426,44 @@ static data_frame_tx_t *cmd_processor_mf1_nested_acquire(uint16_t cmd, uint16_t
     return data_frame_make(cmd, STATUS_HF_TAG_OK, sizeof(ncs), (uint8_t *)(&ncs));
 }
 
+static data_frame_tx_t *cmd_processor_mf1_nested_acquire_sectors(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    typedef struct {
+        uint8_t type_known;
+        uint8_t block_known;
+        uint8_t key_known[6];
+        uint8_t type_target;
+        uint8_t sector_start;
+        uint8_t sector_count;
+        uint8_t set_count;
+    } PACKED payload_t;
+    typedef struct {
+        uint8_t uid[4];
+        uint32_t distance;
+        uint8_t sector_done;
+        mf1_nested_core_t ncs[(NETDATA_MAX_DATA_LENGTH - 9) / sizeof(mf1_nested_core_t)];
+    } PACKED resp_t;
+    payload_t *payload = (payload_t *)data;
+    if (length != sizeof(payload_t) ||
+            payload->sector_start >= MF1_SECTOR_MAX ||
+            payload->sector_count == 0 ||
+            payload->set_count == 0 || payload->set_count > ARRAYLEN(((resp_t *)0)->ncs)) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+
+    static resp_t resp;
+    uint32_t distance;
+    status = nested_recover_sectors(bytes_to_num(payload->key_known, 6), payload->block_known, payload->type_known,
+                                    payload->sector_start, payload->sector_count, payload->type_target, payload->set_count,
+                                    resp.uid, &distance, resp.ncs, ARRAYLEN(resp.ncs), &resp.sector_done);
+    if (status != STATUS_HF_TAG_OK) {
+        return data_frame_make(cmd, status, 0, NULL);
+    }
+    resp.distance = U32HTONL(distance);
+    // mf1_nested_core_t is PACKED and comprises only bytes so we can use it directly
+    uint16_t resp_length = offsetof(resp_t, ncs) + resp.sector_done * payload->set_count * sizeof(mf1_nested_core_t);
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, resp_length, (uint8_t *)&resp);
+}
+
 static data_frame_tx_t *cmd_processor_mf1_auth_one_key_block(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     typedef struct {
         uint8_t type;
@@ -343,10 +476,61 @@ static data_frame_tx_t *cmd_processor_mf1_auth_one_key_block(uint16_t cmd, uint1
 
     payload_t *payload = (payload_t *)data;
     status = auth_key_use_522_hw(payload->block, payload->type, payload->key);
-    pcd_14a_reader_mf1_unauth();
+    if (!m_hf_session_open) {
+        pcd_14a_reader_mf1_unauth();
+    }
     return data_frame_make(cmd, status, 0, NULL);
 }
 
+static data_frame_tx_t *cmd_processor_mf1_check_keys_of_sectors(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    typedef struct {
+        uint8_t mask[MF1_SECTOR_MASK_SIZE];
+        uint8_t keys[1][6]; // we can have more than one... struct just to compute offsets with min 1 key
+    } PACKED payload_t;
+    payload_t *payload = (payload_t *)data;
+    if (length < sizeof(payload_t) || (length - offsetof(payload_t, keys)) % sizeof(payload->keys[0]) != 0) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+
+    mf1_toolbox_check_keys_of_sectors_in_t in = {
+        .keys_len = (length - offsetof(payload_t, keys)) / sizeof(payload->keys[0]),
+        .keys = payload->keys,
+    };
+    memcpy(in.mask, payload->mask, sizeof(in.mask));
+    mf1_toolbox_check_keys_of_sectors_out_t out;
+    uint8_t found_count;
+    status = mf1_toolbox_check_keys_of_sectors(&in, &out, &found_count);
+    if (status != STATUS_HF_TAG_OK) {
+        return data_frame_make(cmd, status, 0, NULL);
+    }
+    // found[] followed by the found keys only
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, sizeof(out.found) + found_count * sizeof(out.keys[0]), (uint8_t *)&out);
+}
+
+static data_frame_tx_t *cmd_processor_mf1_read_sectors(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    typedef struct {
+        uint8_t sector_start;
+        mf1_sector_key_t keys[1]; // one per sector from sector_start... struct just to compute offsets with min 1 key
+    } PACKED payload_t;
+    payload_t *payload = (payload_t *)data;
+    if (length < sizeof(payload_t) ||
+            (length - offsetof(payload_t, keys)) % sizeof(mf1_sector_key_t) != 0 ||
+            payload->sector_start >= MF1_SECTOR_MAX) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+
+    // sector_done[1] followed by the sectors, as many as fit in one frame
+    uint8_t resp[NETDATA_MAX_DATA_LENGTH];
+    uint16_t resp_length = 0;
+    uint8_t sector_count = (length - offsetof(payload_t, keys)) / sizeof(mf1_sector_key_t);
+    status = mf1_toolbox_read_sectors(payload->sector_start, sector_count, payload->keys,
+                                      &resp[1], sizeof(resp) - 1, &resp_length, &resp[0]);
+    if (status != STATUS_HF_TAG_OK) {
+        return data_frame_make(cmd, status, 0, NULL);
+    }
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, resp_length + 1, resp);
+}
+
 static data_frame_tx_t *cmd_processor_mf1_read_one_block(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     typedef struct {
         uint8_t type;
@@ -365,6 +549,7 @@ static data_frame_tx_t *cmd_processor_mf1_read_one_block(uint16_t cmd, uint16_t
     }
     status = pcd_14a_reader_mf1_read(payload->block, block);
     if (status != STATUS_HF_TAG_OK) {
+        mf1_toolbox_session_reset();
         return data_frame_make(cmd, status, 0, NULL);
     }
     return data_frame_make(cmd, status, sizeof(block), block);
@@ -387,6 +572,9 @@ static data_frame_tx_t *cmd_processor_mf1_write_one_block(uint16_t cmd, uint16_t
         return data_frame_make(cmd, status, 0, NULL);
     }
     status = pcd_14a_reader_mf1_write(payload->block, payload->block_data);
+    if (status != STATUS_HF_TAG_OK) {
+        mf1_toolbox_session_reset();
+    }
     return data_frame_make(cmd, status, 0, NULL);
 }
 
@@ -426,6 +614,14 @@ static data_frame_tx_t *cmd_processor_hf14a_raw(uint16_t cmd, uint16_t status, u
     NRF_LOG_INFO("check_response_crc = %d", payload->options.check_response_crc);
     NRF_LOG_INFO("reserved           = %d", payload->options.reserved);
 
+    if (m_hf_session_open) {
+        // the session owns the field, and the raw frames leave the tag in an unknown state
+        payload->options.keep_rf_field = 1;
+        mf1_toolbox_session_reset();
+        iso14443_4_reader_reset();
+        hf_session_idle_stop();
+    }
+
     status = pcd_14a_reader_raw_cmd(
                  payload->options.activate_rf_field,
                  payload->options.wait_response,
@@ -444,9 +640,50 @@ static data_frame_tx_t *cmd_processor_hf14a_raw(uint16_t cmd, uint16_t status, u
                  U8ARR_BIT_LEN(resp)
              );
 
+    if (m_hf_session_open) {
+        hf_session_idle_start();
+    }
+
     return data_frame_make(cmd, status, resp_length, resp);
 }
 
+static data_frame_tx_t *cmd_processor_hf14a_apdu(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    typedef struct {
+        uint8_t flags;
+        uint8_t apdu[0];
+    } PACKED payload_t;
+    payload_t *payload = (payload_t *)data;
+    if (length < sizeof(payload_t)) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    // the chain only survives between commands if the field stays on
+    if ((payload->flags & ISO14443_4_FLAG_MORE) && !m_hf_session_open) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+
+    if (!iso14443_4_reader_is_active()) {
+        static picc_14a_tag_t taginfo;
+        status = pcd_14a_reader_scan_auto(&taginfo);
+        if (status != STATUS_HF_TAG_OK) {
+            return data_frame_make(cmd, status, 0, NULL);
+        }
+        status = iso14443_4_reader_activate(&taginfo);
+        if (status != STATUS_HF_TAG_OK) {
+            return data_frame_make(cmd, status, 0, NULL);
+        }
+    }
+
+    // flags[1]|response[n]
+    static uint8_t resp[NETDATA_MAX_DATA_LENGTH];
+    uint16_t resp_length = 0;
+    status = iso14443_4_reader_exchange(payload->flags, payload->apdu, length - sizeof(payload_t),
+                                        &resp[1], sizeof(resp) - 1, &resp_length, &resp[0]);
+    if (status != STATUS_HF_TAG_OK) {
+        return data_frame_make(cmd, status, 0, NULL);
+    }
+    return data_frame_make(cmd, STATUS_HF_TAG_OK, 1 + resp_length, resp);
+}
+
 static data_frame_tx_t *cmd_processor_em410x_scan(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     uint8_t id_buffer[5] = { 0x00 };
     status = PcdScanEM410X(id_buffer);
@@ -663,29 +900,45 @@ static data_frame_tx_t *cmd_processor_mf1_get_detection_enable(uint16_t cmd, uin
 
 static data_frame_tx_t *cmd_processor_mf1_get_detection_count(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     uint32_t count = nfc_tag_mf1_detection_log_count();
-    if (count == 0xFFFFFFFF) {
-        count = 0;
-    }
     uint32_t payload = U32HTONL(count);
     return data_frame_make(cmd, STATUS_SUCCESS, sizeof(uint32_t), (uint8_t *)&payload);
 }
 
 static data_frame_tx_t *cmd_processor_mf1_get_detection_log(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
-    uint32_t count;
-    uint32_t index;
-    uint8_t *resp = NULL;
-    nfc_tag_mf1_auth_log_t *logs = mf1_get_auth_log(&count);
-    if (length != 4 || count == 0xFFFFFFFF) {
+    nfc_tag_mf1_auth_log_t logs[MF1_AUTH_LOG_PAGE_SIZE];
+    if (length != 4) {
         return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
     }
-    index = U32NTOHL(*(uint32_t *)data);
-    // NRF_LOG_INFO("index = %d", index);
-    if (index >= count) {
+    uint32_t index = U32NTOHL(*(uint32_t *)data);
+    uint32_t count = nfc_tag_mf1_detection_log_read(index, logs, MF1_AUTH_LOG_PAGE_SIZE);
+    if (count == 0) {
         return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
     }
-    resp = (uint8_t *)(logs + index);
-    length = MIN(count - index, NETDATA_MAX_DATA_LENGTH / sizeof(nfc_tag_mf1_auth_log_t)) * sizeof(nfc_tag_mf1_auth_log_t);
-    return data_frame_make(cmd, STATUS_SUCCESS, length, resp);
+    return data_frame_make(cmd, STATUS_SUCCESS, count * sizeof(nfc_tag_mf1_auth_log_t), (uint8_t *)logs);
+}
+
+// Detection log export in progress, pushed by mf1_detection_log_stream_process
+static struct {
+    bool active;
+    uint32_t cursor;
+    uint32_t end;
+} m_detection_log_stream = { .active = false };
+
+static data_frame_tx_t *cmd_processor_mf1_stream_detection_log(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (length != 4) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    uint32_t index = U32NTOHL(*(uint32_t *)data);
+    uint32_t count = nfc_tag_mf1_detection_log_count();
+    if (index > count) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    // The logs appended from now on are left for the next export
+    m_detection_log_stream.cursor = index;
+    m_detection_log_stream.end = count;
+    m_detection_log_stream.active = true;
+    // All the frames are sent from the main loop
+    return NULL;
 }
 
 static data_frame_tx_t *cmd_processor_mf1_write_emu_block_data(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
@@ -812,13 +1065,14 @@ static data_frame_tx_t *cmd_processor_delete_slot_tag_nick(uint16_t cmd, uint16_
 }
 
 static data_frame_tx_t *cmd_processor_mf1_get_emulator_config(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
-    uint8_t mf1_info[5] = {};
+    uint8_t mf1_info[6] = {};
     mf1_info[0] = nfc_tag_mf1_is_detection_enable();
     mf1_info[1] = nfc_tag_mf1_is_gen1a_magic_mode();
     mf1_info[2] = nfc_tag_mf1_is_gen2_magic_mode();
     mf1_info[3] = nfc_tag_mf1_is_use_mf1_coll_res();
     mf1_info[4] = nfc_tag_mf1_get_write_mode();
-    return data_frame_make(cmd, STATUS_SUCCESS, 5, mf1_info);
+    mf1_info[5] = nfc_tag_mf1_is_fast_crypto1();
+    return data_frame_make(cmd, STATUS_SUCCESS, sizeof(mf1_info), mf1_info);
 }
 
 static data_frame_tx_t *cmd_processor_mf1_get_gen1a_mode(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
@@ -860,6 +1114,82 @@ static data_frame_tx_t *cmd_processor_mf1_set_block_anti_coll_mode(uint16_t cmd,
     return data_frame_make(cmd, STATUS_SUCCESS, 0, NULL);
 }
 
+static data_frame_tx_t *cmd_processor_mf1_get_fast_crypto1_mode(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    uint8_t mode = nfc_tag_mf1_is_fast_crypto1();
+    return data_frame_make(cmd, STATUS_SUCCESS, 1, &mode);
+}
+
+static data_frame_tx_t *cmd_processor_mf1_set_fast_crypto1_mode(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (length != 1 || data[0] > 1) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    nfc_tag_mf1_set_fast_crypto1(data[0]);
+    return data_frame_make(cmd, STATUS_SUCCESS, 0, NULL);
+}
+
+static data_frame_tx_t *cmd_processor_mf1_crypto1_bench(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    nfc_tag_mf1_bench_cycles_t cycles[MF1_BENCH_STEP_COUNT];
+    nfc_tag_mf1_crypto1_bench(cycles);
+    for (int i = 0; i < MF1_BENCH_STEP_COUNT; i++) {
+        cycles[i].bit_serial = U32HTONL(cycles[i].bit_serial);
+        cycles[i].fast = U32HTONL(cycles[i].fast);
+    }
+    return data_frame_make(cmd, STATUS_SUCCESS, sizeof(cycles), (uint8_t *)cycles);
+}
+
+static data_frame_tx_t *cmd_processor_hf14a_get_emu_stats(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (length > 1 || (length == 1 && data[0] > 1)) {
+        return data_frame_make(cmd, STATUS_PAR_ERR, 0, NULL);
+    }
+    nfc_tag_14a_stats_t stats;
+    nfc_tag_14a_stats_get(&stats, length == 1 && data[0] == 1);
+
+    struct {
+        uint32_t rx_frames;
+        uint32_t rx_errors;
+        uint32_t crc_errors;
+        uint32_t responses;
+        uint32_t fdt_misses;
+        uint32_t overflow;
+        uint8_t bucket_count;
+        uint16_t bucket_us[NFC_TAG_14A_STATS_BUCKET_COUNT - 1];
+        uint8_t entry_count;
+        struct {
+            uint8_t cmd;
+            uint8_t length;
+            uint32_t count;
+            uint32_t fdt_misses;
+            uint16_t max_us;
+            uint16_t hist[NFC_TAG_14A_STATS_BUCKET_COUNT];
+        } PACKED entries[NFC_TAG_14A_STATS_ENTRY_COUNT];
+    } PACKED payload;
+
+    payload.rx_frames = U32HTONL(stats.rx_frames);
+    payload.rx_errors = U32HTONL(stats.rx_errors);
+    payload.crc_errors = U32HTONL(stats.crc_errors);
+    payload.responses = U32HTONL(stats.responses);
+    payload.fdt_misses = U32HTONL(stats.fdt_misses);
+    payload.overflow = U32HTONL(stats.overflow);
+    payload.bucket_count = NFC_TAG_14A_STATS_BUCKET_COUNT;
+    for (int i = 0; i < NFC_TAG_14A_STATS_BUCKET_COUNT - 1; i++) {
+        payload.bucket_us[i] = U16HTONS(nfc_tag_14a_stats_bucket_us[i]);
+    }
+    payload.entry_count = stats.entry_count;
+    for (int i = 0; i < stats.entry_count; i++) {
+        payload.entries[i].cmd = stats.entries[i].cmd;
+        payload.entries[i].length = stats.entries[i].length;
+        payload.entries[i].count = U32HTONL(stats.entries[i].count);
+        payload.entries[i].fdt_misses = U32HTONL(stats.entries[i].fdt_misses);
+        payload.entries[i].max_us = U16HTONS(stats.entries[i].max_us);
+        for (int j = 0; j < NFC_TAG_14A_STATS_BUCKET_COUNT; j++) {
+            payload.entries[i].hist[j] = U16HTONS(stats.entries[i].hist[j]);
+        }
+    }
+    // Only the used entries are sent
+    uint16_t size = sizeof(payload) - (NFC_TAG_14A_STATS_ENTRY_COUNT - stats.entry_count) * sizeof(payload.entries[0]);
+    return data_frame_make(cmd, STATUS_SUCCESS, size, (uint8_t *)&payload);
+}
+
 static data_frame_tx_t *cmd_processor_mf1_get_write_mode(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     uint8_t mode = nfc_tag_mf1_get_write_mode();
     return data_frame_make(cmd, STATUS_SUCCESS, 1, &mode);
@@ -937,18 +1267,43 @@ static data_frame_tx_t *before_reader_run(uint16_t cmd, uint16_t status, uint16_
  */
 static data_frame_tx_t *before_hf_reader_run(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     data_frame_tx_t *ret = before_reader_run(cmd, status, length, data);
-    if (ret == NULL) {
-        pcd_14a_reader_reset();
-        pcd_14a_reader_antenna_on();
-        bsp_delay_ms(8);
+    if (ret != NULL) {
+        return ret;
+    }
+    if (m_hf_session_open && g_is_reader_antenna_on) {
+        // reader session, the field is already up: keep the tag selected for the single block commands only,
+        // every other command selects the tag by itself
+        hf_session_idle_stop();
+        if (cmd != DATA_CMD_MF1_AUTH_ONE_KEY_BLOCK && cmd != DATA_CMD_MF1_READ_ONE_BLOCK && cmd != DATA_CMD_MF1_WRITE_ONE_BLOCK) {
+            mf1_toolbox_session_reset();
+        }
+        // only APDU exchanges keep the tag in the ISO14443-4 protocol state
+        if (cmd != DATA_CMD_HF14A_APDU) {
+            iso14443_4_reader_reset();
+        }
+        return NULL;
+    }
+    if (m_hf_session_open) {
+        // something turned the field off, power the tag again
+        hf_session_idle_stop();
+        mf1_toolbox_session_reset();
     }
-    return ret;
+    iso14443_4_reader_reset();
+    pcd_14a_reader_reset();
+    pcd_14a_reader_antenna_on();
+    bsp_delay_ms(8);
+    return NULL;
 }
 
 /**
  * after reader run, off antenna, to keep battery.
+ * In a reader session the field stays on until the session is closed or idle.
  */
 static data_frame_tx_t *after_hf_reader_run(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
+    if (m_hf_session_open) {
+        hf_session_idle_start();
+        return NULL;
+    }
     pcd_14a_reader_antenna_off();
     return NULL;
 }
@@ -1015,6 +1370,13 @@ static cmd_data_map_t m_data_cmd_map[] = {
     {    DATA_CMD_MF1_READ_ONE_BLOCK,           before_hf_reader_run,        cmd_processor_mf1_read_one_block,            after_hf_reader_run    },
     {    DATA_CMD_MF1_WRITE_ONE_BLOCK,          before_hf_reader_run,        cmd_processor_mf1_write_one_block,           after_hf_reader_run    },
     {    DATA_CMD_HF14A_RAW,                    before_reader_run,           cmd_processor_hf14a_raw,                     NULL                   },
+    {    DATA_CMD_MF1_CHECK_KEYS_OF_SECTORS,    before_hf_reader_run,        cmd_processor_mf1_check_keys_of_sectors,     after_hf_reader_run    },
+    {    DATA_CMD_MF1_READ_SECTORS,             before_hf_reader_run,        cmd_processor_mf1_read_sectors,              after_hf_reader_run    },
+    {    DATA_CMD_HF14A_SESSION_OPEN,           before_reader_run,           cmd_processor_hf14a_session_open,            NULL                   },
+    {    DATA_CMD_HF14A_SESSION_CLOSE,          before_reader_run,           cmd_processor_hf14a_session_close,           NULL                   },
+    {    DATA_CMD_HF14A_SELECT,                 before_hf_reader_run,        cmd_processor_hf14a_select,                  after_hf_reader_run    },
+    {    DATA_CMD_HF14A_APDU,                   before_hf_reader_run,        cmd_processor_hf14a_apdu,                    after_hf_reader_run    },
+    {    DATA_CMD_MF1_NESTED_ACQUIRE_SECTORS,   before_hf_reader_run,        cmd_processor_mf1_nested_acquire_sectors,    after_hf_reader_run    },
 
     {    DATA_CMD_EM410X_SCAN,                  before_reader_run,           cmd_processor_em410x_scan,                   NULL                   },
     {    DATA_CMD_EM410X_WRITE_TO_T55XX,        before_reader_run,           cmd_processor_em410x_write_to_t55XX,         NULL                   },
@@ -1039,6 +1401,11 @@ static cmd_data_map_t m_data_cmd_map[] = {
     {    DATA_CMD_MF1_GET_WRITE_MODE,           NULL,                        cmd_processor_mf1_get_write_mode,            NULL                   },
     {    DATA_CMD_MF1_SET_WRITE_MODE,           NULL,                        cmd_processor_mf1_set_write_mode,            NULL                   },
     {    DATA_CMD_HF14A_GET_ANTI_COLL_DATA,     NULL,                        cmd_processor_hf14a_get_anti_coll_data,      NULL                   },
+    {    DATA_CMD_MF1_GET_FAST_CRYPTO1_MODE,    NULL,                        cmd_processor_mf1_get_fast_crypto1_mode,     NULL                   },
+    {    DATA_CMD_MF1_SET_FAST_CRYPTO1_MODE,    NULL,                        cmd_processor_mf1_set_fast_crypto1_mode,     NULL                   },
+    {    DATA_CMD_MF1_CRYPTO1_BENCH,            NULL,                        cmd_processor_mf1_crypto1_bench,             NULL                   },
+    {    DATA_CMD_HF14A_GET_EMU_STATS,          NULL,                        cmd_processor_hf14a_get_emu_stats,           NULL                   },
+    {    DATA_CMD_MF1_STREAM_DETECTION_LOG,     NULL,                        cmd_processor_mf1_stream_detection_log,      NULL                   },
 
     {    DATA_CMD_EM410X_SET_EMU_ID,            NULL,                        cmd_processor_em410x_set_emu_id,             NULL                   },
     {    DATA_CMD_EM410X_GET_EMU_ID,            NULL,                        cmd_processor_em410x_get_emu_id,             NULL                   },
@@ -1074,10 +1441,58 @@ static void auto_response_data(data_frame_tx_t *resp) {
 }
 
 
+/**
+ * Close the reader session once idle or when the device left the reader mode, from the main loop.
+ */
+void hf_reader_session_process(void) {
+#if defined(PROJECT_CHAMELEON_ULTRA)
+    if (m_hf_session_open && (m_hf_session_expired || get_device_mode() != DEVICE_MODE_READER)) {
+        NRF_LOG_INFO("HF reader session closed");
+        hf_session_close();
+    }
+#endif
+}
+
+/**
+ * Send the next frame of a detection log export, from the main loop, once the link took the previous one.
+ * Each frame holds the index of its first log and as many logs as fit, an empty one ends the export.
+ */
+void mf1_detection_log_stream_process(void) {
+    if (!m_detection_log_stream.active) {
+        return;
+    }
+    if (!is_usb_working() && !is_nus_working()) {
+        // Nobody left to send to
+        m_detection_log_stream.active = false;
+        return;
+    }
+    if (is_usb_working() && is_usb_tx_busy()) {
+        return;
+    }
+    struct {
+        uint32_t cursor;
+        nfc_tag_mf1_auth_log_t logs[MF1_AUTH_LOG_PAGE_SIZE];
+    } PACKED payload;
+    uint32_t max = MIN(m_detection_log_stream.end - m_detection_log_stream.cursor, MF1_AUTH_LOG_PAGE_SIZE);
+    uint32_t count = nfc_tag_mf1_detection_log_read(m_detection_log_stream.cursor, payload.logs, max);
+    payload.cursor = U32HTONL(m_detection_log_stream.cursor);
+    m_detection_log_stream.cursor += count;
+    if (count == 0) {
+        m_detection_log_stream.active = false;
+    }
+    auto_response_data(data_frame_make(DATA_CMD_MF1_STREAM_DETECTION_LOG, STATUS_SUCCESS,
+                                       sizeof(payload.cursor) + count * sizeof(nfc_tag_mf1_auth_log_t), (uint8_t *)&payload));
+}
+
 /**@brief Function to process data frame(cmd)
  */
 void on_data_frame_received(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data) {
     data_frame_tx_t *response = NULL;
+    // Any command stops a detection log export, and its response must not overwrite the frame still being sent
+    m_detection_log_stream.active = false;
+    if (is_usb_working()) {
+        usb_cdc_wait_tx_done();
+    }
     bool is_cmd_support = false;
     for (int i = 0; i < ARRAY_SIZE(m_data_cmd_map); i++) {
         if (m_data_cmd_map[i].cmd == cmd) {
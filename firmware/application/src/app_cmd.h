@@ -15,5 +15,7 @@ typedef struct {
 } cmd_data_map_t;
 
 void on_data_frame_received(uint16_t cmd, uint16_t status, uint16_t length, uint8_t *data);
+void hf_reader_session_process(void);
+void mf1_detection_log_stream_process(void);
 
 #endif
@@ -871,6 +871,11 @@ int main(void) {
         blink_usb_led_status();
         // Data pack process
         data_frame_process();
+        // Reader session idle process
+        hf_reader_session_process();
+        // Detection log export and spill to flash process
+        mf1_detection_log_stream_process();
+        nfc_tag_mf1_detection_log_spill_process();
         // Log print process
         while (NRF_LOG_PROCESS());
         // USB event process
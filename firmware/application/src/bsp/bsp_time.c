@@ -1,5 +1,7 @@
 #include "bsp_time.h"
 #include "app_timer.h"
+#include "app_error.h"
+#include "nrfx_timer.h"
 
 
 #define TICK_PERIOD APP_TIMER_TICKS(10) // Timing
@@ -7,6 +9,12 @@
 // Define a soft timer
 APP_TIMER_DEF(m_app_timer);
 
+// Microsecond time base, TIMER4 free running at 1MHz over 32 bits:
+// CC0 captures the current time, CC1 is the deadline of bsp_us_wait
+static const nrfx_timer_t m_us_timer = NRFX_TIMER_INSTANCE(4);
+// Number of users of the time base, it only runs (and keeps HFCLK on) while someone needs it
+static uint8_t m_us_timer_users = 0;
+
 // Timer pool
 autotimer bsptimers[TIMER_BSP_COUNT] = { 0 };
 // Timer iteration position
@@ -106,3 +114,48 @@ void bsp_timer_stop(void) {
         }
     }
 }
+
+static void us_timer_event_handler(nrf_timer_event_t event_type, void *p_context) {
+    // Nothing to do, the compare interrupt only wakes up bsp_us_wait
+}
+
+// Start the microsecond time base, or only count one more user when it runs
+void bsp_us_timer_acquire(void) {
+    if (m_us_timer_users++ == 0) {
+        nrfx_timer_config_t timer_cfg = NRFX_TIMER_DEFAULT_CONFIG;
+        timer_cfg.frequency = NRF_TIMER_FREQ_1MHz;
+        timer_cfg.mode = NRF_TIMER_MODE_TIMER;
+        timer_cfg.bit_width = NRF_TIMER_BIT_WIDTH_32;
+        ret_code_t err_code = nrfx_timer_init(&m_us_timer, &timer_cfg, us_timer_event_handler);
+        APP_ERROR_CHECK(err_code);
+        nrfx_timer_enable(&m_us_timer);
+    }
+}
+
+// Release the microsecond time base, stopped with its last user
+void bsp_us_timer_release(void) {
+    if (m_us_timer_users > 0 && --m_us_timer_users == 0) {
+        nrfx_timer_disable(&m_us_timer);
+        nrfx_timer_uninit(&m_us_timer);
+    }
+}
+
+// Current time of the microsecond time base, wraps after about 71 minutes
+uint32_t bsp_us_now(void) {
+    return nrfx_timer_capture(&m_us_timer, NRF_TIMER_CC_CHANNEL0);
+}
+
+/*
+* Sleep until *flag is set (by an interrupt) or until timeout_us elapsed since start,
+* the compare interrupt wakes the CPU up at the deadline so nothing is polled.
+* flag may be NULL to only wait for the deadline.
+* Returns the flag value.
+*/
+bool bsp_us_wait(uint32_t start, uint32_t timeout_us, volatile bool *flag) {
+    nrfx_timer_compare(&m_us_timer, NRF_TIMER_CC_CHANNEL1, start + timeout_us, true);
+    while (!(flag != NULL && *flag) && NO_TIMEOUT_US(start, timeout_us)) {
+        __WFE();
+    }
+    nrfx_timer_compare_int_disable(&m_us_timer, NRF_TIMER_CC_CHANNEL1);
+    return flag != NULL && *flag;
+}
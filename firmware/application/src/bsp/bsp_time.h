@@ -2,6 +2,7 @@
 #define _DrvTime2_h_
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef NULL
 #define NULL        ((void *)0)
@@ -21,6 +22,8 @@ typedef struct {
 
 // Realize a grand definition of judgment timeout
 #define NO_TIMEOUT_1MS(timer, count)    ((((autotimer*)timer)->time <= (count))?  1: 0)
+// Timeout on the microsecond time base: less than timeout_us elapsed since start (a bsp_us_now value), wrap safe
+#define NO_TIMEOUT_US(start, timeout_us)    ((uint32_t)(bsp_us_now() - (start)) < (uint32_t)(timeout_us))
 
 void bsp_timer_init(void);
 void bsp_timer_uninit(void);
@@ -31,5 +34,11 @@ void bsp_return_timer(autotimer *timer);
 autotimer *bsp_obtain_timer(uint32_t start_value);
 uint8_t bsp_set_timer(autotimer *timer, uint32_t start_value);
 
+// Microsecond time base, running while at least one user acquired it
+void bsp_us_timer_acquire(void);
+void bsp_us_timer_release(void);
+uint32_t bsp_us_now(void);
+bool bsp_us_wait(uint32_t start, uint32_t timeout_us, volatile bool *flag);
+
 
 #endif
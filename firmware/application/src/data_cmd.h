@@ -66,6 +66,13 @@
 #define DATA_CMD_MF1_READ_ONE_BLOCK             (2008)
 #define DATA_CMD_MF1_WRITE_ONE_BLOCK            (2009)
 #define DATA_CMD_HF14A_RAW                      (2010)
+#define DATA_CMD_MF1_CHECK_KEYS_OF_SECTORS      (2011)
+#define DATA_CMD_MF1_READ_SECTORS               (2012)
+#define DATA_CMD_HF14A_SESSION_OPEN             (2013)
+#define DATA_CMD_HF14A_SESSION_CLOSE            (2014)
+#define DATA_CMD_HF14A_SELECT                   (2015)
+#define DATA_CMD_HF14A_APDU                     (2016)
+#define DATA_CMD_MF1_NESTED_ACQUIRE_SECTORS     (2017)
 
 //
 // ******************************************************************
@@ -104,6 +111,11 @@
 #define DATA_CMD_MF1_GET_WRITE_MODE             (4016)
 #define DATA_CMD_MF1_SET_WRITE_MODE             (4017)
 #define DATA_CMD_HF14A_GET_ANTI_COLL_DATA       (4018)
+#define DATA_CMD_MF1_GET_FAST_CRYPTO1_MODE      (4019)
+#define DATA_CMD_MF1_SET_FAST_CRYPTO1_MODE      (4020)
+#define DATA_CMD_MF1_CRYPTO1_BENCH              (4021)
+#define DATA_CMD_HF14A_GET_EMU_STATS            (4022)
+#define DATA_CMD_MF1_STREAM_DETECTION_LOG       (4023)
 //
 // ******************************************************************
 
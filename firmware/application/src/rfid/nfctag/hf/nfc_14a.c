@@ -1,6 +1,7 @@
 #include <hal/nrf_nfct.h>
 #include <nrfx_nfct.h>
 #include <nrf_gpio.h>
+#include "app_util_platform.h"
 
 #define NRF_LOG_MODULE_NAME nfc
 #include "nrf_log.h"
@@ -42,46 +43,11 @@ nfc_tag_14a_state_t m_tag_state_14a = NFC_TAG_STATE_14A_IDLE;
 // 14443A protocol processor
 nfc_tag_14a_handler_t m_tag_handler = {
     .cb_reset = NULL,       // Tag Reset callback
+    .cb_field = NULL,       // Field on/off callback, the tag powers up or down
     .cb_state = NULL,       // Label status machine callback
     .get_coll_res = NULL,   // Obtain packaging of anti -conflict resources of labels
 };
 
-// Byte mirror
-const uint8_t ByteMirror[256] = {
-    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
-    0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
-    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
-    0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
-    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4,
-    0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
-    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec,
-    0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
-    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
-    0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
-    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea,
-    0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
-    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6,
-    0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
-    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
-    0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
-    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1,
-    0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
-    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9,
-    0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
-    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
-    0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
-    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed,
-    0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
-    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3,
-    0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
-    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
-    0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
-    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7,
-    0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
-    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
-    0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
-};
-
 // RATS FSDI length check table
 const uint16_t ats_fsdi_table[] = {
     // 0 - 8
@@ -99,6 +65,96 @@ static uint8_t m_nfc_tx_buffer[MAX_NFC_TX_BUFFER_SIZE] = { 0x00 };
 // The N -secondary connection needs to use SAK, when the "third 'bit' in SAK is 1 is 1, the logo UID is incomplete
 static uint8_t m_uid_incomplete_sak[]   = { 0x04, 0xda, 0x17 };
 
+// Emulation statistics, counted in the NFCT interrupt
+static nfc_tag_14a_stats_t m_stats = { 0 };
+// Histogram bucket bounds, in microseconds for the client and in CPU cycles for the interrupt
+const uint16_t nfc_tag_14a_stats_bucket_us[NFC_TAG_14A_STATS_BUCKET_COUNT - 1] = { 10, 20, 40, 60, 80, 100, 200 };
+static uint32_t m_stats_bucket_cycles[NFC_TAG_14A_STATS_BUCKET_COUNT - 1];
+static uint32_t m_stats_cycles_per_us = 1;
+// The frame being processed: DWT cycle count at its end, its key and whether a CRC check failed
+static uint32_t m_stats_rx_cycles;
+static uint8_t m_stats_cmd;
+static uint8_t m_stats_length;
+static bool m_stats_crc_failed;
+// Entry of the response to the frame, for the frame delay timeout that may follow
+static nfc_tag_14a_stats_entry_t *m_stats_tx_entry;
+
+/**
+ * @brief Start the DWT cycle counter that times the responses
+ */
+static void nfc_tag_14a_stats_init(void) {
+    m_stats_cycles_per_us = SystemCoreClock / 1000000;
+    for (int i = 0; i < NFC_TAG_14A_STATS_BUCKET_COUNT - 1; i++) {
+        m_stats_bucket_cycles[i] = nfc_tag_14a_stats_bucket_us[i] * m_stats_cycles_per_us;
+    }
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Count a response, called once the transmission has been started so it costs no reply time
+ */
+static void nfc_tag_14a_stats_record(void) {
+    uint32_t cycles = DWT->CYCCNT - m_stats_rx_cycles;
+    nfc_tag_14a_stats_entry_t *entry = NULL;
+
+    m_stats.responses++;
+    for (int i = 0; i < m_stats.entry_count; i++) {
+        if (m_stats.entries[i].cmd == m_stats_cmd && m_stats.entries[i].length == m_stats_length) {
+            entry = &m_stats.entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (m_stats.entry_count == NFC_TAG_14A_STATS_ENTRY_COUNT) {
+            m_stats.overflow++;
+            m_stats_tx_entry = NULL;
+            return;
+        }
+        entry = &m_stats.entries[m_stats.entry_count++];
+        entry->cmd = m_stats_cmd;
+        entry->length = m_stats_length;
+    }
+    m_stats_tx_entry = entry;
+
+    entry->count++;
+    uint32_t us = cycles / m_stats_cycles_per_us;
+    if (us > entry->max_us) {
+        entry->max_us = us > UINT16_MAX ? UINT16_MAX : us;
+    }
+    int bucket = 0;
+    while (bucket < NFC_TAG_14A_STATS_BUCKET_COUNT - 1 && cycles > m_stats_bucket_cycles[bucket]) {
+        bucket++;
+    }
+    if (entry->hist[bucket] != UINT16_MAX) {
+        entry->hist[bucket]++;
+    }
+}
+
+/**
+ * @brief Key the response to the frame being processed by another first byte,
+ * for handlers that decrypt their frames. The frame length stays as received
+ * @param cmd  The command the frame carries
+ */
+void nfc_tag_14a_stats_label(uint8_t cmd) {
+    m_stats_cmd = cmd;
+}
+
+/**
+ * @brief Copy the emulation statistics
+ * @param stats  Where to copy them
+ * @param reset  Whether to clear them as well
+ */
+void nfc_tag_14a_stats_get(nfc_tag_14a_stats_t *stats, bool reset) {
+    CRITICAL_REGION_ENTER();
+    memcpy(stats, &m_stats, sizeof(m_stats));
+    if (reset) {
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_stats_tx_entry = NULL;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
 /**
  * @brief Calculate BCC
  *
@@ -137,142 +193,25 @@ bool nfc_tag_14a_checks_crc(uint8_t *pbtData, size_t szLen) {
     uint8_t c1 = pbtData[szLen - 2];
     uint8_t c2 = pbtData[szLen - 1];
     nfc_tag_14a_append_crc(pbtData, szLen - 2);
-    return pbtData[szLen - 2] == c1 && pbtData[szLen - 1] == c2;
-}
-
-/**
-* @brief  : Bit frames for packaging ISO14443A
-* Automatically conduct the merger of the parity of the coupling school and the data of the data
-* @param   pbtTx: bitstream to be transmitted
-*          szTxBits: The length of the buffer
-*          pbtTxPar: bitstream of the puppet school inspection, the length of this data must be szTxBits / 8, that is,
-* In fact, the composition of the bitstream after the merger is:
-*                    data(1byte) - par(1bit) - data(1byte) - par(1bit) ...
-*                      00001000  -   0       - 10101110    - 1
-*                    This similar data structure
-*          pbtFrame: The final assembled data buffer
-* @retval :The length of the bitstream assembly results buffer. Note that it is the length of the bit.
-*/
-uint8_t nfc_tag_14a_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame) {
-    uint8_t btData;
-    uint32_t uiBitPos;
-    uint32_t uiDataPos = 0;
-    size_t szBitsLeft = szTxBits;
-    size_t szFrameBits = 0;
-
-    // Make sure we should frame at least something
-    if (szBitsLeft == 0)
-        return 0;
-
-    // Handle a short response (1byte) as a special case
-    if (szBitsLeft < 9) {
-        *pbtFrame = *pbtTx;
-        szFrameBits = szTxBits;
-        return szFrameBits;
-    }
-    // We start by calculating the frame length in bits
-    szFrameBits = szTxBits + (szTxBits / 8);
-
-    // Parse the data bytes and add the parity bits
-    // This is really a sensitive process, mirror the frame bytes and append parity bits
-    // buffer = mirror(frame-byte) + parity + mirror(frame-byte) + parity + ...
-    // split "buffer" up in segments of 8 bits again and mirror them
-    // air-bytes = mirror(buffer-byte) + mirror(buffer-byte) + mirror(buffer-byte) + ..
-    while (1) {
-        // Reset the temporary frame byte;
-        uint8_t btFrame = 0;
-
-        for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-            // Copy as much data that fits in the frame byte
-            btData = ByteMirror[pbtTx[uiDataPos]];
-            btFrame |= (btData >> uiBitPos);
-            // Save this frame byte
-            *pbtFrame = ByteMirror[btFrame];
-            // Set the remaining bits of the date in the new frame byte and append the parity bit
-            btFrame = (btData << (8 - uiBitPos));
-            btFrame |= ((pbtTxPar[uiDataPos] & 0x01) << (7 - uiBitPos));
-            // Backup the frame bits we have so far
-            pbtFrame++;
-            *pbtFrame = ByteMirror[btFrame];
-            // Increase the data (without parity bit) position
-            uiDataPos++;
-            // Test if we are done
-            if (szBitsLeft < 9)
-                return szFrameBits;
-            szBitsLeft -= 8;
-        }
-        // Every 8 data bytes we lose one frame byte to the parities
-        pbtFrame++;
+    if (pbtData[szLen - 2] == c1 && pbtData[szLen - 1] == c2) {
+        return true;
     }
+    // Counted once per frame, however many times the frame gets checked
+    m_stats_crc_failed = true;
+    return false;
 }
 
 /**
-* @brief  :Bit frame of ISO14443A
-*           Automatically perform the unpacking of the puppet school inspection and the data
-* @param  :pbtFrame: bitstream that will be dismissed
-*          szFrameBits:The length of the buffer
-*          pbtRx:Caps, data areas, data areas, data areas, data areas, data areas.
-*          pbtRxPar: The buffer of the bitstream Store after the packaging, the coupling school inspection area
-* @retval :The data length of the bitstream packaging, note that the length of the data area is the length of the data area.retval / 8
-*/
-uint8_t nfc_tag_14a_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar) {
-    uint8_t btFrame;
-    uint8_t btData;
-    uint8_t uiBitPos;
-    uint32_t uiDataPos = 0;
-    uint8_t *pbtFramePos = (uint8_t *)pbtFrame;
-    size_t szBitsLeft = szFrameBits;
-    size_t szRxBits = 0;
-
-    // Make sure we should frame at least something
-    if (szBitsLeft == 0)
-        return 0;
-
-    // Handle a short response (1byte) as a special case
-    if (szBitsLeft < 9) {
-        *pbtRx = *pbtFrame;
-        szRxBits = szFrameBits;
-        return szRxBits;
-    }
-
-    // Calculate the data length in bits
-    szRxBits = szFrameBits - (szFrameBits / 9);
-
-    // Parse the frame bytes, remove the parity bits and store them in the parity array
-    // This process is the reverse of WrapFrame(), look there for more info
-    while (1) {
-        for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-            btFrame = ByteMirror[pbtFramePos[uiDataPos]];
-            btData = (btFrame << uiBitPos);
-            btFrame = ByteMirror[pbtFramePos[uiDataPos + 1]];
-            btData |= (btFrame >> (8 - uiBitPos));
-            pbtRx[uiDataPos] = ByteMirror[btData];
-            if (pbtRxPar != NULL)
-                pbtRxPar[uiDataPos] = ((btFrame >> (7 - uiBitPos)) & 0x01);
-            // Increase the data (without parity bit) position
-            uiDataPos++;
-            // Test if we are done
-            if (szBitsLeft < 9)
-                return szRxBits;
-            szBitsLeft -= 9;
-        }
-        // Every 8 data bytes we lose one frame byte to the parities
-        pbtFramePos++;
-    }
-}
-
-/**
- * @brief: Function for response reader core implemented
- * @param[in]   data       Send data buffer
+ * @brief: Function for response reader core implemented, the frame is sent by EasyDMA straight from the buffer
+ * @param[in]   buffer     Send data buffer, in RAM
  * @param[in]   bytes      Send data length
  * @param[in]   appendCrc  Auto append crc
  * @param[in]   delayMode  Timeslot, delay mode.
  */
-#define NFC_14A_TX_BYTE_CORE(data, bytes, appendCrc, delayMode)                                                  \
+#define NFC_14A_TX_FRAME_CORE(buffer, bytes, appendCrc, delayMode)                                               \
     do {                                                                                                         \
         m_is_responded = true;                                                                                   \
-        memcpy(m_nfc_tx_buffer, data, bytes);                                                                    \
-        NRF_NFCT->PACKETPTR = (uint32_t)(m_nfc_tx_buffer);                                                       \
+        NRF_NFCT->PACKETPTR = (uint32_t)(buffer);                                                                \
         NRF_NFCT->TXD.AMOUNT = (bytes << NFCT_TXD_AMOUNT_TXDATABYTES_Pos) & NFCT_TXD_AMOUNT_TXDATABYTES_Msk;     \
         NRF_NFCT->FRAMEDELAYMODE = delayMode;                                                                    \
         uint32_t reg = 0;                                                                                        \
@@ -285,6 +224,20 @@ uint8_t nfc_tag_14a_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBi
         NRF_NFCT->TXD.FRAMECONFIG = reg;                                                                         \
         NRF_NFCT->INTENSET = (NRF_NFCT_INT_TXFRAMESTART_MASK | NRF_NFCT_INT_TXFRAMEEND_MASK);                    \
         NRF_NFCT->TASKS_STARTTX = 1;                                                                             \
+        nfc_tag_14a_stats_record();                                                                              \
+    } while(0);                                                                                                  \
+
+/**
+ * @brief: Function for response reader core implemented
+ * @param[in]   data       Send data buffer
+ * @param[in]   bytes      Send data length
+ * @param[in]   appendCrc  Auto append crc
+ * @param[in]   delayMode  Timeslot, delay mode.
+ */
+#define NFC_14A_TX_BYTE_CORE(data, bytes, appendCrc, delayMode)                                                  \
+    do {                                                                                                         \
+        memcpy(m_nfc_tx_buffer, data, bytes);                                                                    \
+        NFC_14A_TX_FRAME_CORE(m_nfc_tx_buffer, bytes, appendCrc, delayMode);                                     \
     } while(0);                                                                                                  \
 
 
@@ -308,6 +261,18 @@ void nfc_tag_14a_tx_bytes_delay_freerun(uint8_t *data, uint32_t bytes, bool appe
     NFC_14A_TX_BYTE_CORE(data, bytes, appendCrc, NRF_NFCT_FRAME_DELAY_MODE_FREERUN);
 }
 
+/**@brief The function of sending the byte flow without copying it to the send buffer, this implementation automatically sends SOF
+ *
+ * @param[in]   data       The byte flow data to be sent, it must stay in RAM and unchanged until the frame is sent
+ * @param[in]   bytes      The length of the byte flow to be sent, up to NFC_TAG_14A_TX_DIRECT_MAX_SIZE
+ * @param[in]   appendCrc  Whether to send the byte flow, automatically send the CRC16 verification automatically
+ */
+void nfc_tag_14a_tx_bytes_direct(uint8_t *data, uint32_t bytes, bool appendCrc) {
+    // The buffer size bounds the sent frames too, the receiving macro sets it back
+    NRF_NFCT->MAXLEN = (bytes << NFCT_MAXLEN_MAXLEN_Pos) & NFCT_MAXLEN_MAXLEN_Msk;
+    NFC_14A_TX_FRAME_CORE(data, bytes, appendCrc, NRF_NFCT_FRAME_DELAY_MODE_WINDOWGRID);
+}
+
 /**
  * @brief: Function for response reader core implemented
  * @param[in]   bits   Send bits length
@@ -323,6 +288,7 @@ void nfc_tag_14a_tx_bytes_delay_freerun(uint8_t *data, uint32_t bytes, bool appe
         NRF_NFCT->FRAMEDELAYMODE = mode;                                                        \
         NRF_NFCT->TXD.FRAMECONFIG = NFCT_TXD_FRAMECONFIG_SOF_Msk;                               \
         NRF_NFCT->TASKS_STARTTX = 1;                                                            \
+        nfc_tag_14a_stats_record();                                                             \
     } while(0);                                                                                 \
 
 /**@brief The function of sending the BIT stream, this implementation automatically sends SOF
@@ -386,6 +352,9 @@ void nfc_tag_14a_data_process(uint8_t *p_data) {
         szDataBits = nfc_tag_14a_unwrap_frame(p_data, szDataBits, p_data, NULL);
     }
 #endif
+    // Key of the response in the statistics, handlers may relabel it with nfc_tag_14a_stats_label
+    m_stats_cmd = p_data[0];
+    m_stats_length = (szDataBits + 7) / 8;
 
     // Start processing the received data, if it is a special frame, you can hand over the data to this link
     if (szDataBits <= 8) {
@@ -622,6 +591,10 @@ void nfc_tag_14a_event_callback(nrfx_nfct_evt_t const *p_event) {
 
             NRF_LOG_INFO("HF FIELD DETECTED");
 
+            if (m_tag_handler.cb_field != NULL) {
+                m_tag_handler.cb_field();
+            }
+
             //Turn off the automatic anti -collision, MCU management all the interaction process, and then enable the NFC peripherals so that Io can be performed after enable
             // 20221108 Fix the different enable switching process of NRF52840 and NRF52832
 #if defined(NRF52833_XXAA) || defined(NRF52840_XXAA)
@@ -643,6 +616,9 @@ void nfc_tag_14a_event_callback(nrfx_nfct_evt_t const *p_event) {
 
             TAG_FIELD_LED_OFF()
             m_tag_state_14a = NFC_TAG_STATE_14A_IDLE;
+            if (m_tag_handler.cb_field != NULL) {
+                m_tag_handler.cb_field();
+            }
 
             // nfc_core_reset();
 
@@ -661,6 +637,15 @@ void nfc_tag_14a_event_callback(nrfx_nfct_evt_t const *p_event) {
             break;
         }
         case NRFX_NFCT_EVT_RX_FRAMEEND: {
+            // The response time is counted from here
+            m_stats_rx_cycles = DWT->CYCCNT;
+            m_stats.rx_frames++;
+            if (p_event->params.rx_frameend.rx_status != 0) {
+                m_stats.rx_errors++;
+            }
+            m_stats_crc_failed = false;
+            m_stats_tx_entry = NULL;
+
             set_slot_light_color(RGB_GREEN);
             TAG_FIELD_LED_ON()
 
@@ -673,6 +658,9 @@ void nfc_tag_14a_event_callback(nrfx_nfct_evt_t const *p_event) {
             // This function processes the data sent by the card reader, and then read that you don't need to reply to the card reader. If you need it, reply
             // Don't reply if you don't need it, it makes sense, right?This is science.
             nfc_tag_14a_data_process(m_nfc_rx_buffer);
+            if (m_stats_crc_failed) {
+                m_stats.crc_errors++;
+            }
             // The above prompt tells us that when we do not need to reply to the card reader, we need to manually enable it
             if (!m_is_responded) {
                 nfc_fdt_reset();
@@ -687,6 +675,10 @@ void nfc_tag_14a_event_callback(nrfx_nfct_evt_t const *p_event) {
                     //If we respond to the label in the communication window, but we did not respond in time, then we need to make an error printing
                     // If this error appears very frequently, it may be that the MCU processing speed does not keep up. At this time, the developer needs to optimize the code
                     if (m_is_responded) {
+                        m_stats.fdt_misses++;
+                        if (m_stats_tx_entry != NULL) {
+                            m_stats_tx_entry->fdt_misses++;
+                        }
                         NRF_LOG_ERROR("NRFX_NFCT_ERROR_FRAMEDELAYTIMEOUT: %d", m_tag_state_14a);
                     }
                     break;
@@ -721,6 +713,7 @@ void nfc_tag_14a_set_handler(nfc_tag_14a_handler_t *handler) {
     if (handler != NULL) {
         // Take it directly to the implementation of the introduction to our global object
         m_tag_handler.cb_reset = handler->cb_reset;
+        m_tag_handler.cb_field = handler->cb_field;
         m_tag_handler.cb_state = handler->cb_state;
         m_tag_handler.get_coll_res = handler->get_coll_res;
     }
@@ -740,6 +733,7 @@ void nfc_tag_14a_sense_switch(bool enable) {
     if (m_nfc_sense_state == NFC_SENSE_STATE_NONE || m_nfc_sense_state == NFC_SENSE_STATE_DISABLE) {
         if (enable) {
             m_nfc_sense_state = NFC_SENSE_STATE_ENABLE;
+            nfc_tag_14a_stats_init();
             // Initialized interrupt event and callback
             nrfx_nfct_config_t nnct = { .rxtx_int_mask = (uint32_t)0xFFFFFFFF, .cb = nfc_tag_14a_event_callback };
             if (nrfx_nfct_init(&nnct) != NRFX_SUCCESS) {
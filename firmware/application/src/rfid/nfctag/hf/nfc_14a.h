@@ -2,9 +2,12 @@
 #define NFC_14A_H
 
 #include "tag_emulation.h"
+#include "nfc_14a_frame.h"
 
 #define MAX_NFC_RX_BUFFER_SIZE  64
 #define MAX_NFC_TX_BUFFER_SIZE  64
+// Longest frame the NFCT peripheral sends, CRC excluded, for nfc_tag_14a_tx_bytes_direct
+#define NFC_TAG_14A_TX_DIRECT_MAX_SIZE  257
 
 #define NFC_TAG_14A_CRC_LENGTH  2
 
@@ -82,16 +85,46 @@ typedef struct {
 
 // Communication reception function that needs to be implemented
 typedef void (*nfc_tag_14a_reset_handler_t)(void);
+typedef void (*nfc_tag_14a_field_handler_t)(void);
 typedef void (*nfc_tag_14a_state_handler_t)(uint8_t *data, uint16_t szBits);
 typedef nfc_tag_14a_coll_res_reference_t *(*nfc_tag_14a_coll_handler_t)(void);
 
 // The interface that 14A communication receiver needs to be implemented
 typedef struct {
     nfc_tag_14a_reset_handler_t cb_reset;
+    nfc_tag_14a_field_handler_t cb_field;
     nfc_tag_14a_state_handler_t cb_state;
     nfc_tag_14a_coll_handler_t get_coll_res;
 } nfc_tag_14a_handler_t;
 
+// Emulation statistics: processing time histogram buckets and command entries
+#define NFC_TAG_14A_STATS_BUCKET_COUNT  8
+#define NFC_TAG_14A_STATS_ENTRY_COUNT   16
+
+// Responses to one command, keyed by its first byte and frame length
+typedef struct {
+    uint8_t cmd;                                    // first byte, decrypted by the handler when it can
+    uint8_t length;                                 // frame length in bytes, parity bits removed
+    uint32_t count;                                 // responses sent
+    uint32_t fdt_misses;                            // responses that missed their frame delay time
+    uint16_t max_us;                                // longest time from rx end to tx start
+    uint16_t hist[NFC_TAG_14A_STATS_BUCKET_COUNT];  // times from rx end to tx start, saturating
+} nfc_tag_14a_stats_entry_t;
+
+typedef struct {
+    uint32_t rx_frames;     // frames received
+    uint32_t rx_errors;     // frames flagged by the NFCT peripheral
+    uint32_t crc_errors;    // frames whose CRC did not check
+    uint32_t responses;     // frames sent back
+    uint32_t fdt_misses;    // responses that missed their frame delay time
+    uint32_t overflow;      // responses to commands that found no free entry
+    uint8_t entry_count;
+    nfc_tag_14a_stats_entry_t entries[NFC_TAG_14A_STATS_ENTRY_COUNT];
+} nfc_tag_14a_stats_t;
+
+// Upper bounds of the histogram buckets in microseconds, the last bucket has none
+extern const uint16_t nfc_tag_14a_stats_bucket_us[NFC_TAG_14A_STATS_BUCKET_COUNT - 1];
+
 // Different or verification code
 void nfc_tag_14a_create_bcc(uint8_t *pbtData, size_t szLen, uint8_t *pbtBcc);
 void nfc_tag_14a_append_bcc(uint8_t *pbtData, size_t szLen);
@@ -100,20 +133,21 @@ void nfc_tag_14a_append_bcc(uint8_t *pbtData, size_t szLen);
 void nfc_tag_14a_append_crc(uint8_t *pbtData, size_t szLen);
 bool nfc_tag_14a_checks_crc(uint8_t *pbtData, size_t szLen);
 
-// 14A frame combination
-uint8_t nfc_tag_14a_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame);
-uint8_t nfc_tag_14a_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar);
-
 // 14A communication control
 void nfc_tag_14a_sense_switch(bool enable);
 void nfc_tag_14a_set_handler(nfc_tag_14a_handler_t *handler);
 void nfc_tag_14a_set_state(nfc_tag_14a_state_t state);
 void nfc_tag_14a_tx_bytes(uint8_t *data, uint32_t bytes, bool appendCrc);
 void nfc_tag_14a_tx_bytes_delay_freerun(uint8_t *data, uint32_t bytes, bool appendCrc);
+void nfc_tag_14a_tx_bytes_direct(uint8_t *data, uint32_t bytes, bool appendCrc);
 void nfc_tag_14a_tx_bits(uint8_t *data, uint32_t bits);
 void nfc_tag_14a_tx_nbit_delay_window(uint8_t data, uint32_t bits);
 void nfc_tag_14a_tx_nbit(uint8_t data, uint32_t bits);
 
+// 14A emulation statistics
+void nfc_tag_14a_stats_get(nfc_tag_14a_stats_t *stats, bool reset);
+void nfc_tag_14a_stats_label(uint8_t cmd);
+
 // Determine whether it is an effective UID length
 bool is_valid_uid_size(uint8_t uid_length);
 
@@ -0,0 +1,146 @@
+#include "nfc_14a_frame.h"
+
+// No SDK dependency, so the host builds it too, see the crypto_bench target in software/src
+
+/**
+* @brief  : Bit frames for packaging ISO14443A
+* Automatically conduct the merger of the parity of the coupling school and the data of the data
+* @param   pbtTx: bitstream to be transmitted
+*          szTxBits: The length of the buffer
+*          pbtTxPar: bitstream of the puppet school inspection, the length of this data must be szTxBits / 8, that is,
+* In fact, the composition of the bitstream after the merger is:
+*                    data(1byte) - par(1bit) - data(1byte) - par(1bit) ...
+*                      00001000  -   0       - 10101110    - 1
+*                    This similar data structure
+*          pbtFrame: The final assembled data buffer
+* @retval :The length of the bitstream assembly results buffer. Note that it is the length of the bit.
+*/
+uint8_t nfc_tag_14a_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame) {
+    uint32_t uiAccu = 0;
+    uint8_t uiAccuBits = 0;
+    size_t szBytes;
+
+    // Make sure we should frame at least something
+    if (szTxBits == 0)
+        return 0;
+
+    // Handle a short response (1byte) as a special case
+    if (szTxBits < 9) {
+        *pbtFrame = *pbtTx;
+        return szTxBits;
+    }
+
+    // The air goes LSB first, so a byte and its parity are the 9 bits pattern data | par << 8:
+    // buffer = data + parity + data + parity + ...
+    // 8 data bytes fill exactly 9 frame bytes, so whole groups have their bit layout fixed
+    szBytes = (szTxBits + 7) / 8;
+    for (; szBytes >= 8; szBytes -= 8, pbtTx += 8, pbtTxPar += 8, pbtFrame += 9) {
+        pbtFrame[0] = pbtTx[0];
+        pbtFrame[1] = (pbtTxPar[0] & 0x01) | pbtTx[1] << 1;
+        pbtFrame[2] = pbtTx[1] >> 7 | (pbtTxPar[1] & 0x01) << 1 | pbtTx[2] << 2;
+        pbtFrame[3] = pbtTx[2] >> 6 | (pbtTxPar[2] & 0x01) << 2 | pbtTx[3] << 3;
+        pbtFrame[4] = pbtTx[3] >> 5 | (pbtTxPar[3] & 0x01) << 3 | pbtTx[4] << 4;
+        pbtFrame[5] = pbtTx[4] >> 4 | (pbtTxPar[4] & 0x01) << 4 | pbtTx[5] << 5;
+        pbtFrame[6] = pbtTx[5] >> 3 | (pbtTxPar[5] & 0x01) << 5 | pbtTx[6] << 6;
+        pbtFrame[7] = pbtTx[6] >> 2 | (pbtTxPar[6] & 0x01) << 6 | pbtTx[7] << 7;
+        pbtFrame[8] = pbtTx[7] >> 1 | (pbtTxPar[7] & 0x01) << 7;
+    }
+    // The rest goes through an accumulator, drained byte by byte
+    for (size_t i = 0; i < szBytes; i++) {
+        uiAccu |= (uint32_t)(pbtTx[i] | ((pbtTxPar[i] & 0x01) << 8)) << uiAccuBits;
+        // At most 7 bits are left over, so there is always room for 9 more
+        *pbtFrame++ = (uint8_t)uiAccu;
+        uiAccu >>= 8;
+        uiAccuBits += 1;
+    }
+    // Last bits of the frame
+    if (uiAccuBits != 0) {
+        *pbtFrame = (uint8_t)uiAccu;
+    }
+    // The frame length in bits
+    return szTxBits + (szTxBits / 8);
+}
+
+/**
+* @brief  :Bit frame of ISO14443A
+*           Automatically perform the unpacking of the puppet school inspection and the data
+* @param  :pbtFrame: bitstream that will be dismissed
+*          szFrameBits:The length of the buffer
+*          pbtRx:Caps, data areas, data areas, data areas, data areas, data areas.
+*          pbtRxPar: The buffer of the bitstream Store after the packaging, the coupling school inspection area
+* @retval :The data length of the bitstream packaging, note that the length of the data area is the length of the data area.retval / 8
+*/
+uint8_t nfc_tag_14a_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar) {
+    uint32_t uiAccu;
+    uint8_t uiAccuBits;
+    size_t szFrameBytes, szRxBits, szBytes;
+    size_t uiFramePos = 0;
+
+    // Make sure we should frame at least something
+    if (szFrameBits == 0)
+        return 0;
+
+    // Handle a short response (1byte) as a special case
+    if (szFrameBits < 9) {
+        *pbtRx = *pbtFrame;
+        return szFrameBits;
+    }
+
+    // Calculate the data length in bits
+    szRxBits = szFrameBits - (szFrameBits / 9);
+
+    // This process is the reverse of wrap_frame(), whole groups of 9 frame bytes first.
+    // A group is read before its data is written, so pbtRx may be pbtFrame
+    szFrameBytes = (szFrameBits + 7) / 8;
+    szBytes = (szRxBits + 7) / 8;
+    for (size_t szGroups = szFrameBits / 72; szGroups > 0; szGroups--) {
+        uint8_t f0 = pbtFrame[0], f1 = pbtFrame[1], f2 = pbtFrame[2], f3 = pbtFrame[3], f4 = pbtFrame[4];
+        uint8_t f5 = pbtFrame[5], f6 = pbtFrame[6], f7 = pbtFrame[7], f8 = pbtFrame[8];
+        pbtRx[0] = f0;
+        pbtRx[1] = f1 >> 1 | f2 << 7;
+        pbtRx[2] = f2 >> 2 | f3 << 6;
+        pbtRx[3] = f3 >> 3 | f4 << 5;
+        pbtRx[4] = f4 >> 4 | f5 << 4;
+        pbtRx[5] = f5 >> 5 | f6 << 3;
+        pbtRx[6] = f6 >> 6 | f7 << 2;
+        pbtRx[7] = f7 >> 7 | f8 << 1;
+        if (pbtRxPar != NULL) {
+            pbtRxPar[0] = f1 & 0x01;
+            pbtRxPar[1] = (f2 >> 1) & 0x01;
+            pbtRxPar[2] = (f3 >> 2) & 0x01;
+            pbtRxPar[3] = (f4 >> 3) & 0x01;
+            pbtRxPar[4] = (f5 >> 4) & 0x01;
+            pbtRxPar[5] = (f6 >> 5) & 0x01;
+            pbtRxPar[6] = (f7 >> 6) & 0x01;
+            pbtRxPar[7] = (f8 >> 7) & 0x01;
+            pbtRxPar += 8;
+        }
+        pbtFrame += 9;
+        pbtRx += 8;
+        szFrameBytes -= 9;
+        szBytes -= 8;
+    }
+    // The rest is taken 9 bits patterns at a time out of an accumulator, read ahead of the data written
+    if (szBytes == 0)
+        return szRxBits;
+    uiAccu = pbtFrame[0];
+    uiAccuBits = 8;
+    for (size_t i = 0; i < szBytes; i++) {
+        // Each data byte takes one frame byte, every 8 data bytes we lose one more to the parities
+        if (uiFramePos + 1 < szFrameBytes) {
+            uiAccu |= (uint32_t)pbtFrame[++uiFramePos] << uiAccuBits;
+            uiAccuBits += 8;
+            if (uiAccuBits == 8 && uiFramePos + 1 < szFrameBytes) {
+                uiAccu |= (uint32_t)pbtFrame[++uiFramePos] << 8;
+                uiAccuBits = 16;
+            }
+        }
+        pbtRx[i] = (uint8_t)uiAccu;
+        if (pbtRxPar != NULL)
+            pbtRxPar[i] = (uiAccu >> 8) & 0x01;
+        uiAccu >>= 9;
+        // The last byte may be short of its parity
+        uiAccuBits = uiAccuBits > 9 ? uiAccuBits - 9 : 0;
+    }
+    return szRxBits;
+}
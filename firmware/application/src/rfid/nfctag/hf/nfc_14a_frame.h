@@ -0,0 +1,11 @@
+#ifndef NFC_14A_FRAME_H
+#define NFC_14A_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 14A frame combination
+uint8_t nfc_tag_14a_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame);
+uint8_t nfc_tag_14a_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar);
+
+#endif
@@ -4,13 +4,12 @@
 #include "nfc_14a.h"
 #include "hex_utils.h"
 #include "fds_util.h"
+#include "fds_ids.h"
 #include "tag_persistence.h"
 
-#ifdef NFC_MF1_FAST_SIM
 #include "mf1_crypto1.h"
-#else
 #include "crypto1_helper.h"
-#endif
+#include "nrf.h"
 
 #define NRF_LOG_MODULE_NAME tag_mf1
 #include "nrf_log.h"
@@ -191,20 +190,29 @@ static nfc_tag_mf1_tx_buffer_t m_tag_tx_buffer;
 //Save the specific type of MF1 currently being simulated
 static tag_specific_type_t m_tag_type;
 
-// Fast simulate is enable, we use internal crypto1 instance from 'mf1_crypto1.c'
-#ifndef NFC_MF1_FAST_SIM
-// mifare classic crypto1
+// mifare classic crypto1, the bit-serial engine keeps its state here,
+// the fast engine from 'mf1_crypto1.c' keeps an internal instance
 static struct Crypto1State mpcs = {0, 0};
 static struct Crypto1State *pcs = &mpcs;
-#endif
+// Engine of the current session, latched at auth so that changing the slot config cannot switch it halfway
+static bool m_fast_crypto1 = false;
 
 // Define the buffer of the data that stored the detected data
-// Place this data in a dormant RAM to save time and space to write into Flash
-#define MF1_AUTH_LOG_MAX_SIZE   1000
+// Place this data in a dormant RAM ring, full pages of it are spilled to Flash once the field is gone,
+// since writing Flash stalls the CPU for longer than a frame delay time
+#define MF1_AUTH_LOG_RING_SIZE      (MF1_AUTH_LOG_RING_PAGES * MF1_AUTH_LOG_PAGE_SIZE)
+#define MF1_AUTH_LOG_RING_PAGES     36
+#define MF1_AUTH_LOG_FLASH_PAGES    64
 static __attribute__((section(".noinit"))) struct nfc_tag_mf1_auth_log_buffer {
-    uint32_t count;
-    nfc_tag_mf1_auth_log_t logs[MF1_AUTH_LOG_MAX_SIZE];
+    uint32_t head;      // records ever appended to the ring, 0xFFFFFFFF after the first power up
+    uint32_t tail;      // records ever spilled from the ring, always a whole number of pages
+    nfc_tag_mf1_auth_log_t logs[MF1_AUTH_LOG_RING_SIZE];
 } m_auth_log;
+// Pages in Flash ahead of the ring, counted from FDS on first use
+static uint32_t m_auth_log_flash_pages = 0;
+static bool m_auth_log_flash_loaded = false;
+// Set when FDS refused a page, the rest stays in the ring until the log is cleared
+static bool m_auth_log_flash_full = false;
 
 static uint8_t CardResponse[4];
 static uint8_t ReaderResponse[4];
@@ -330,26 +338,40 @@ void nfc_tag_mf1_random_nonce(uint8_t nonce[4], bool isNested) {
  * @param block: The block currently verified
  * @param nonce: Brightly random number
  */
-void append_mf1_auth_log_step1(bool isKeyB, bool isNested, uint8_t block, uint8_t *nonce) {
-    // Power up for the first time, reset the buffer information
-    if (m_auth_log.count == 0xFFFFFFFF) {
-        m_auth_log.count = 0;
+static void auth_log_ring_check(void) {
+    // Power up for the first time or a ring that makes no sense, reset the buffer information
+    if (m_auth_log.head == 0xFFFFFFFF || m_auth_log.head - m_auth_log.tail > MF1_AUTH_LOG_RING_SIZE ||
+            m_auth_log.tail % MF1_AUTH_LOG_PAGE_SIZE != 0) {
+        m_auth_log.head = 0;
+        m_auth_log.tail = 0;
         NRF_LOG_INFO("Mifare Classic auth log buffer ready");
     }
-    // Non -first -time call, see if you record whether the detection log is over the upper limit of the size
-    if (m_auth_log.count > MF1_AUTH_LOG_MAX_SIZE) {
+}
+
+// The record being written, NULL when the ring has no room left
+static nfc_tag_mf1_auth_log_t *auth_log_ring_next(void) {
+    if (m_auth_log.head - m_auth_log.tail >= MF1_AUTH_LOG_RING_SIZE) {
+        return NULL;
+    }
+    return &m_auth_log.logs[m_auth_log.head % MF1_AUTH_LOG_RING_SIZE];
+}
+
+void append_mf1_auth_log_step1(bool isKeyB, bool isNested, uint8_t block, uint8_t *nonce) {
+    auth_log_ring_check();
+    // See if the ring has room, the pages waiting for Flash must not be covered
+    nfc_tag_mf1_auth_log_t *log = auth_log_ring_next();
+    if (log == NULL) {
         // Skill this operation directly over the upper limit.
         NRF_LOG_INFO("Mifare Classic auth log buffer overflow");
         return;
     }
     // Determine whether this card slot enables the detection log record
     if (m_tag_information->config.detection_enable) {
-        m_auth_log.logs[m_auth_log.count].is_key_b = isKeyB;
-        m_auth_log.logs[m_auth_log.count].block = block;
-        m_auth_log.logs[m_auth_log.count].is_nested = isNested;
-        memcpy(m_auth_log.logs[m_auth_log.count].uid, UID_BY_CASCADE_LEVEL, 4);
-//        m_auth_log.logs[m_auth_log.count].nt = U32HTONL(*(uint32_t *)nonce);
-        memcpy(m_auth_log.logs[m_auth_log.count].nt, nonce, 4);
+        log->is_key_b = isKeyB;
+        log->block = block;
+        log->is_nested = isNested;
+        memcpy(log->uid, UID_BY_CASCADE_LEVEL, 4);
+        memcpy(log->nt, nonce, 4);
     }
 }
 
@@ -359,15 +381,14 @@ void append_mf1_auth_log_step1(bool isKeyB, bool isNested, uint8_t block, uint8_
  */
 void append_mf1_auth_log_step2(uint8_t *nr, uint8_t *ar) {
     // Determine to the upper limit and skip this operation directly to avoid covering the previous records
-    if (m_auth_log.count > MF1_AUTH_LOG_MAX_SIZE) {
+    nfc_tag_mf1_auth_log_t *log = auth_log_ring_next();
+    if (log == NULL) {
         return;
     }
     if (m_tag_information->config.detection_enable) {
         // Cache encryption information
-//        m_auth_log.logs[m_auth_log.count].nr = U32HTONL(*(uint32_t *)nr);
-//        m_auth_log.logs[m_auth_log.count].ar = U32HTONL(*(uint32_t *)ar);
-        memcpy(m_auth_log.logs[m_auth_log.count].nr, nr, 4);
-        memcpy(m_auth_log.logs[m_auth_log.count].ar, ar, 4);
+        memcpy(log->nr, nr, 4);
+        memcpy(log->ar, ar, 4);
     }
 }
 
@@ -377,25 +398,87 @@ void append_mf1_auth_log_step2(uint8_t *nr, uint8_t *ar) {
  */
 void append_mf1_auth_log_step3(bool is_auth_success) {
     // Determine to the upper limit and skip this operation directly to avoid covering the previous records
-    if (m_auth_log.count > MF1_AUTH_LOG_MAX_SIZE) {
+    if (auth_log_ring_next() == NULL) {
         return;
     }
     if (m_tag_information->config.detection_enable) {
         // Then you can end this record, the number of statistics increases
-        m_auth_log.count += 1;
+        m_auth_log.head += 1;
         // Print the number of logs in the current record
-        NRF_LOG_INFO("Auth log count: %d", m_auth_log.count);
+        NRF_LOG_INFO("Auth log count: %d", m_auth_log.head - m_auth_log.tail);
+    }
+}
+
+/** @brief Count the log pages already in Flash, once, Flash outlives the RAM ring
+ */
+static void auth_log_flash_load(void) {
+    if (m_auth_log_flash_loaded) {
+        return;
+    }
+    auth_log_ring_check();
+    m_auth_log_flash_pages = 0;
+    while (m_auth_log_flash_pages < MF1_AUTH_LOG_FLASH_PAGES &&
+            fds_is_exists(FDS_MF1_AUTH_LOG_FILE_ID, m_auth_log_flash_pages + 1)) {
+        m_auth_log_flash_pages++;
+    }
+    m_auth_log_flash_full = m_auth_log_flash_pages == MF1_AUTH_LOG_FLASH_PAGES;
+    m_auth_log_flash_loaded = true;
+    NRF_LOG_INFO("Mifare Classic auth log pages in flash: %d", m_auth_log_flash_pages);
+}
+
+/** @brief Move the full pages of the detection log from RAM to Flash, from the main loop.
+ * Nothing is written while a reader field is present, the ring holds a whole session
+ */
+void nfc_tag_mf1_detection_log_spill_process(void) {
+    if (g_is_tag_emulating) {
+        return;
+    }
+    auth_log_flash_load();
+    if (m_auth_log_flash_full || m_auth_log.head - m_auth_log.tail < MF1_AUTH_LOG_PAGE_SIZE) {
+        return;
+    }
+    // The ring size is a whole number of pages, so a page never wraps
+    nfc_tag_mf1_auth_log_t *page = &m_auth_log.logs[m_auth_log.tail % MF1_AUTH_LOG_RING_SIZE];
+    if (fds_write_sync(FDS_MF1_AUTH_LOG_FILE_ID, m_auth_log_flash_pages + 1, MF1_AUTH_LOG_PAGE_SIZE * sizeof(nfc_tag_mf1_auth_log_t), page)) {
+        m_auth_log_flash_pages++;
+        m_auth_log.tail += MF1_AUTH_LOG_PAGE_SIZE;
+        m_auth_log_flash_full = m_auth_log_flash_pages == MF1_AUTH_LOG_FLASH_PAGES;
+        NRF_LOG_INFO("Mifare Classic auth log page %d saved", m_auth_log_flash_pages);
+    } else {
+        m_auth_log_flash_full = true;
+        NRF_LOG_ERROR("Mifare Classic auth log page %d not saved, flash is full", m_auth_log_flash_pages + 1);
     }
 }
 
-/** @brief MF1 obtain verification log
- * @param count: The statistics of the verification log
+/** @brief MF1 obtain verification log, the pages in Flash first and then the ring
+ * @param index: The first log to read
+ * @param logs: Where to copy them
+ * @param max: How many logs at most
+ * @return The number of logs copied, 0 past the end
  */
-nfc_tag_mf1_auth_log_t *mf1_get_auth_log(uint32_t *count) {
-    // First pass the total number of logs verified by verified
-    *count = m_auth_log.count;
-    // Just return to the head pointer of the log number array
-    return m_auth_log.logs;
+uint32_t nfc_tag_mf1_detection_log_read(uint32_t index, nfc_tag_mf1_auth_log_t *logs, uint32_t max) {
+    static nfc_tag_mf1_auth_log_t page[MF1_AUTH_LOG_PAGE_SIZE];
+    uint32_t count = nfc_tag_mf1_detection_log_count();
+    uint32_t in_flash = m_auth_log_flash_pages * MF1_AUTH_LOG_PAGE_SIZE;
+    uint32_t n = 0;
+
+    while (n < max && index < count) {
+        if (index < in_flash) {
+            uint16_t length = sizeof(page);
+            if (!fds_read_sync(FDS_MF1_AUTH_LOG_FILE_ID, index / MF1_AUTH_LOG_PAGE_SIZE + 1, &length, (uint8_t *)page)) {
+                break;
+            }
+            uint32_t i = index % MF1_AUTH_LOG_PAGE_SIZE;
+            uint32_t take = MIN(MF1_AUTH_LOG_PAGE_SIZE - i, max - n);
+            memcpy(&logs[n], &page[i], take * sizeof(nfc_tag_mf1_auth_log_t));
+            n += take;
+            index += take;
+        } else {
+            logs[n++] = m_auth_log.logs[(m_auth_log.tail + index - in_flash) % MF1_AUTH_LOG_RING_SIZE];
+            index++;
+        }
+    }
+    return n;
 }
 
 static int get_block_max_by_tag_type(tag_specific_type_t tag_type) {
@@ -423,13 +506,91 @@ static bool check_block_max_overflow(uint8_t block) {
     return block > block_max;
 }
 
-#ifndef NFC_MF1_FAST_SIM
 void mf1_prng_by_bytes(uint8_t *nonces, uint32_t n) {
     uint32_t nonces_u32 = bytes_to_num(nonces, 4);
     nonces_u32 = prng_successor(nonces_u32, n);
     num_to_bytes(nonces_u32, 4, nonces);
 }
-#endif
+
+/**
+ * Crypto1 steps of the state machine, on the engine latched in m_fast_crypto1.
+ * Both engines give the same bits, the fast one trades tables for time.
+ */
+
+// Clock the tag PRNG n times, n is a multiple of 32
+static void mf1_cipher_prng(uint8_t nonce[4], uint8_t n) {
+    if (m_fast_crypto1) {
+        Crypto1PRNG(nonce, n);
+    } else {
+        mf1_prng_by_bytes(nonce, n);
+    }
+}
+
+// First auth: load the key and feed in uid ^ nt, nonce is left unchanged
+static void mf1_cipher_setup(uint8_t key[6], uint8_t uid[4], uint8_t nonce[4]) {
+    if (m_fast_crypto1) {
+        uint8_t nonce_copy[4];
+        // Crypto1Setup encrypts the nonce in-place, which nobody needs here
+        memcpy(nonce_copy, nonce, sizeof(nonce_copy));
+        Crypto1Setup(key, uid, nonce_copy);
+    } else {
+        // Set the Crypto1 key flow and discard the previous encryption state
+        crypto1_deinit(pcs);
+        crypto1_init(pcs, bytes_to_num(key, 6));
+        crypto1_word(pcs, bytes_to_num(uid, 4) ^ bytes_to_num(nonce, 4), 0);
+    }
+}
+
+// Nested auth: like mf1_cipher_setup, but the nonce is encrypted in-place and par gets its encrypted parity
+static void mf1_cipher_setup_nested(uint8_t key[6], uint8_t uid[4], uint8_t nonce[4], uint8_t par[4]) {
+    if (m_fast_crypto1) {
+        // Decrypt = false for the tag, decrypt = true for the reader
+        Crypto1SetupNested(key, uid, nonce, par, false);
+    } else {
+        uint8_t keystream[4];
+        crypto1_deinit(pcs);
+        crypto1_init(pcs, bytes_to_num(key, 6));
+        num_to_bytes(bytes_to_num(uid, 4) ^ bytes_to_num(nonce, 4), 4, keystream);
+        mf_crypto1_encryptEx(pcs, nonce, keystream, nonce, 4, par);
+    }
+}
+
+// Feed in the encrypted reader nonce nr, then decrypt the reader answer ar in-place
+static void mf1_cipher_reader_auth(uint8_t nr[4], uint8_t ar[4]) {
+    if (m_fast_crypto1) {
+        Crypto1Auth(nr);
+        Crypto1ByteArray(ar, 4);
+    } else {
+        crypto1_word(pcs, bytes_to_num(nr, 4), 1);
+        num_to_bytes(bytes_to_num(ar, 4) ^ crypto1_word(pcs, 0, 0), 4, ar);
+    }
+}
+
+// Decrypt a frame from the reader in-place
+static void mf1_cipher_decrypt(uint8_t *data, uint8_t len) {
+    if (m_fast_crypto1) {
+        Crypto1ByteArray(data, len);
+    } else {
+        mf_crypto1_decryptEx(pcs, data, len, data);
+    }
+}
+
+// Encrypt a frame for the reader in-place, par gets the encrypted parity bits
+static void mf1_cipher_encrypt(uint8_t *data, uint8_t *par, uint8_t len) {
+    if (m_fast_crypto1) {
+        Crypto1ByteArrayWithParity(data, par, len);
+    } else {
+        mf_crypto1_encrypt(pcs, data, len, par);
+    }
+}
+
+// Encrypt a 4 bit ACK/NAK
+static uint8_t mf1_cipher_nibble(uint8_t value) {
+    if (m_fast_crypto1) {
+        return value ^ Crypto1Nibble();
+    }
+    return mf_crypto1_encrypt4bit(pcs, value);
+}
 
 /** @brief MF1 status machine
  * @param data      From reading head data
@@ -454,9 +615,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                     m_gen1a_state = GEN1A_STATE_UNLOCKED_RW_WAIT;       // Update the Gen1A status machine
                     m_mf1_state = MF1_STATE_UNAUTHENTICATED;                     // Update MF1 status machine
                     nfc_tag_14a_tx_nbit_delay_window(ACK_VALUE, 4);     //Reply to the card reader Gen1a label unlock the back door success
-#ifndef NFC_MF1_FAST_SIM
                     crypto1_deinit(pcs);                                // Reset crypto1 handler
-#endif
                 } else {
                     m_gen1a_state = GEN1A_STATE_DISABLE;                // If you find that you have not taken the first step, directly reset the Gen1a status machine
                 }
@@ -499,6 +658,8 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
 
                             // Set KeyInUse as global use to retain information about identity verification
                             KeyInUse = p_data[0] & 1;
+                            // The session runs on the engine this slot asks for, until the next auth
+                            m_fast_crypto1 = m_tag_information->config.use_fast_crypto1;
 
                             // Obtain the specified sector access control bytes. Here we directly take the coincidence, convert the memory into a structure, and let the compiler help us maintain the pointing of the pointer
                             m_tag_trailer_info = (nfc_tag_mf1_trailer_info_t *)m_tag_information->memory[BlockEnd];
@@ -510,21 +671,13 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             for (uint8_t i = 0; i < sizeof(ReaderResponse); i++) {
                                 ReaderResponse[i] = CardNonce[i];
                             }
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1PRNG(ReaderResponse, 64);
-#else
-                            mf1_prng_by_bytes(ReaderResponse, 64);
-#endif
+                            mf1_cipher_prng(ReaderResponse, 64);
 
                             // Calculate our response based on the response from the card reader
                             for (uint8_t i = 0; i < sizeof(CardResponse); i++) {
                                 CardResponse[i] = ReaderResponse[i];
                             }
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1PRNG(CardResponse, 32);
-#else
-                            mf1_prng_by_bytes(CardResponse, 32);
-#endif
+                            mf1_cipher_prng(CardResponse, 32);
 
                             // Record verification log
                             append_mf1_auth_log_step1(KeyInUse, false, BlockAuth, CardNonce);
@@ -538,8 +691,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             m_tag_tx_buffer.tx_raw_buffer[2] = CardNonce[2];
                             m_tag_tx_buffer.tx_raw_buffer[3] = CardNonce[3];
 
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1Setup(
+                            mf1_cipher_setup(
                                 // Select A or B secrets based on the current instruction type
                                 KeyInUse ? m_tag_trailer_info->key_b : m_tag_trailer_info->key_a,
                                 // Passing the current anti -collision UID
@@ -547,17 +699,6 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                                 // Passing into a clear random number, this random number will be used to decrypt subsequent communication
                                 CardNonce
                             );
-#else
-                            // Set the Crypto1 key flow and discard the previous encryption state
-                            crypto1_deinit(pcs);
-                            // Load key flow
-                            crypto1_init(pcs,
-                                         // Select A or B secrets based on the current instruction type
-                                         bytes_to_num(KeyInUse ? m_tag_trailer_info->key_b : m_tag_trailer_info->key_a, 6)
-                                        );
-                            // Set key flow
-                            crypto1_word(pcs, bytes_to_num(UID_BY_CASCADE_LEVEL, 4) ^ bytes_to_num(CardNonce, 4), 0);
-#endif
                             // Responsible for clear -scale random number to read the card reader
                             nfc_tag_14a_tx_bytes(m_tag_tx_buffer.tx_raw_buffer, 4, false);
                             break;
@@ -622,22 +763,14 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
         }
 
         case MF1_STATE_AUTHENTICATING: {
+            // The frames from here on are encrypted, key their statistics by what they carry
+            nfc_tag_14a_stats_label(CMD_AUTH_A | KeyInUse);
             if (szDataBits == 64) {
                 //NR + AR responded to the card reader
                 append_mf1_auth_log_step2(p_data, &p_data[4]);
-#ifdef NFC_MF1_FAST_SIM
-                // Reader delivers an encrypted nonce. We use it to setup the crypto1 LFSR in nonlinear feedback mode. Furthermore it delivers an encrypted answer. Decrypt and check it
-                Crypto1Auth(&p_data[0]);
-                Crypto1ByteArray(&p_data[4], 4);
-#else
-                // NR, a random number generated by a card reader
-                uint32_t nr = bytes_to_num(p_data, 4);
-                // AR, is the encrypted data that we responded in the first step of the card encryption
-                uint32_t ar = bytes_to_num(&p_data[4], 4);
-                // --- crypto
-                crypto1_word(pcs, nr, 1);
-                num_to_bytes(ar ^ crypto1_word(pcs, 0, 0), 4, &p_data[4]);
-#endif
+                // Reader delivers an encrypted nonce NR. We use it to setup the crypto1 LFSR in nonlinear feedback mode.
+                // Furthermore it delivers an encrypted answer AR to the nonce of the first step. Decrypt and check it
+                mf1_cipher_reader_auth(&p_data[0], &p_data[4]);
                 // Was the random number of the return of the card reader was sent by us
                 if ((p_data[4] == ReaderResponse[0]) && (p_data[5] == ReaderResponse[1]) && (p_data[6] == ReaderResponse[2]) && (p_data[7] == ReaderResponse[3])) {
                     // The reader has passed the authentication.The estimated calculation card response data and generating the puppet test position.
@@ -646,11 +779,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                     m_tag_tx_buffer.tx_raw_buffer[2] = CardResponse[2];
                     m_tag_tx_buffer.tx_raw_buffer[3] = CardResponse[3];
                     //Encryption and calculation of the puppet school inspection
-#ifdef NFC_MF1_FAST_SIM
-                    Crypto1ByteArrayWithParity(m_tag_tx_buffer.tx_raw_buffer, m_tag_tx_buffer.tx_bit_parity, 4);
-#else
-                    mf_crypto1_encrypt(pcs, m_tag_tx_buffer.tx_raw_buffer, 4, m_tag_tx_buffer.tx_bit_parity);
-#endif
+                    mf1_cipher_encrypt(m_tag_tx_buffer.tx_raw_buffer, m_tag_tx_buffer.tx_bit_parity, 4);
                     // The verification is successful, and you need to enter the state that has been successfully verified
                     m_mf1_state = MF1_STATE_AUTHENTICATED;
                     // Package, stitch the Qiqi school inspection, return
@@ -673,11 +802,8 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
         case MF1_STATE_AUTHENTICATED: {
             if (szDataBits == 32) {
                 // In this state, all communication is encrypted.Therefore, we must first decrypt the data sent by the read head.
-#ifdef NFC_MF1_FAST_SIM
-                Crypto1ByteArray(p_data, 4);
-#else
-                mf_crypto1_decryptEx(pcs, p_data, 4, p_data);
-#endif
+                mf1_cipher_decrypt(p_data, 4);
+                nfc_tag_14a_stats_label(p_data[0]);
                 // After the decryption is completed, check whether the CRC is correct, and we must ensure that the data coming over is correct!
                 if (nfc_tag_14a_checks_crc(p_data, 4)) {
                     switch (p_data[0]) {
@@ -714,11 +840,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             // In any case, the data of the reply must be calculated CRC
                             nfc_tag_14a_append_crc(m_tag_tx_buffer.tx_raw_buffer, NFC_TAG_MF1_DATA_SIZE);
                             // Reply and calculate the coupling school inspection to reply to the card reader
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1ByteArrayWithParity(m_tag_tx_buffer.tx_raw_buffer, m_tag_tx_buffer.tx_bit_parity, NFC_TAG_MF1_FRAME_SIZE);
-#else
-                            mf_crypto1_encrypt(pcs, m_tag_tx_buffer.tx_raw_buffer, NFC_TAG_MF1_FRAME_SIZE, m_tag_tx_buffer.tx_bit_parity);
-#endif
+                            mf1_cipher_encrypt(m_tag_tx_buffer.tx_raw_buffer, m_tag_tx_buffer.tx_bit_parity, NFC_TAG_MF1_FRAME_SIZE);
                             // Combined Qiqi School Check Data Frame
                             m_tag_tx_buffer.tx_frame_bit_size = nfc_tag_14a_wrap_frame(m_tag_tx_buffer.tx_raw_buffer, 144, m_tag_tx_buffer.tx_bit_parity, m_tag_tx_buffer.tx_warp_frame);
                             // Start sending
@@ -731,21 +853,13 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                                 // Reset the 14A state machine directly, let the label sleep
                                 nfc_tag_14a_set_state(NFC_TAG_STATE_14A_HALTED);
                                 // Tell me to read the head. This operation is not allowed to be allowed
-#ifdef NFC_MF1_FAST_SIM
-                                nfc_tag_14a_tx_nbit(NAK_INVALID_OPERATION_TBIV ^ Crypto1Nibble(), 4);
-#else
-                                nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, NAK_INVALID_OPERATION_TBIV), 4);
-#endif
+                                nfc_tag_14a_tx_nbit(mf1_cipher_nibble(NAK_INVALID_OPERATION_TBIV), 4);
                             } else {
                                 // Normally write command.Store the address and prepare to receive the upcoming data.
                                 CurrentAddress = p_data[1];
                                 m_mf1_state = MF1_STATE_WRITE;
                                 // Take ACK response, inform the reading head we are ready
-#ifdef NFC_MF1_FAST_SIM
-                                nfc_tag_14a_tx_nbit(ACK_VALUE ^ Crypto1Nibble(), 4);
-#else
-                                nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, ACK_VALUE), 4);
-#endif
+                                nfc_tag_14a_tx_nbit(mf1_cipher_nibble(ACK_VALUE), 4);
                             }
                             return;
                         }
@@ -753,31 +867,19 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                         case CMD_DECREMENT: {
                             CurrentAddress = p_data[1];
                             m_mf1_state = MF1_STATE_DECREMENT;
-#ifdef NFC_MF1_FAST_SIM
-                            nfc_tag_14a_tx_nbit(ACK_VALUE ^ Crypto1Nibble(), 4);
-#else
-                            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, ACK_VALUE), 4);
-#endif
+                            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(ACK_VALUE), 4);
                             break;
                         }
                         case CMD_INCREMENT: {
                             CurrentAddress = p_data[1];
                             m_mf1_state = MF1_STATE_INCREMENT;
-#ifdef NFC_MF1_FAST_SIM
-                            nfc_tag_14a_tx_nbit(ACK_VALUE ^ Crypto1Nibble(), 4);
-#else
-                            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, ACK_VALUE), 4);
-#endif
+                            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(ACK_VALUE), 4);
                             break;
                         }
                         case CMD_RESTORE: {
                             CurrentAddress = p_data[1];
                             m_mf1_state = MF1_STATE_RESTORE;
-#ifdef NFC_MF1_FAST_SIM
-                            nfc_tag_14a_tx_nbit(ACK_VALUE ^ Crypto1Nibble(), 4);
-#else
-                            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, ACK_VALUE), 4);
-#endif
+                            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(ACK_VALUE), 4);
                             break;
                         }
                         case CMD_TRANSFER: {
@@ -794,11 +896,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                                 memcpy(m_tag_information->memory[p_data[1]], m_data_block_buffer, MEM_BYTES_PER_BLOCK);
                                 status = ACK_VALUE;
                             }
-#ifdef NFC_MF1_FAST_SIM
-                            nfc_tag_14a_tx_nbit(status ^ Crypto1Nibble(), 4);
-#else
-                            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, status), 4);
-#endif
+                            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(status), 4);
                             break;
                         }
                         case CMD_AUTH_A:
@@ -828,6 +926,8 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
 
                             // Set KeyInUse as global use to retain information about identity verification
                             KeyInUse = p_data[0] & 1;
+                            // The session runs on the engine this slot asks for, until the next auth
+                            m_fast_crypto1 = m_tag_information->config.use_fast_crypto1;
 
                             // Obtain the specified sector access control bytes. Here we directly take the coincidence, convert the memory into a structure, and let the compiler help us maintain the pointing of the pointer
                             m_tag_trailer_info = (nfc_tag_mf1_trailer_info_t *)m_tag_information->memory[BlockEnd];
@@ -839,21 +939,13 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             for (uint8_t i = 0; i < sizeof(ReaderResponse); i++) {
                                 ReaderResponse[i] = CardNonce[i];
                             }
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1PRNG(ReaderResponse, 64);
-#else
-                            mf1_prng_by_bytes(ReaderResponse, 64);
-#endif
+                            mf1_cipher_prng(ReaderResponse, 64);
 
                             // Calculate our response based on the response from the card reader
                             for (uint8_t i = 0; i < sizeof(CardResponse); i++) {
                                 CardResponse[i] = ReaderResponse[i];
                             }
-#ifdef NFC_MF1_FAST_SIM
-                            Crypto1PRNG(CardResponse, 32);
-#else
-                            mf1_prng_by_bytes(CardResponse, 32);
-#endif
+                            mf1_cipher_prng(CardResponse, 32);
 
                             // Record nested verification information
                             append_mf1_auth_log_step1(KeyInUse, true, BlockAuth, CardNonce);
@@ -867,9 +959,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             m_tag_tx_buffer.tx_raw_buffer[2] = CardNonce[2];
                             m_tag_tx_buffer.tx_raw_buffer[3] = CardNonce[3];
 
-#ifdef NFC_MF1_FAST_SIM
-                            /* Setup crypto1 cipher. Discard in-place encrypted CardNonce. */
-                            Crypto1SetupNested(
+                            mf1_cipher_setup_nested(
                                 // Select A or B secrets based on the current instruction type
                                 KeyInUse ? m_tag_trailer_info->key_b : m_tag_trailer_info->key_a,
                                 // Passing the current anti -collision UID
@@ -877,24 +967,8 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                                 // Passing into a clear random number, this random number will be encrypted and passed through this buffer area
                                 m_tag_tx_buffer.tx_raw_buffer,
                                 // A buffer that passed into a strange school inspection of random numbers
-                                m_tag_tx_buffer.tx_bit_parity,
-                                // Explain the user: Decrypt = false for the tag, decrypt = true for the reader
-                                // We are currently a label character, so we are introduced into false
-                                false
+                                m_tag_tx_buffer.tx_bit_parity
                             );
-#else
-                            // Set the Crypto1 key flow and discard the previous encryption state
-                            crypto1_deinit(pcs);
-                            //Load key flow
-                            crypto1_init(pcs,
-                                         // Select A or B secrets based on the current instruction type
-                                         bytes_to_num(KeyInUse ? m_tag_trailer_info->key_b : m_tag_trailer_info->key_a, 6)
-                                        );
-                            // Random number encryption
-                            uint8_t m_auth_nt_keystream[4];
-                            num_to_bytes(bytes_to_num(UID_BY_CASCADE_LEVEL, 4) ^ bytes_to_num(CardNonce, 4), 4, m_auth_nt_keystream);
-                            mf_crypto1_encryptEx(pcs, CardNonce, m_auth_nt_keystream, m_tag_tx_buffer.tx_raw_buffer, 4, m_tag_tx_buffer.tx_bit_parity);
-#endif
                             // In the case of nested verification, after the frame is set up, a encrypted random number is replied, and the puppet school inspection does not bring CRC
                             m_tag_tx_buffer.tx_frame_bit_size = nfc_tag_14a_wrap_frame(m_tag_tx_buffer.tx_raw_buffer, 32, m_tag_tx_buffer.tx_bit_parity, m_tag_tx_buffer.tx_warp_frame);
                             nfc_tag_14a_tx_bits(m_tag_tx_buffer.tx_warp_frame, m_tag_tx_buffer.tx_frame_bit_size);
@@ -906,11 +980,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                                 // If everything is normal, then we should make the card directly to sleep, and cannot respond to any message to the read head
                                 nfc_tag_14a_set_state(NFC_TAG_STATE_14A_HALTED);
                             } else {
-#ifdef NFC_MF1_FAST_SIM
-                                nfc_tag_14a_tx_nbit(NAK_INVALID_OPERATION_TBIV ^ Crypto1Nibble(), 4);
-#else
-                                nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, NAK_INVALID_OPERATION_TBIV), 4);
-#endif
+                                nfc_tag_14a_tx_nbit(mf1_cipher_nibble(NAK_INVALID_OPERATION_TBIV), 4);
                             }
                             break;
                         }
@@ -918,21 +988,13 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                             // If you read your hair, you don't know what ghost instructions, we can't handle it,
                             // Therefore, the task is abnormal, and the status needs to be reset, and the response to the reading head will not support this instruction
                             nfc_tag_14a_set_state(NFC_TAG_STATE_14A_IDLE);
-#ifdef NFC_MF1_FAST_SIM
-                            nfc_tag_14a_tx_nbit(NAK_INVALID_OPERATION_TBIV ^ Crypto1Nibble(), 4);
-#else
-                            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, NAK_INVALID_OPERATION_TBIV), 4);
-#endif
+                            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(NAK_INVALID_OPERATION_TBIV), 4);
                             break;
                         }
                     }
                 } else {
                     // CRC is wrong, return the error code notification
-#ifdef NFC_MF1_FAST_SIM
-                    nfc_tag_14a_tx_nbit(NAK_INVALID_OPERATION_TBIV ^ Crypto1Nibble(), 4);
-#else
-                    nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, NAK_INVALID_OPERATION_TBIV), 4);
-#endif
+                    nfc_tag_14a_tx_nbit(mf1_cipher_nibble(NAK_INVALID_OPERATION_TBIV), 4);
                     break;
                 }
             } else {
@@ -945,14 +1007,11 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
 
         case MF1_STATE_WRITE: {
             uint8_t status;
+            nfc_tag_14a_stats_label(CMD_WRITE);
             //It is currently in a state machine, we need to ensure that the received data is sufficient length
             if (szDataBits == 144) {
                 // Decrypted the 16 -byte to be written in data and 2 -byte CRCA
-#ifdef NFC_MF1_FAST_SIM
-                Crypto1ByteArray(p_data, NFC_TAG_MF1_FRAME_SIZE);
-#else
-                mf_crypto1_decryptEx(pcs, p_data, NFC_TAG_MF1_FRAME_SIZE, p_data);
-#endif
+                mf1_cipher_decrypt(p_data, NFC_TAG_MF1_FRAME_SIZE);
                 //The CRC that checks the data, ensure that the data received again is correct
                 if (nfc_tag_14a_checks_crc(p_data, NFC_TAG_MF1_FRAME_SIZE)) {
                     // Do not judge the current writing mode here to control the writing mode
@@ -975,11 +1034,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
             }
             // In any case, after the operation, the label will be allowed to return to the verification idle state
             m_mf1_state = MF1_STATE_AUTHENTICATED;
-#ifdef NFC_MF1_FAST_SIM
-            nfc_tag_14a_tx_nbit(status ^ Crypto1Nibble(), 4);
-#else
-            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, status), 4);
-#endif
+            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(status), 4);
             break;
         }
 
@@ -987,15 +1042,12 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
         case MF1_STATE_INCREMENT:
         case MF1_STATE_RESTORE: {
             uint8_t status;
+            nfc_tag_14a_stats_label(m_mf1_state == MF1_STATE_DECREMENT ? CMD_DECREMENT : (m_mf1_state == MF1_STATE_INCREMENT ? CMD_INCREMENT : CMD_RESTORE));
             if (szDataBits == (MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH) * 8) {
                 //When we arrived here, we have issued a decrease, increasing or recovery command, and the reader is now sending data.
                 // First, decrypt the data and check the CRC.Read the data in the requested block address into the global block buffer and check the integrity.
                 // Then, if necessary, add or decrease according to the command issued, and store the block back to the global block buffer.
-#ifdef NFC_MF1_FAST_SIM
-                Crypto1ByteArray(p_data, MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH);
-#else
-                mf_crypto1_decryptEx(pcs, p_data, MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH, p_data);
-#endif
+                mf1_cipher_decrypt(p_data, MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH);
                 // After decomposition, CRC must be verified to avoid using error data
                 if (nfc_tag_14a_checks_crc(p_data, MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH)) {
                     // Copy a piece of data first to the global buffer zone
@@ -1032,11 +1084,7 @@ void nfc_tag_mf1_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                 status = NAK_CRC_PARITY_ERROR_TBIV;
             }
             m_mf1_state = MF1_STATE_AUTHENTICATED;
-#ifdef NFC_MF1_FAST_SIM
-            nfc_tag_14a_tx_nbit(status ^ Crypto1Nibble(), 4);
-#else
-            nfc_tag_14a_tx_nbit(mf_crypto1_encrypt4bit(pcs, status), 4);
-#endif
+            nfc_tag_14a_tx_nbit(mf1_cipher_nibble(status), 4);
             break;
         }
 
@@ -1091,10 +1139,8 @@ void nfc_tag_mf1_reset_handler() {
     m_mf1_state = MF1_STATE_UNAUTHENTICATED;
     m_gen1a_state = GEN1A_STATE_DISABLE;
 
-#ifndef NFC_MF1_FAST_SIM
     // Must to reset pcs handler
     crypto1_deinit(pcs);
-#endif
 }
 
 /** @brief Obtain the length of effective information for the information structure
@@ -1193,6 +1239,7 @@ bool nfc_tag_mf1_data_factory(uint8_t slot, tag_specific_type_t tag_type) {
     p_mf1_information->config.use_mf1_coll_res = false;
     p_mf1_information->config.mode_block_write = NFC_TAG_MF1_WRITE_NORMAL;
     p_mf1_information->config.detection_enable = false;
+    p_mf1_information->config.use_fast_crypto1 = false;
 
     // save data to flash
     tag_sense_type_t sense_type = get_sense_type_from_tag_type(tag_type);
@@ -1219,14 +1266,21 @@ bool nfc_tag_mf1_is_detection_enable(void) {
     return m_tag_information->config.detection_enable;
 }
 
-// Clear detection record
+// Clear detection record, in RAM and in Flash
 void nfc_tag_mf1_detection_log_clear(void) {
-    m_auth_log.count = 0;
+    auth_log_flash_load();
+    while (m_auth_log_flash_pages > 0) {
+        fds_delete_sync(FDS_MF1_AUTH_LOG_FILE_ID, m_auth_log_flash_pages--);
+    }
+    m_auth_log_flash_full = false;
+    m_auth_log.head = 0;
+    m_auth_log.tail = 0;
 }
 
 // The number of statistics of detection records
 uint32_t nfc_tag_mf1_detection_log_count(void) {
-    return m_auth_log.count;
+    auth_log_flash_load();
+    return m_auth_log_flash_pages * MF1_AUTH_LOG_PAGE_SIZE + m_auth_log.head - m_auth_log.tail;
 }
 
 // Set gen1a magic mode
@@ -1272,3 +1326,81 @@ nfc_tag_mf1_write_mode_t nfc_tag_mf1_get_write_mode(void) {
     return m_tag_information->config.mode_block_write;
 }
 
+
+// Set crypto1 engine, fast or bit-serial
+void nfc_tag_mf1_set_fast_crypto1(bool enable) {
+    m_tag_information->config.use_fast_crypto1 = enable;
+}
+
+// Is crypto1 on the fast engine?
+bool nfc_tag_mf1_is_fast_crypto1(void) {
+    return m_tag_information->config.use_fast_crypto1;
+}
+
+#define MF1_BENCH_ROUNDS    16
+
+/** @brief Measure the crypto1 work of each state machine step on both engines, with the DWT cycle counter
+ * The best of MF1_BENCH_ROUNDS rounds is kept, so that interrupts do not count.
+ * The engines are left with dummy states, do not run it while a reader talks to the emulated card.
+ * @param cycles   CPU cycles of each step, indexed by nfc_tag_mf1_bench_step_t
+ */
+void nfc_tag_mf1_crypto1_bench(nfc_tag_mf1_bench_cycles_t cycles[MF1_BENCH_STEP_COUNT]) {
+    uint8_t key[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t uid[4] = { 0xDE, 0xAD, 0xBE, 0xEF };
+    uint8_t nonce[4], response[4];
+    uint8_t frame[NFC_TAG_MF1_FRAME_SIZE], parity[NFC_TAG_MF1_FRAME_SIZE];
+    uint32_t t[MF1_BENCH_STEP_COUNT + 1];
+    bool fast_crypto1 = m_fast_crypto1;
+
+    // Start the cycle counter, it may be off when no debugger is attached
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    for (int i = 0; i < MF1_BENCH_STEP_COUNT; i++) {
+        cycles[i].bit_serial = UINT32_MAX;
+        cycles[i].fast = UINT32_MAX;
+    }
+    // Rounds alternate between the engines
+    for (int r = 0; r < MF1_BENCH_ROUNDS * 2; r++) {
+        m_fast_crypto1 = r & 1;
+        num_to_bytes(0x01020304 + r, 4, nonce);
+        memset(frame, 0x5A, sizeof(frame));
+
+        // Same steps, in the order of nfc_tag_mf1_bench_step_t, as the state machine does them
+        t[MF1_BENCH_STEP_AUTH] = DWT->CYCCNT;
+        memcpy(response, nonce, 4);
+        mf1_cipher_prng(response, 64);
+        mf1_cipher_prng(response, 32);
+        mf1_cipher_setup(key, uid, nonce);
+        t[MF1_BENCH_STEP_AUTH_NESTED] = DWT->CYCCNT;
+        memcpy(response, nonce, 4);
+        mf1_cipher_prng(response, 64);
+        mf1_cipher_prng(response, 32);
+        memcpy(frame, nonce, 4);
+        mf1_cipher_setup_nested(key, uid, frame, parity);
+        t[MF1_BENCH_STEP_READER_AUTH] = DWT->CYCCNT;
+        mf1_cipher_reader_auth(&frame[0], &frame[4]);
+        t[MF1_BENCH_STEP_COMMAND] = DWT->CYCCNT;
+        mf1_cipher_decrypt(frame, 4);
+        t[MF1_BENCH_STEP_READ] = DWT->CYCCNT;
+        mf1_cipher_encrypt(frame, parity, NFC_TAG_MF1_FRAME_SIZE);
+        t[MF1_BENCH_STEP_ACK] = DWT->CYCCNT;
+        frame[0] = mf1_cipher_nibble(ACK_VALUE);
+        t[MF1_BENCH_STEP_WRITE] = DWT->CYCCNT;
+        mf1_cipher_decrypt(frame, NFC_TAG_MF1_FRAME_SIZE);
+        t[MF1_BENCH_STEP_VALUE] = DWT->CYCCNT;
+        mf1_cipher_decrypt(frame, MEM_VALUE_SIZE + NFC_TAG_14A_CRC_LENGTH);
+        t[MF1_BENCH_STEP_COUNT] = DWT->CYCCNT;
+
+        for (int i = 0; i < MF1_BENCH_STEP_COUNT; i++) {
+            uint32_t *best = m_fast_crypto1 ? &cycles[i].fast : &cycles[i].bit_serial;
+            if (t[i + 1] - t[i] < *best) {
+                *best = t[i + 1] - t[i];
+            }
+        }
+    }
+
+    // Whatever session was going on has lost its cipher state
+    m_fast_crypto1 = fast_crypto1;
+    m_mf1_state = MF1_STATE_UNAUTHENTICATED;
+}
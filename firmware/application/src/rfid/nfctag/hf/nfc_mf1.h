@@ -4,10 +4,6 @@
 #include "nfc_14a.h"
 #include "netdata.h"
 
-// Exchange space for time.
-// Fast simulate enable(Implement By ChameleonMini Repo)
-// #define NFC_MF1_FAST_SIM
-
 #define NFC_TAG_MF1_DATA_SIZE   16
 #define NFC_TAG_MF1_FRAME_SIZE  (NFC_TAG_MF1_DATA_SIZE + NFC_TAG_14A_CRC_LENGTH)
 #define NFC_TAG_MF1_BLOCK_MAX   256
@@ -71,8 +67,13 @@ typedef struct {
     uint8_t detection_enable: 1;
     // Allow to write block 0 (CUID/gen2 mode)
     uint8_t mode_gen2_magic: 1;
+    /**
+     * Run Crypto1 on the table driven engine from the ChameleonMini repo instead of the bit-serial crapto1 one.
+     * Exchange space for time, for readers with a tight frame delay.
+     */
+    uint8_t use_fast_crypto1: 1;
     // reserve
-    uint8_t reserved1: 4;
+    uint8_t reserved1: 3;
     uint8_t reserved2;
     uint8_t reserved3;
 } nfc_tag_mf1_configure_t;
@@ -138,8 +139,31 @@ typedef struct {
     // uint32_t ar;
 } PACKED nfc_tag_mf1_auth_log_t;
 
+// Crypto1 work of the state machine steps, measured by nfc_tag_mf1_crypto1_bench
+typedef enum {
+    MF1_BENCH_STEP_AUTH,            // PRNG and cipher setup of a first auth
+    MF1_BENCH_STEP_AUTH_NESTED,     // PRNG, cipher setup and nonce encryption of a nested auth
+    MF1_BENCH_STEP_READER_AUTH,     // NR feed in and AR decryption
+    MF1_BENCH_STEP_COMMAND,         // Decryption of a 4 bytes command
+    MF1_BENCH_STEP_READ,            // Encryption of a block and its CRC, with parity
+    MF1_BENCH_STEP_ACK,             // Encryption of an ACK/NAK nibble
+    MF1_BENCH_STEP_WRITE,           // Decryption of a block and its CRC
+    MF1_BENCH_STEP_VALUE,           // Decryption of a value operand and its CRC
+    MF1_BENCH_STEP_COUNT,
+} nfc_tag_mf1_bench_step_t;
+
+// CPU cycles of one step on each engine
+typedef struct {
+    uint32_t bit_serial;
+    uint32_t fast;
+} nfc_tag_mf1_bench_cycles_t;
+
+
+// Detection logs per Flash page, as many as a data frame carries
+#define MF1_AUTH_LOG_PAGE_SIZE  28
 
-nfc_tag_mf1_auth_log_t *mf1_get_auth_log(uint32_t *count);
+uint32_t nfc_tag_mf1_detection_log_read(uint32_t index, nfc_tag_mf1_auth_log_t *logs, uint32_t max);
+void nfc_tag_mf1_detection_log_spill_process(void);
 int nfc_tag_mf1_data_loadcb(tag_specific_type_t type, tag_data_buffer_t *buffer);
 int nfc_tag_mf1_data_savecb(tag_specific_type_t type, tag_data_buffer_t *buffer);
 bool nfc_tag_mf1_data_factory(uint8_t slot, tag_specific_type_t tag_type);
@@ -157,6 +181,9 @@ void nfc_tag_mf1_set_use_mf1_coll_res(bool enable);
 bool nfc_tag_mf1_is_use_mf1_coll_res(void);
 void nfc_tag_mf1_set_write_mode(nfc_tag_mf1_write_mode_t write_mode);
 nfc_tag_mf1_write_mode_t nfc_tag_mf1_get_write_mode(void);
+void nfc_tag_mf1_set_fast_crypto1(bool enable);
+bool nfc_tag_mf1_is_fast_crypto1(void);
+void nfc_tag_mf1_crypto1_bench(nfc_tag_mf1_bench_cycles_t cycles[MF1_BENCH_STEP_COUNT]);
 
 
 #endif
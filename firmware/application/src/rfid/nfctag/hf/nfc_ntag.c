@@ -22,6 +22,7 @@ NRF_LOG_MODULE_REGISTER();
 #define CMD_WRITE                   0xA2
 #define CMD_COMPAT_WRITE            0xA0
 #define CMD_READ_CNT                0x39
+#define CMD_INCR_CNT                0xA5
 #define CMD_PWD_AUTH                0x1B
 #define CMD_READ_SIG                0x3C
 
@@ -53,6 +54,13 @@ NRF_LOG_MODULE_REGISTER();
 
 // CONFIG masks to check individual needed bits
 #define CONF_ACCESS_PROT            0x80
+#define CONF_ACCESS_NFC_CNT_EN      0x10
+#define CONF_ACCESS_NFC_CNT_PWD_PROT 0x08
+
+// NFC COUNTER stuff, the 24 bit counter is kept LSB first in the page after the last tag page
+#define NFC_CNT_ADDRESS             0x02
+#define NFC_CNT_SIZE                3
+#define NFC_CNT_MAX                 0xFFFFFF
 
 #define VERSION_INFO_LENGTH         8 //8 bytes info length + crc
 
@@ -77,6 +85,10 @@ static nfc_tag_14a_coll_res_reference_t m_shadow_coll_res;
 static nfc_tag_ntag_tx_buffer_t m_tag_tx_buffer;
 // Save the specific type of NTAG currently being simulated
 static tag_specific_type_t m_tag_type;
+// Whether PWD_AUTH succeeded since the last activation
+static bool m_tag_authenticated = false;
+// Whether the nfc counter was already incremented since the last activation
+static bool m_tag_counter_incremented = false;
 
 static int get_block_max_by_tag_type(tag_specific_type_t tag_type) {
     int block_max;
@@ -112,6 +124,40 @@ static int get_block_cfg_by_tag_type(tag_specific_type_t tag_type) {
     return block_max;
 }
 
+static uint8_t get_access_by_tag_type(tag_specific_type_t tag_type) {
+    // The config area start is a byte address
+    return ((uint8_t *)m_tag_information->memory)[get_block_cfg_by_tag_type(tag_type) + CONF_ACCESS_OFFSET];
+}
+
+static uint8_t *get_counter_by_tag_type(tag_specific_type_t tag_type) {
+    return m_tag_information->memory[get_block_max_by_tag_type(tag_type)];
+}
+
+static uint32_t get_counter_value(uint8_t *counter) {
+    return counter[0] | (counter[1] << 8) | (counter[2] << 16);
+}
+
+static void set_counter_value(uint8_t *counter, uint32_t value) {
+    counter[0] = value & 0xFF;
+    counter[1] = (value >> 8) & 0xFF;
+    counter[2] = (value >> 16) & 0xFF;
+}
+
+/** @brief The nfc counter counts the first READ or FAST_READ after power up, when it is enabled by NFC_CNT_EN
+ */
+static void nfc_tag_ntag_counter_on_read(void) {
+    if (m_tag_counter_incremented || !(get_access_by_tag_type(m_tag_type) & CONF_ACCESS_NFC_CNT_EN)) {
+        return;
+    }
+    m_tag_counter_incremented = true;
+    uint8_t *counter = get_counter_by_tag_type(m_tag_type);
+    uint32_t value = get_counter_value(counter);
+    // The counter stops at its maximum value
+    if (value < NFC_CNT_MAX) {
+        set_counter_value(counter, value + 1);
+    }
+}
+
 void nfc_tag_ntag_state_handler(uint8_t *p_data, uint16_t szDataBits) {
     uint8_t command = p_data[0];
     uint8_t block_num = p_data[1];
@@ -135,10 +181,13 @@ void nfc_tag_ntag_state_handler(uint8_t *p_data, uint16_t szDataBits) {
             break;
         case CMD_READ:
             if (block_num < get_block_max_by_tag_type(m_tag_type)) {
+                // Past the last page the read rolls over to page 0, the counter page is never read
+                int block_max = get_block_max_by_tag_type(m_tag_type);
                 for (int block = 0; block < 4; block++) {
-                    memcpy(m_tag_tx_buffer.tx_buffer + block * 4, m_tag_information->memory[block_num + block], NFC_TAG_NTAG_DATA_SIZE);
+                    memcpy(m_tag_tx_buffer.tx_buffer + block * 4, m_tag_information->memory[(block_num + block) % block_max], NFC_TAG_NTAG_DATA_SIZE);
                 }
                 nfc_tag_14a_tx_bytes(m_tag_tx_buffer.tx_buffer, BYTES_PER_READ, true);
+                nfc_tag_ntag_counter_on_read();
             } else {
                 nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBIV, 4);
             }
@@ -149,10 +198,50 @@ void nfc_tag_ntag_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                 nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
                 break;
             }
-            for (int block = block_num; block <= end_block_num; block++) {
-                memcpy(m_tag_tx_buffer.tx_buffer + (block - block_num) * 4, m_tag_information->memory[block], NFC_TAG_NTAG_DATA_SIZE);
+            // The pages are contiguous in the slot memory, send them from there without copying,
+            // but one frame can't be longer than the NFCT peripheral sends
+            uint32_t bytes = (end_block_num - block_num + 1) * NFC_TAG_NTAG_DATA_SIZE;
+            if (bytes > NFC_TAG_14A_TX_DIRECT_MAX_SIZE) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
+                break;
             }
-            nfc_tag_14a_tx_bytes(m_tag_tx_buffer.tx_buffer, (end_block_num - block_num + 1) * NFC_TAG_NTAG_DATA_SIZE, true);
+            nfc_tag_14a_tx_bytes_direct(m_tag_information->memory[block_num], bytes, true);
+            nfc_tag_ntag_counter_on_read();
+            break;
+        }
+        case CMD_READ_CNT: {
+            if (block_num != NFC_CNT_ADDRESS) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
+                break;
+            }
+            // The counter may be password protected
+            if ((get_access_by_tag_type(m_tag_type) & CONF_ACCESS_NFC_CNT_PWD_PROT) && !m_tag_authenticated) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
+                break;
+            }
+            memcpy(m_tag_tx_buffer.tx_buffer, get_counter_by_tag_type(m_tag_type), NFC_CNT_SIZE);
+            nfc_tag_14a_tx_bytes(m_tag_tx_buffer.tx_buffer, NFC_CNT_SIZE, true);
+            break;
+        }
+        case CMD_INCR_CNT: {
+            // cmd + addr + 4 bytes increment value (LSB first, the last byte is ignored) + crc
+            if (szDataBits != (6 + NFC_TAG_14A_CRC_LENGTH) * 8 || !nfc_tag_14a_checks_crc(p_data, 6 + NFC_TAG_14A_CRC_LENGTH)) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_CRC_PARITY_ERROR_TBV, 4);
+                break;
+            }
+            if (block_num != NFC_CNT_ADDRESS) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
+                break;
+            }
+            uint8_t *counter = get_counter_by_tag_type(m_tag_type);
+            uint32_t value = get_counter_value(counter) + get_counter_value(&p_data[2]);
+            // The counter can't overflow
+            if (value > NFC_CNT_MAX) {
+                nfc_tag_14a_tx_nbit_delay_window(NAK_INVALID_OPERATION_TBV, 4);
+                break;
+            }
+            set_counter_value(counter, value);
+            nfc_tag_14a_tx_nbit_delay_window(ACK_VALUE, 4);
             break;
         }
         case CMD_WRITE:
@@ -171,6 +260,7 @@ void nfc_tag_ntag_state_handler(uint8_t *p_data, uint16_t szDataBits) {
                 break;
             }
             /* Authenticate the user */
+            m_tag_authenticated = true;
             //RESET AUTHLIM COUNTER, CURRENTLY NOT IMPLEMENTED
             // TODO
             /* Send the PACK value back */
@@ -201,11 +291,18 @@ nfc_tag_14a_coll_res_reference_t *get_ntag_coll_res() {
 }
 
 void nfc_tag_ntag_reset_handler() {
-    // TODO
+    // A new activation drops the authentication
+    m_tag_authenticated = false;
+}
+
+void nfc_tag_ntag_field_handler() {
+    // The nfc counter only counts once per power up, REQA/WUPA in the same field don't count again
+    m_tag_counter_incremented = false;
 }
 
 static int get_information_size_by_tag_type(tag_specific_type_t type) {
-    return sizeof(nfc_tag_14a_coll_res_entity_t) + sizeof(nfc_tag_ntag_configure_t) + (get_block_max_by_tag_type(type) * NFC_TAG_NTAG_DATA_SIZE);
+    // The pages are followed by the nfc counter page
+    return sizeof(nfc_tag_14a_coll_res_entity_t) + sizeof(nfc_tag_ntag_configure_t) + ((get_block_max_by_tag_type(type) + 1) * NFC_TAG_NTAG_DATA_SIZE);
 }
 
 /** @brief ntag's callback before saving data
@@ -234,6 +331,7 @@ int nfc_tag_ntag_data_loadcb(tag_specific_type_t type, tag_data_buffer_t *buffer
             .get_coll_res = get_ntag_coll_res,
             .cb_state = nfc_tag_ntag_state_handler,
             .cb_reset = nfc_tag_ntag_reset_handler,
+            .cb_field = nfc_tag_ntag_field_handler,
         };
         nfc_tag_14a_set_handler(&handler_for_14a);
         NRF_LOG_INFO("HF ntag data load finish.");
@@ -266,6 +364,8 @@ bool nfc_tag_ntag_data_factory(uint8_t slot, tag_specific_type_t tag_type) {
             memcpy(p_ntag_information->memory[block], default_p2, NFC_TAG_NTAG_DATA_SIZE);
         }
     }
+    // The nfc counter starts from zero
+    memset(p_ntag_information->memory[block_max], 0, NFC_TAG_NTAG_DATA_SIZE);
 
     // default ntag auto ant-collision res
     p_ntag_information->res_coll.atqa[0] = 0x44;
@@ -5,7 +5,7 @@
 
 #define NFC_TAG_NTAG_DATA_SIZE   4
 #define NFC_TAG_NTAG_FRAME_SIZE 64
-#define NFC_TAG_NTAG_BLOCK_MAX   231
+#define NFC_TAG_NTAG_BLOCK_MAX   232 // 231 pages of ntag216 + the hidden nfc counter page
 
 #define NTAG213_PAGES 45 //45 pages total for ntag213, from 0 to 44
 #define NTAG215_PAGES 135 //135 pages total for ntag215, from 0 to 134
@@ -215,6 +215,8 @@ static void load_data_by_tag_type(uint8_t slot, tag_specific_type_t tag_type) {
         NRF_LOG_INFO("Tag slot data no exists.");
         return;
     }
+    // Records saved by older firmware may be shorter, the fields they lack start from zero
+    memset(buffer->buffer + length, 0, buffer->length - length);
     ret = tag_emulation_load_by_buffer(tag_type, true);
     if (ret) {
         NRF_LOG_INFO("Load tag slot %d, type %d data done.", slot, tag_type);
@@ -0,0 +1,323 @@
+#include <string.h>
+
+#include "iso14443_4.h"
+#include "rc522.h"
+#include "bsp_delay.h"
+#include "app_status.h"
+#include "utils.h"
+
+#define NRF_LOG_MODULE_NAME iso14443_4
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+#include "nrf_log_default_backends.h"
+NRF_LOG_MODULE_REGISTER();
+
+
+// PCB of the blocks the reader sends, no CID and no NAD
+#define PCB_I_BLOCK         0x02
+#define PCB_R_ACK           0xA2
+#define PCB_R_NAK           0xB2
+#define PCB_S_DESELECT      0xC2
+#define PCB_S_WTX           0xF2
+#define PCB_CHAINING        0x10
+#define PCB_BLOCK_NUM       0x01
+
+#define PCB_IS_I_BLOCK(pcb)     (((pcb) & 0xE2) == 0x02)
+#define PCB_IS_R_BLOCK(pcb)     (((pcb) & 0xE6) == 0xA2)
+#define PCB_IS_R_ACK(pcb)       (PCB_IS_R_BLOCK(pcb) && !((pcb) & 0x10))
+#define PCB_IS_S_WTX(pcb)       (((pcb) & 0xF6) == 0xF2)
+
+// FWT = 256 * 16 / fc * 2^FWI, about 302us << FWI, FWI 14 at most
+#define FWT_US(fwi)             (302UL << (fwi))
+#define FWT_MAX_US              FWT_US(14)
+// Delta FWT allowed on top of every FWT (49152 / fc)
+#define FWT_DELTA_US            3700
+
+// Protocol state of the activated tag, see iso14443_4_reader_activate
+static struct {
+    bool active;
+    bool tx_chaining;       // the last I-block we sent was chained, the APDU goes on in the next call
+    bool rx_chaining;       // the tag holds more response blocks, it waits for our R(ACK)
+    uint8_t block_num;
+    uint8_t frame_max;      // min(FSC, FSD), PCB and CRC included
+    uint32_t fwt_us;
+} m_t_cl;
+
+// FSCI to FSC
+static const uint16_t m_fsc_table[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+
+/**
+* @brief  : Forget the activated tag, call it when the field or the tag state changed
+*/
+void iso14443_4_reader_reset(void) {
+    memset(&m_t_cl, 0, sizeof(m_t_cl));
+}
+
+/**
+* @brief  : Whether a tag is activated and its block protocol state is known
+*/
+bool iso14443_4_reader_is_active(void) {
+    return m_t_cl.active;
+}
+
+/**
+* @brief  : Take over a tag that answered RATS, read the frame size and the waiting times from its ATS
+* @param  : tag: the selected tag, with its ATS
+* @retval : STATUS_HF_TAG_OK, or STATUS_HF_ERR_ATS when the tag does not speak ISO14443-4
+*/
+uint8_t iso14443_4_reader_activate(picc_14a_tag_t *tag) {
+    uint8_t fsci = 2;
+    uint8_t fwi = 4;
+    uint8_t sfgi = 0;
+
+    iso14443_4_reader_reset();
+    if (!(tag->sak & 0x20) || tag->ats_len == 0) {
+        return STATUS_HF_ERR_ATS;
+    }
+
+    // TL|T0|TA|TB|TC|historical bytes, T0 tells which interface bytes follow
+    if (tag->ats_len > 1) {
+        uint8_t t0 = tag->ats[1];
+        uint8_t pos = 2;
+        fsci = t0 & 0x0F;
+        if (t0 & 0x10) {
+            pos++;  // TA: bit rates, only 106kbps is used
+        }
+        if ((t0 & 0x20) && pos < tag->ats_len) {
+            uint8_t tb = tag->ats[pos];
+            // 15 is RFU for both, keep the defaults then
+            if ((tb >> 4) != 0x0F) {
+                fwi = tb >> 4;
+            }
+            if ((tb & 0x0F) != 0x0F) {
+                sfgi = tb & 0x0F;
+            }
+        }
+    }
+
+    uint16_t fsc = fsci < ARRAYLEN(m_fsc_table) ? m_fsc_table[fsci] : 256;
+    m_t_cl.frame_max = fsc < ISO14443_4_FSD ? fsc : ISO14443_4_FSD;
+    m_t_cl.fwt_us = FWT_US(fwi);
+    m_t_cl.active = true;
+    NRF_LOG_INFO("T=CL active, frame %d, FWT %d us", m_t_cl.frame_max, m_t_cl.fwt_us);
+
+    // SFGT: the tag needs this guard time after the ATS before it takes the first block
+    if (sfgi) {
+        bsp_delay_us(FWT_US(sfgi));
+    }
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief  : Send one block and receive one block, CRC appended and checked
+* @param  : tx: block to send, 2 more bytes are needed for the CRC
+*           rx: receives the block, CRC removed
+*           timeout_us: waiting time of the answer
+* @retval : Status value hf_tag_ok, success
+*/
+static uint8_t iso14443_4_transceive(uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t *rx_len, uint32_t timeout_us) {
+    uint8_t frame[ISO14443_4_FSD];
+    uint8_t crc[2];
+    uint16_t len = 0;
+    uint32_t timeout_before = pcd_14a_reader_timeout_us_get();
+
+    memcpy(frame, tx, tx_len);
+    crc_14a_append(frame, tx_len);
+    pcd_14a_reader_timeout_us_set(timeout_us + FWT_DELTA_US);
+    uint8_t status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, frame, tx_len + 2, rx, &len, U8ARR_BIT_LEN(frame));
+    pcd_14a_reader_timeout_us_set(timeout_before);
+    if (status != STATUS_HF_TAG_OK) {
+        return status;
+    }
+
+    // A block is at least PCB and CRC, in whole bytes
+    if (len % 8 || len < 3 * 8) {
+        return STATUS_HF_ERR_STAT;
+    }
+    len /= 8;
+    crc_14a_calculate(rx, len - 2, crc);
+    if (rx[len - 2] != crc[0] || rx[len - 1] != crc[1]) {
+        return STATUS_HF_ERR_CRC;
+    }
+    *rx_len = len - 2;
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief  : Send a block and get the answer of the tag, answering the waiting time extensions
+*           and recovering the lost blocks (ISO14443-4 7.5.4): an I-block that got no valid answer
+*           is followed by R(NAK), an R(ACK) is sent again.
+* @param  : tx: I-block or R(ACK) to send
+*           rx: receives the answer, an I-block or an R(ACK) with our block number
+* @retval : Status value hf_tag_ok, success
+*/
+static uint8_t iso14443_4_block_exchange(uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t *rx_len) {
+    uint8_t retry = 0;
+    uint8_t status;
+    uint8_t reply[2];
+    uint8_t *out = tx;
+    uint8_t out_len = tx_len;
+    uint32_t timeout_us = m_t_cl.fwt_us;
+
+    for (;;) {
+        status = iso14443_4_transceive(out, out_len, rx, rx_len, timeout_us);
+        timeout_us = m_t_cl.fwt_us;
+        if (status == STATUS_HF_TAG_OK) {
+            if (PCB_IS_S_WTX(rx[0]) && *rx_len >= 2) {
+                // The tag needs more time, the temporary FWT is FWT * WTXM, at most FWT max
+                uint8_t wtxm = rx[1] & 0x3F;
+                if (wtxm == 0 || wtxm > 59) {
+                    return STATUS_HF_ERR_STAT;
+                }
+                reply[0] = PCB_S_WTX;
+                reply[1] = wtxm;
+                out = reply;
+                out_len = 2;
+                timeout_us = m_t_cl.fwt_us * wtxm;
+                if (timeout_us > FWT_MAX_US) {
+                    timeout_us = FWT_MAX_US;
+                }
+                continue;
+            }
+            if (PCB_IS_I_BLOCK(rx[0]) || (PCB_IS_R_ACK(rx[0]) && (rx[0] & PCB_BLOCK_NUM) == m_t_cl.block_num)) {
+                return STATUS_HF_TAG_OK;
+            }
+            if (!PCB_IS_R_ACK(rx[0])) {
+                NRF_LOG_INFO("Unexpected block 0x%02x", rx[0]);
+                return STATUS_HF_ERR_STAT;
+            }
+            // R(ACK) with the other block number: the tag did not get our last block
+            status = STATUS_HF_ERR_STAT;
+            out = tx;
+            out_len = tx_len;
+        } else if (PCB_IS_R_BLOCK(tx[0])) {
+            out = tx;
+            out_len = tx_len;
+        } else {
+            reply[0] = PCB_R_NAK | m_t_cl.block_num;
+            out = reply;
+            out_len = 1;
+        }
+        if (retry++ >= ISO14443_4_RETRY_MAX) {
+            return status;
+        }
+    }
+}
+
+/**
+* @brief  : Exchange an APDU with the activated tag, with the chaining of both sides.
+*           An APDU or a response larger than one call is split: ISO14443_4_FLAG_MORE in flags
+*           keeps the chain open after the data given, ISO14443_4_FLAG_MORE in resp_flags means
+*           the tag holds more response, call again without data to get it.
+* @param  : flags: ISO14443_4_FLAG_MORE when more APDU data follows
+*           apdu: the APDU, or the part of it
+*           resp: receives the response, or the part of it
+*           resp_max: size of resp, at least one frame
+*           resp_len: receives the length of the response
+*           resp_flags: receives ISO14443_4_FLAG_MORE when the response goes on
+* @retval : Status value hf_tag_ok, success
+*/
+uint8_t iso14443_4_reader_exchange(uint8_t flags, uint8_t *apdu, uint16_t apdu_len,
+                                   uint8_t *resp, uint16_t resp_max, uint16_t *resp_len, uint8_t *resp_flags) {
+    uint8_t tx[ISO14443_4_FSD];
+    uint8_t rx[ISO14443_4_FSD];
+    uint8_t rx_len = 0;
+    uint8_t status;
+    uint8_t inf_max = m_t_cl.frame_max - 3;
+
+    *resp_len = 0;
+    *resp_flags = 0;
+    if (!m_t_cl.active || resp_max < inf_max) {
+        return STATUS_PAR_ERR;
+    }
+
+    if (m_t_cl.rx_chaining) {
+        // Fetch the next part of the response, nothing can be sent before it is complete
+        if (apdu_len || (flags & ISO14443_4_FLAG_MORE)) {
+            return STATUS_PAR_ERR;
+        }
+        m_t_cl.rx_chaining = false;
+        tx[0] = PCB_R_ACK | m_t_cl.block_num;
+        status = iso14443_4_block_exchange(tx, 1, rx, &rx_len);
+    } else {
+        uint16_t sent = 0;
+        bool last_block;
+        // Without data there is nothing to send, unless it closes an APDU chained by the last call
+        if (apdu_len == 0 && !m_t_cl.tx_chaining) {
+            return STATUS_PAR_ERR;
+        }
+        m_t_cl.tx_chaining = false;
+        do {
+            uint8_t chunk = (apdu_len - sent) < inf_max ? (apdu_len - sent) : inf_max;
+            last_block = sent + chunk == apdu_len;
+            bool chaining = !last_block || (flags & ISO14443_4_FLAG_MORE);
+            tx[0] = PCB_I_BLOCK | m_t_cl.block_num | (chaining ? PCB_CHAINING : 0);
+            memcpy(&tx[1], &apdu[sent], chunk);
+            status = iso14443_4_block_exchange(tx, 1 + chunk, rx, &rx_len);
+            if (status != STATUS_HF_TAG_OK) {
+                break;
+            }
+            if (chaining) {
+                // The tag acknowledges every chained block
+                if (!PCB_IS_R_ACK(rx[0])) {
+                    status = STATUS_HF_ERR_STAT;
+                    break;
+                }
+                m_t_cl.block_num ^= PCB_BLOCK_NUM;
+            }
+            sent += chunk;
+        } while (!last_block);
+        if (status == STATUS_HF_TAG_OK && (flags & ISO14443_4_FLAG_MORE)) {
+            m_t_cl.tx_chaining = true;
+            return STATUS_HF_TAG_OK;
+        }
+    }
+
+    // Response, maybe chained by the tag
+    while (status == STATUS_HF_TAG_OK) {
+        if (!PCB_IS_I_BLOCK(rx[0]) || (rx[0] & PCB_BLOCK_NUM) != m_t_cl.block_num) {
+            status = STATUS_HF_ERR_STAT;
+            break;
+        }
+        m_t_cl.block_num ^= PCB_BLOCK_NUM;
+        memcpy(&resp[*resp_len], &rx[1], rx_len - 1);
+        *resp_len += rx_len - 1;
+        if (!(rx[0] & PCB_CHAINING)) {
+            return STATUS_HF_TAG_OK;
+        }
+        if (resp_max - *resp_len < inf_max) {
+            // No room for another block, the tag waits for the R(ACK) of the next call
+            m_t_cl.rx_chaining = true;
+            *resp_flags = ISO14443_4_FLAG_MORE;
+            return STATUS_HF_TAG_OK;
+        }
+        tx[0] = PCB_R_ACK | m_t_cl.block_num;
+        status = iso14443_4_block_exchange(tx, 1, rx, &rx_len);
+    }
+
+    // The block state is lost, the tag has to be activated again
+    NRF_LOG_INFO("T=CL exchange failed: %d", status);
+    iso14443_4_reader_reset();
+    return status;
+}
+
+/**
+* @brief  : Send S(DESELECT), the tag goes to the HALT state
+* @retval : Status value hf_tag_ok, success
+*/
+uint8_t iso14443_4_reader_deselect(void) {
+    uint8_t tx[1] = { PCB_S_DESELECT };
+    uint8_t rx[ISO14443_4_FSD];
+    uint8_t rx_len;
+    uint8_t status = STATUS_HF_TAG_OK;
+
+    if (m_t_cl.active) {
+        status = iso14443_4_transceive(tx, sizeof(tx), rx, &rx_len, m_t_cl.fwt_us);
+        if (status == STATUS_HF_TAG_OK && rx[0] != PCB_S_DESELECT) {
+            status = STATUS_HF_ERR_STAT;
+        }
+    }
+    iso14443_4_reader_reset();
+    return status;
+}
@@ -0,0 +1,32 @@
+#ifndef ISO14443_4_H
+#define ISO14443_4_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rc522.h"
+
+// Largest frame the reader accepts (FSD), the RC522 FIFO; RATS announces it with FSDI = 5
+#define ISO14443_4_FSD              DEF_FIFO_LENGTH
+// Retransmissions of one block before the exchange fails
+#define ISO14443_4_RETRY_MAX        2
+
+// iso14443_4_reader_exchange flags, command side: more APDU data follows in the next call
+// response side: the tag has more response data, call again without data to fetch it
+#define ISO14443_4_FLAG_MORE        0x01
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void iso14443_4_reader_reset(void);
+bool iso14443_4_reader_is_active(void);
+uint8_t iso14443_4_reader_activate(picc_14a_tag_t *tag);
+uint8_t iso14443_4_reader_exchange(uint8_t flags, uint8_t *apdu, uint16_t apdu_len,
+                                   uint8_t *resp, uint16_t resp_max, uint16_t *resp_len, uint8_t *resp_flags);
+uint8_t iso14443_4_reader_deselect(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
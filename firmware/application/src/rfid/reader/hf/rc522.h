@@ -61,6 +61,8 @@
     ifTheTimeoutValueIsTooSmall,YouMayNotBeAbleToReadTheUid (gen1A)Card!
 */
 #define DEF_COM_TIMEOUT         25
+// A tag never answers HLTA, pcd_14a_reader_fast_halt_tag only waits about the frame delay, in us
+#define FAST_HALT_TIMEOUT_US    1000
 
 // dataIoLengthDefinition
 #define MAX_MIFARE_FRAME_SIZE   18                              // biggest Mifare frame is answer to a read (one block = 16 Bytes) + 2 Bytes CRC
@@ -182,6 +184,8 @@ void set_register_mask(uint8_t reg, uint8_t mask);
 // Device communication control
 uint16_t pcd_14a_reader_timeout_get(void);
 void pcd_14a_reader_timeout_set(uint16_t timeout_ms);
+uint32_t pcd_14a_reader_timeout_us_get(void);
+void pcd_14a_reader_timeout_us_set(uint32_t timeout_us);
 
 // Device communication interface
 uint8_t pcd_14a_reader_bytes_transfer(uint8_t Command,
@@ -204,6 +208,7 @@ void pcd_14a_reader_parity_off(void);
 
 // 14443-A tag operation
 uint8_t pcd_14a_reader_scan_auto(picc_14a_tag_t *tag);
+uint8_t pcd_14a_reader_scan_all(picc_14a_tag_t *tags, uint8_t tags_max, uint8_t *tags_count);
 uint8_t pcd_14a_reader_fast_select(picc_14a_tag_t *tag);
 uint8_t pcd_14a_reader_ats_request(uint8_t *pAts, uint16_t *szAts, uint16_t szAtsBitMax);
 uint8_t pcd_14a_reader_atqa_request(uint8_t *resp, uint8_t *resp_par, uint16_t resp_max_bit);
@@ -375,9 +375,9 @@ uint8_t em410x_read(uint8_t *uid, uint32_t timeout_ms) {
     start_lf_125khz_radio();    // Start 125kHz modulation
 
     // Reading the card during timeout
-    autotimer *p_at = bsp_obtain_timer(0);
-    // NO_TIMEOUT_1MS(p_at, timeout_ms)
-    while (NO_TIMEOUT_1MS(p_at, timeout_ms)) {
+    bsp_us_timer_acquire();
+    uint32_t start_us = bsp_us_now();
+    while (NO_TIMEOUT_US(start_us, timeout_ms * 1000)) {
         //Execute the card, exit if you read it
         if (em410x_acquire()) {
             stop_lf_125khz_radio();
@@ -397,8 +397,7 @@ uint8_t em410x_read(uint8_t *uid, uint32_t timeout_ms) {
 
     dataindex = 0;  // After the end, keep in mind the index of resetting data
 
-    bsp_return_timer(p_at);
-    p_at = NULL;
+    bsp_us_timer_release();
 
     return ret;
 }
@@ -16,6 +16,7 @@
 #if defined(PROJECT_CHAMELEON_ULTRA)
 #include "rc522.h"
 #include "mf1_toolbox.h"
+#include "iso14443_4.h"
 #include "lf_em410x_data.h"
 #include "lf_125khz_radio.h"
 #include "lf_reader_main.h"
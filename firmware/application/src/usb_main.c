@@ -40,6 +40,8 @@ APP_USBD_CDC_ACM_GLOBAL_DEF(m_app_cdc_acm,
 volatile bool g_usb_connected = false;
 volatile bool g_usb_port_opened = false;
 volatile bool g_usb_led_marquee_enable = true;
+// A write is in flight, the next one must wait for its TX_DONE
+static volatile bool m_usb_tx_busy = false;
 
 /** @brief User event handler @ref app_usbd_cdc_acm_user_ev_handler_t */
 static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const *p_inst, app_usbd_cdc_acm_user_event_t event) {
@@ -62,9 +64,11 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const *p_inst, app_usb
             NRF_LOG_INFO("CDC ACM port closed");
             g_usb_port_opened = false;
             g_usb_led_marquee_enable = true;
+            m_usb_tx_busy = false;
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
+            m_usb_tx_busy = false;
             break;
 
         case APP_USBD_CDC_ACM_USER_EVT_RX_DONE: {
@@ -154,6 +158,7 @@ void usb_cdc_init(void) {
 void usb_cdc_write(const void *p_buf, uint16_t length) {
     ret_code_t err_code = app_usbd_cdc_acm_write(&m_app_cdc_acm, p_buf, length);
     APP_ERROR_CHECK(err_code);
+    m_usb_tx_busy = true;
 }
 
 // override fputc to printf to cdc serial
@@ -183,3 +188,17 @@ int fputc(int ch, FILE *f){
 bool is_usb_working(void) {
     return g_usb_port_opened;
 }
+
+bool is_usb_tx_busy(void) {
+    return m_usb_tx_busy;
+}
+
+/**
+ * Wait for the write in flight, the CDC class takes one at a time and sends from the frame buffer.
+ * The TX_DONE event comes from the usb event queue, so it is processed here.
+ */
+void usb_cdc_wait_tx_done(void) {
+    while (m_usb_tx_busy && g_usb_port_opened) {
+        while (app_usbd_event_queue_process());
+    }
+}
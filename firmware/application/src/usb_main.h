@@ -7,5 +7,7 @@
 void usb_cdc_init(void);
 void usb_cdc_write(const void *p_buf, uint16_t length);
 bool is_usb_working(void);
+bool is_usb_tx_busy(void);
+void usb_cdc_wait_tx_done(void);
 
 #endif
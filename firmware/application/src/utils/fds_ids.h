@@ -32,6 +32,12 @@
  */
 #define FDS_SLOT_TAG_NICK_NAME_FILE_ID_BASE 0x1200
 
+/*
+ * MF1 detection log pages spilled from RAM, one record per page
+ * FDS record key is the page number plus one, starting from 0x1 without gaps
+ */
+#define FDS_MF1_AUTH_LOG_FILE_ID            0x1300
+
 // Note that previously assigned records may need to be cleaned from Flash.
 // Taking into account the possible overlaps, it boils down to
 // ID 0x1066 Keys 0x1066
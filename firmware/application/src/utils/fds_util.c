@@ -58,6 +58,7 @@ bool fds_read_sync(uint16_t id, uint16_t key, uint16_t *length, uint8_t *buffer)
     fds_flash_record_t  flash_record;   // Pointing to the actual information in Flash
     fds_record_desc_t   record_desc;    // Recorded handle
     if (fds_find_record(id, key, &record_desc)) {
+        bool ret = false;
         err_code = fds_record_open(&record_desc, &flash_record);            //Open the record so that it is marked as the open state
         APP_ERROR_CHECK(err_code);
         if (flash_record.p_header->length_words * 4 <= *length) {        // Read the data in Flash here to the given RAM
@@ -65,12 +66,16 @@ bool fds_read_sync(uint16_t id, uint16_t key, uint16_t *length, uint8_t *buffer)
             memcpy(buffer, flash_record.p_data, flash_record.p_header->length_words * 4);
             NRF_LOG_INFO("FDS read success.");
             *length = flash_record.p_header->length_words * 4;
-            return true;
+            ret = true;
         } else {
             NRF_LOG_INFO("FDS buffer too small, can't run memcpy, fds size = %d, buffer size = %d", flash_record.p_header->length_words * 4, *length);
         }
-        err_code = fds_record_close(&record_desc);                          // Close the file after the operation is completed
+        // Close the file after the operation is completed, an open record is never moved by the GC
+        err_code = fds_record_close(&record_desc);
         APP_ERROR_CHECK(err_code);
+        if (ret) {
+            return true;
+        }
     }
     //If the correct data is not loaded, this record may not exist
     *length = 0;
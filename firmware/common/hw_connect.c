@@ -47,6 +47,7 @@ uint32_t g_hf_spi_mosi;
 uint32_t g_hf_spi_sck;
 uint32_t g_hf_ant_sel;
 uint32_t g_reader_power;
+uint32_t g_hf_irq;
 #endif
 
 
@@ -142,6 +143,8 @@ void hw_connect_init(void) {
         HF_ANT_SEL      = (NRF_GPIO_PIN_MAP(1, 10));
 
         READER_POWER    = (NRF_GPIO_PIN_MAP(1, 15));
+        // No RC522 IRQ line mapped on this revision, the reader polls ComIrqReg
+        HF_IRQ          = HF_IRQ_NOT_CONNECTED;
     }
 #endif
 
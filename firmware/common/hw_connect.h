@@ -83,6 +83,7 @@ extern uint32_t g_hf_spi_mosi;
 extern uint32_t g_hf_spi_sck;
 extern uint32_t g_hf_ant_sel;
 extern uint32_t g_reader_power;
+extern uint32_t g_hf_irq;
 
 #define LF_ANT_DRIVER  g_lf_ant_driver
 #define LF_OA_OUT      g_lf_oa_out
@@ -92,6 +93,9 @@ extern uint32_t g_reader_power;
 #define HF_SPI_SCK     g_hf_spi_sck
 #define HF_ANT_SEL     g_hf_ant_sel
 #define READER_POWER   g_reader_power
+#define HF_IRQ         g_hf_irq
+// HF_IRQ value when the board does not route the RC522 IRQ line
+#define HF_IRQ_NOT_CONNECTED  (0xFFFFFFFF)
 #endif
 
 
@@ -15,11 +15,13 @@ from platform import uname
 
 import chameleon_com
 import chameleon_cmd
+import chameleon_crypto
 from chameleon_utils import ArgumentParserNoExit, ArgsParserError, UnexpectedResponseError
 from chameleon_utils import CLITree
 from chameleon_utils import CR, CG, CB, CC, CY, CM, C0
 from chameleon_enum import Command, Status, SlotNumber, TagSenseType, TagSpecificType
 from chameleon_enum import MifareClassicWriteMode, MifareClassicPrngType, MifareClassicDarksideStatus, MfcKeyType
+from chameleon_enum import MifareClassicBenchStep
 from chameleon_enum import AnimationMode, ButtonType, ButtonPressFunction
 
 # NXP IDs based on https://www.nxp.com/docs/en/application-note/AN10833.pdf
@@ -43,8 +45,13 @@ else:
     # from source
     default_cwd = Path.cwd() / Path(__file__).parent.parent / "bin"
 
+# in-process key recovery, None when the library was not built: the tools are spawned instead
+crypto_lib = chameleon_crypto.load(default_cwd)
+
 
 def check_tools():
+    if crypto_lib is not None:
+        return
     tools = ['staticnested', 'nested', 'darkside', 'mfkey32v2']
     if sys.platform == "win32":
         tools = [x+'.exe' for x in tools]
@@ -625,6 +632,64 @@ class HF14AScan(ReaderRequiredUnit):
         self.scan()
 
 
+@hf_14a.command('session')
+class HF14ASession(ReaderRequiredUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Keep the field on and the tag selected between HF commands'
+        action_group = parser.add_mutually_exclusive_group(required=True)
+        action_group.add_argument('-o', '--open', action='store_true', help="Open the session")
+        action_group.add_argument('-c', '--close', action='store_true', help="Close the session")
+        parser.add_argument('-t', '--timeout', type=int, metavar="<dec>", default=0,
+                            help="Idle timeout in ms, the session closes by itself after it (default 3000)")
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        if args.open:
+            if not 0 <= args.timeout <= 0xFFFF:
+                print(f" [!] {CR}Timeout must be between 0 and 65535 ms{C0}")
+                return
+            self.cmd.hf14a_session_open(args.timeout)
+            print(" - Reader session open")
+        else:
+            self.cmd.hf14a_session_close()
+            print(" - Reader session closed")
+
+
+@hf_14a.command('select')
+class HF14ASelect(ReaderRequiredUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Select a tag by its UID when several tags are in the field'
+        parser.add_argument('-u', '--uid', type=str, required=True, metavar="<hex>",
+                            help="UID of 4, 7 or 10 bytes, as listed by hf 14a scan")
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        if not re.match(r"^([a-fA-F0-9]{8}|[a-fA-F0-9]{14}|[a-fA-F0-9]{20})$", args.uid):
+            raise ArgsParserError("UID must be 4, 7 or 10 bytes of hex")
+        sak = self.cmd.hf14a_select(bytes.fromhex(args.uid))
+        print(f"- Selected {args.uid.upper()}, SAK: {sak:02X}")
+        print("  The selection only lasts beyond this command in a reader session (hf 14a session -o)")
+
+
+@hf_14a.command('apdu')
+class HF14AApdu(ReaderRequiredUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Send an APDU to an ISO14443-4 tag, the device handles the block protocol'
+        parser.add_argument('-d', '--data', type=str, required=True, metavar="<hex>", help="APDU")
+        parser.epilog = "APDUs or responses larger than one frame need a reader session (hf 14a session -o)"
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        data = args.data.replace(' ', '')
+        if not re.match(r"^([a-fA-F0-9]{2})+$", data):
+            raise ArgsParserError("APDU must be a HEX string of whole bytes")
+        resp = self.cmd.hf14a_apdu(bytes.fromhex(data))
+        print(f" - {resp.hex(' ').upper()}")
+
+
 @hf_14a.command('info')
 class HF14AInfo(ReaderRequiredUnit):
     def args_parser(self) -> ArgumentParserNoExit:
@@ -638,6 +703,36 @@ class HF14AInfo(ReaderRequiredUnit):
         scan.scan(deep=1)
 
 
+@hf_14a.command('estats')
+class HF14AEStats(DeviceRequiredUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Show the 14A emulator counters and the time from reader frame end to response, ' \
+                             'per command'
+        parser.add_argument('--reset', action='store_true', help="Clear the counters after showing them")
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        stats = self.cmd.hf14a_get_emu_stats(args.reset)
+        print(f'- {"Frames received:":40}{stats["rx_frames"]}')
+        print(f'- {"Frames with RX errors:":40}{stats["rx_errors"]}')
+        print(f'- {"Frames with CRC errors:":40}{stats["crc_errors"]}')
+        print(f'- {"Responses sent:":40}{stats["responses"]}')
+        print(f'- {"Frame delay time misses:":40}{CR if stats["fdt_misses"] else CG}{stats["fdt_misses"]}{C0}')
+        if stats['overflow']:
+            print(f'- {"Responses to commands not listed:":40}{stats["overflow"]}')
+        if len(stats['commands']) == 0:
+            return
+        buckets = [f'<={us}us' for us in stats['bucket_us']] + [f'>{stats["bucket_us"][-1]}us']
+        print(f'  {"Cmd":>4}{"Len":>5}{"Count":>9}{"Misses":>8}{"Max us":>8}' + ''.join(f'{b:>9}' for b in buckets))
+        for entry in stats['commands']:
+            misses = f'{CR if entry["fdt_misses"] else ""}{entry["fdt_misses"]:>8}{C0}'
+            print(f'  {entry["cmd"]:>4X}{entry["length"]:>5}{entry["count"]:>9}{misses}{entry["max_us"]:>8}' +
+                  ''.join(f'{n:>9}' for n in entry['hist']))
+        if args.reset:
+            print(f' - {CY}Counters cleared{C0}')
+
+
 @hf_mf.command('nested')
 class HFMFNested(ReaderRequiredUnit):
     def args_parser(self) -> ArgumentParserNoExit:
@@ -655,6 +750,8 @@ class HFMFNested(ReaderRequiredUnit):
         dsttype_group = parser.add_mutually_exclusive_group()
         dsttype_group.add_argument('--ta', '--tA', action='store_true', help="Target A key (default)")
         dsttype_group.add_argument('--tb', '--tB', action='store_true', help="Target B key")
+        parser.add_argument('-n', '--sets', type=int, default=4, metavar="<dec>",
+                            help="Nonce sets collected in one go, more sets narrow the candidates down (default 4)")
         return parser
 
     def from_nt_level_code_to_str(self, nt_level):
@@ -665,7 +762,7 @@ class HFMFNested(ReaderRequiredUnit):
         if nt_level == 2:
             return 'HardNested'
 
-    def recover_a_key(self, block_known, type_known, key_known, block_target, type_target) -> str or None:
+    def recover_a_key(self, block_known, type_known, key_known, block_target, type_target, sets=4) -> str or None:
         """
             recover a key from key known
         :param block_known:
@@ -673,6 +770,7 @@ class HFMFNested(ReaderRequiredUnit):
         :param key_known:
         :param block_target:
         :param type_target:
+        :param sets: nested sets to collect
         :return:
         """
         # check nt level, we can run static or nested auto...
@@ -686,19 +784,67 @@ class HFMFNested(ReaderRequiredUnit):
         if nt_level == 0:  # It's a staticnested tag?
             nt_uid_obj = self.cmd.mf1_static_nested_acquire(
                 block_known, type_known, key_known, block_target, type_target)
-            cmd_param = f"{nt_uid_obj['uid']} {str(type_target)}"
+            cmd_param = f"{nt_uid_obj['uid']} {int(type_target)}"
             for nt_item in nt_uid_obj['nts']:
                 cmd_param += f" {nt_item['nt']} {nt_item['nt_enc']}"
             decryptor_name = "staticnested"
+            if crypto_lib is not None:
+                def decryptor():
+                    return crypto_lib.static_nested(nt_uid_obj['uid'], type_target, nt_uid_obj['nts'])
         else:
-            dist_obj = self.cmd.mf1_detect_nt_dist(block_known, type_known, key_known)
-            nt_obj = self.cmd.mf1_nested_acquire(block_known, type_known, key_known, block_target, type_target)
+            sector_target = block_target // 4 if block_target < 128 else 32 + (block_target - 128) // 16
+            dist_obj = self.cmd.mf1_nested_acquire_sectors(block_known, type_known, key_known, type_target,
+                                                           sector_target, 1, sets)
+            nt_obj = dist_obj['sectors'][0]['nts']
             # create cmd
             cmd_param = f"{dist_obj['uid']} {dist_obj['dist']}"
             for nt_item in nt_obj:
                 cmd_param += f" {nt_item['nt']} {nt_item['nt_enc']} {nt_item['par']}"
             decryptor_name = "nested"
+            if crypto_lib is not None:
+                def decryptor():
+                    return crypto_lib.nested(dist_obj['uid'], dist_obj['dist'], nt_obj)
+
+        if crypto_lib is not None:
+            print(f"   Executing {decryptor_name} in-process")
+            key_list = [f"{key:012x}" for key in self.run_in_thread(decryptor)]
+        else:
+            key_list = self.run_decryptor(decryptor_name, cmd_param)
+            if key_list is None:
+                # No keys recover, and no errors.
+                return None
+
+        # Here you have to verify the password first, and then get the one that is successfully verified
+        # If there is no verified password, it means that the recovery failed, you can try again
+        print(f" - [{len(key_list)} candidate key(s) found ]")
+        for key in key_list:
+            key_bytes = bytearray.fromhex(key)
+            if self.cmd.mf1_auth_one_key_block(block_target, type_target, key_bytes):
+                return key
+        return None
 
+    @staticmethod
+    def run_in_thread(decryptor):
+        """
+            Run an in-process decryptor while showing the elapsed time
+        :return: decryptor result
+        """
+        result = []
+        time_start = timeit.default_timer()
+        worker = threading.Thread(target=lambda: result.extend(decryptor()))
+        worker.start()
+        while worker.is_alive():
+            print(f"   [ Time elapsed {timeit.default_timer() - time_start:#.1f}s ]\r", end="")
+            worker.join(0.1)
+        # clear \r
+        print()
+        return result
+
+    def run_decryptor(self, decryptor_name, cmd_param):
+        """
+            Run a decryptor tool and collect the keys it prints
+        :return: key hex strings, None if the tool failed
+        """
         # Cross-platform compatibility
         if sys.platform == "win32":
             cmd_recover = f"{decryptor_name}.exe {cmd_param}"
@@ -717,23 +863,15 @@ class HFMFNested(ReaderRequiredUnit):
         # clear \r
         print()
 
-        if process.get_ret_code() == 0:
-            output_str = process.get_output_sync()
-            key_list = []
-            for line in output_str.split('\n'):
-                sea_obj = re.search(r"([a-fA-F0-9]{12})", line)
-                if sea_obj is not None:
-                    key_list.append(sea_obj[1])
-            # Here you have to verify the password first, and then get the one that is successfully verified
-            # If there is no verified password, it means that the recovery failed, you can try again
-            print(f" - [{len(key_list)} candidate key(s) found ]")
-            for key in key_list:
-                key_bytes = bytearray.fromhex(key)
-                if self.cmd.mf1_auth_one_key_block(block_target, type_target, key_bytes):
-                    return key
-        else:
-            # No keys recover, and no errors.
+        if process.get_ret_code() != 0:
             return None
+        output_str = process.get_output_sync()
+        key_list = []
+        for line in output_str.split('\n'):
+            sea_obj = re.search(r"([a-fA-F0-9]{12})", line)
+            if sea_obj is not None:
+                key_list.append(sea_obj[1])
+        return key_list
 
     def on_exec(self, args: argparse.Namespace):
         block_known = args.blk
@@ -751,8 +889,11 @@ class HFMFNested(ReaderRequiredUnit):
         if block_known == block_target and type_known == type_target:
             print(f"{CR}Target key already known{C0}")
             return
+        if not 1 <= args.sets <= 55:
+            print(f"{CR}Sets must be between 1 and 55{C0}")
+            return
         print(f" - {C0}Nested recover one key running...{C0}")
-        key = self.recover_a_key(block_known, type_known, key_known, block_target, type_target)
+        key = self.recover_a_key(block_known, type_known, key_known, block_target, type_target, args.sets)
         if key is None:
             print(f"{CY}No key found, you can retry.{C0}")
         else:
@@ -769,29 +910,46 @@ class HFMFDarkside(ReaderRequiredUnit):
     def args_parser(self) -> ArgumentParserNoExit:
         parser = ArgumentParserNoExit()
         parser.description = 'Mifare Classic darkside recover key'
+        parser.add_argument('--adaptive', action='store_true', default=False,
+                            help="Learn the shortest field-off time the tag restarts its PRNG with")
         return parser
 
-    def recover_key(self, block_target, type_target):
+    def recover_key(self, block_target, type_target, adaptive=False):
         """
             Execute darkside acquisition and decryption
         :param block_target:
         :param type_target:
+        :param adaptive: learn and use the shortest field-off time of the tag
         :return:
         """
         first_recover = True
         retry_count = 0
         while retry_count < 0xFF:
-            darkside_resp = self.cmd.mf1_darkside_acquire(block_target, type_target, first_recover, 30)
+            darkside_resp = self.cmd.mf1_darkside_acquire(block_target, type_target, first_recover, 30, adaptive)
             first_recover = False  # not first run.
             if darkside_resp[0] != MifareClassicDarksideStatus.OK:
                 print(f"Darkside error: {MifareClassicDarksideStatus(darkside_resp[0])}")
                 break
             darkside_obj = darkside_resp[1]
+            if adaptive:
+                rate = darkside_obj['attempts'] * 1000 / max(darkside_obj['elapsed_ms'], 1)
+                print(f" - Field off: {darkside_obj['field_off_us'] / 1000:.1f}ms, "
+                      f"{darkside_obj['attempts']} attempts, {rate:.1f} attempts/s")
 
             if darkside_obj['par'] != 0:  # NXP tag workaround.
                 self.darkside_list.clear()
 
             self.darkside_list.append(darkside_obj)
+            if crypto_lib is not None:
+                key_list = [f"{key:012x}" for key in crypto_lib.darkside(darkside_obj['uid'], self.darkside_list)]
+                if len(key_list) == 0:
+                    print(f" - No key found, retrying({retry_count})...")
+                    retry_count += 1
+                    continue  # retry
+                for key in key_list:
+                    if self.cmd.mf1_auth_one_key_block(block_target, type_target, bytearray.fromhex(key)):
+                        return key
+                continue
             recover_params = f"{darkside_obj['uid']}"
             for darkside_item in self.darkside_list:
                 recover_params += f" {darkside_item['nt1']} {darkside_item['ks1']} {darkside_item['par']}"
@@ -826,7 +984,7 @@ class HFMFDarkside(ReaderRequiredUnit):
         return None
 
     def on_exec(self, args: argparse.Namespace):
-        key = self.recover_key(0x03, MfcKeyType.A)
+        key = self.recover_key(0x03, MfcKeyType.A, args.adaptive)
         if key is not None:
             print(f" - Key Found: {key}")
         else:
@@ -868,6 +1026,146 @@ class HFMFWRBL(MF1AuthArgsUnit):
             print(f" - {CR}Write fail.{C0}")
 
 
+class MF1KeysArgsUnit(ReaderRequiredUnit):
+    default_keys = ['ffffffffffff', '000000000000', 'a0a1a2a3a4a5', 'b0b1b2b3b4b5', 'd3f7d3f7d3f7',
+                    'aabbccddeeff', '4d3a99c351dd', '1a982c7e459a', '714c5c886e97', '587ee5f9350f',
+                    'a0478cc39091', '533cb6c723f6', '8fd0a4f256e9']
+
+    @staticmethod
+    def add_keys_args(parser: ArgumentParserNoExit):
+        size_group = parser.add_mutually_exclusive_group()
+        size_group.add_argument('--mini', action='store_const', dest='sectors', const=5, help="MIFARE Mini")
+        size_group.add_argument('--1k', action='store_const', dest='sectors', const=16, help="MIFARE 1K (default)")
+        size_group.add_argument('--2k', action='store_const', dest='sectors', const=32, help="MIFARE 2K")
+        size_group.add_argument('--4k', action='store_const', dest='sectors', const=40, help="MIFARE 4K")
+        parser.add_argument('-k', '--key', type=str, action='append', metavar="<hex>",
+                            help="Key to check, can be repeated")
+        parser.add_argument('--dict', type=str, metavar="<path>",
+                            help="Dictionary file, one key per line")
+        return parser
+
+    def get_keys(self, args: argparse.Namespace):
+        keys = []
+        if args.key is not None:
+            keys.extend(args.key)
+        if args.dict is not None:
+            with open(args.dict) as fd:
+                keys.extend(line.split('#')[0].strip() for line in fd)
+        if len(keys) == 0:
+            keys = self.default_keys
+        keys = list(dict.fromkeys(key.lower() for key in keys if key != ''))
+        for key in keys:
+            if not re.match(r"^[a-f0-9]{12}$", key):
+                raise ArgsParserError(f"Key {key} must include 12 HEX symbols")
+        return [bytes.fromhex(key) for key in keys]
+
+    def check_keys(self, keys: list, sectors: int):
+        """
+            Check the keys against the first sectors on the device, several frames when needed
+        :return: {(sector, MfcKeyType): key}
+        """
+        # bit 2n is key A of sector n, bit 2n+1 its key B, sectors drop out of the mask once their key is found
+        mask_bits = chameleon_cmd.MF1_SECTOR_MASK_SIZE * 8
+        mask = ((1 << sectors * 2) - 1) << (mask_bits - sectors * 2)
+        found = {}
+        max_keys = chameleon_cmd.MF1_CHECK_KEYS_MAX
+        for i in range(0, len(keys), max_keys):
+            chunk = keys[i:i + max_keys]
+            print(f" - Checking keys {i + 1}-{i + len(chunk)} of {len(keys)}...")
+            result = self.cmd.mf1_check_keys_of_sectors(mask.to_bytes(chameleon_cmd.MF1_SECTOR_MASK_SIZE, 'big'), chunk)
+            for (sector, key_type), key in result.items():
+                found[(sector, key_type)] = key
+                mask &= ~(1 << (mask_bits - 1 - (sector * 2 + (key_type == MfcKeyType.B))))
+            if mask == 0:
+                break
+        return found
+
+
+@hf_mf.command('fchk')
+class HFMFFCHK(MF1KeysArgsUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Mifare Classic check keys of all sectors on the device'
+        self.add_keys_args(parser)
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        sectors = args.sectors if args.sectors is not None else 16
+        found = self.check_keys(self.get_keys(args), sectors)
+
+        print(f" - Found {len(found)} of {sectors * 2} keys")
+        print("   Sec | Key A        | Key B")
+        for sector in range(sectors):
+            key_a = found.get((sector, MfcKeyType.A))
+            key_b = found.get((sector, MfcKeyType.B))
+            print(f"   {sector:3} | "
+                  f"{f'{CG}{key_a.hex()}{C0}' if key_a is not None else f'{CR}------------{C0}'} | "
+                  f"{f'{CG}{key_b.hex()}{C0}' if key_b is not None else f'{CR}------------{C0}'}")
+
+
+@hf_mf.command('dump')
+class HFMFDump(MF1KeysArgsUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'Mifare Classic dump the whole card, keys are checked first'
+        self.add_keys_args(parser)
+        parser.add_argument('-f', '--file', type=str, required=False, default="",
+                            help="Specify a filename for dump file (.bin or .eml)")
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        sectors = args.sectors if args.sectors is not None else 16
+        found = self.check_keys(self.get_keys(args), sectors)
+
+        # key A first, key B when only B is known
+        table = []
+        for sector in range(sectors):
+            if (sector, MfcKeyType.A) in found:
+                table.append((MfcKeyType.A, found[(sector, MfcKeyType.A)]))
+            elif (sector, MfcKeyType.B) in found:
+                table.append((MfcKeyType.B, found[(sector, MfcKeyType.B)]))
+            else:
+                table.append((None, None))
+
+        result = []
+        while len(result) < sectors:
+            start = len(result)
+            read = self.cmd.mf1_read_sectors(start, table[start:])
+            if len(read) == 0:
+                print(f" - {CR}Device returned no sector{C0}")
+                return
+            result.extend(read)
+
+        dump = bytearray()
+        for item in result:
+            sector = item['sector']
+            blocks = item['blocks']
+            # the trailer never reads back its keys, put in the ones we know
+            trailer = blocks[-1]
+            if trailer is not None:
+                key_a = found.get((sector, MfcKeyType.A), trailer[:6])
+                key_b = found.get((sector, MfcKeyType.B), trailer[10:])
+                blocks[-1] = key_a + trailer[6:10] + key_b
+            first = sector * 4 if sector < 32 else 128 + (sector - 32) * 16
+            for i, block in enumerate(blocks):
+                if block is None:
+                    print(f" - Block {first + i:3}: {CR}{'-' * 32}{C0}")
+                    dump += bytes(16)
+                else:
+                    print(f" - Block {first + i:3}: {block.hex()}")
+                    dump += block
+
+        if args.file != "":
+            if args.file.endswith('.eml'):
+                with open(args.file, 'w+') as fd:
+                    for i in range(0, len(dump), 16):
+                        fd.write(dump[i:i + 16].hex() + '\n')
+            else:
+                with open(args.file, 'wb+') as fd:
+                    fd.write(dump)
+            print(f" - {CG}Dump written in {args.file}.{C0}")
+
+
 @hf_mf.command('elog')
 class HFMFELog(DeviceRequiredUnit):
     detection_log_size = 18
@@ -930,6 +1228,17 @@ class HFMFELog(DeviceRequiredUnit):
             return
         print(f" - MF1 detection log count = {count}, start download", end="")
         result_list = []
+        if Command.MF1_STREAM_DETECTION_LOG in self.device_com.commands:
+            # the device pushes the frames back to back
+            try:
+                for cursor, tmp in self.cmd.mf1_stream_detection_log(index):
+                    index = cursor + len(tmp)
+                    result_list.extend(tmp)
+                    print("."*len(tmp), end="")
+            except TimeoutError:
+                # the next command stops the export on the device, the rest is fetched from the last cursor
+                pass
+        # whatever the export did not bring is fetched a frame at a time
         while index < count:
             tmp = self.cmd.mf1_get_detection_log(index)
             recv_count = len(tmp)
@@ -938,6 +1247,12 @@ class HFMFELog(DeviceRequiredUnit):
             print("."*recv_count, end="")
         print()
         print(f" - Download done ({len(result_list)} records), start parse and decrypt")
+        solved = None
+        if crypto_lib is not None:
+            # the whole log in one pass, groups are solved in parallel and stop once explained
+            solved = {}
+            for item in crypto_lib.mfkey32v2_log(result_list):
+                solved.setdefault((item['uid'], item['block'], item['type']), set()).add(item['key'])
         # classify
         result_maps = {}
         for item in result_list:
@@ -961,14 +1276,18 @@ class HFMFELog(DeviceRequiredUnit):
                 if 'A' in result_maps_for_uid[block]:
                     # print(f" - A record: { result_maps[block]['A'] }")
                     records = result_maps_for_uid[block]['A']
-                    if len(records) > 1:
+                    if len(records) > 1 and solved is not None:
+                        result_maps[uid][block]['A'] = solved.get((uid, block, 'A'), set())
+                    elif len(records) > 1:
                         result_maps[uid][block]['A'] = self.decrypt_by_list(records)
                     else:
                         print(f"  > {len(records)} record")
                 if 'B' in result_maps_for_uid[block]:
                     # print(f" - B record: { result_maps[block]['B'] }")
                     records = result_maps_for_uid[block]['B']
-                    if len(records) > 1:
+                    if len(records) > 1 and solved is not None:
+                        result_maps[uid][block]['B'] = solved.get((uid, block, 'B'), set())
+                    elif len(records) > 1:
                         result_maps[uid][block]['B'] = self.decrypt_by_list(records)
                     else:
                         print(f"  > {len(records)} record")
@@ -1108,6 +1427,11 @@ class HFMFEConfig(SlotIndexArgsAndGoUnit, HF14AAntiCollArgsUnit, DeviceRequiredU
         log_group = parser.add_mutually_exclusive_group()
         log_group.add_argument('--enable-log', action='store_true', help="Enable logging of MFC authentication data")
         log_group.add_argument('--disable-log', action='store_true', help="Disable logging of MFC authentication data")
+        crypto1_group = parser.add_mutually_exclusive_group()
+        crypto1_group.add_argument('--enable-fast-crypto1', action='store_true',
+                                   help="Use the table driven Crypto1 engine, for readers with tight timings")
+        crypto1_group.add_argument('--disable-fast-crypto1', action='store_true',
+                                   help="Use the bit-serial Crypto1 engine")
         return parser
 
     def on_exec(self, args: argparse.Namespace):
@@ -1137,6 +1461,7 @@ class HFMFEConfig(SlotIndexArgsAndGoUnit, HF14AAntiCollArgsUnit, DeviceRequiredU
         block_anti_coll_mode = mfc_config["block_anti_coll_mode"]
         write_mode = MifareClassicWriteMode(mfc_config["write_mode"])
         detection = mfc_config["detection"]
+        fast_crypto1 = mfc_config["fast_crypto1"]
         change_requested, change_done, uid, atqa, sak, ats = self.update_hf14a_anticoll(args, uid, atqa, sak, ats)
         if args.enable_gen1a:
             change_requested = True
@@ -1211,6 +1536,22 @@ class HFMFEConfig(SlotIndexArgsAndGoUnit, HF14AAntiCollArgsUnit, DeviceRequiredU
                 change_done = True
             else:
                 print(f'{CY}Requested logging of MFC authentication data already disabled{C0}')
+        if args.enable_fast_crypto1:
+            change_requested = True
+            if not fast_crypto1:
+                fast_crypto1 = True
+                self.cmd.mf1_set_fast_crypto1_mode(fast_crypto1)
+                change_done = True
+            else:
+                print(f'{CY}Requested fast Crypto1 already enabled{C0}')
+        elif args.disable_fast_crypto1:
+            change_requested = True
+            if fast_crypto1:
+                fast_crypto1 = False
+                self.cmd.mf1_set_fast_crypto1_mode(fast_crypto1)
+                change_done = True
+            else:
+                print(f'{CY}Requested fast Crypto1 already disabled{C0}')
 
         if change_done:
             print(' - MF1 Emulator settings updated')
@@ -1235,6 +1576,24 @@ class HFMFEConfig(SlotIndexArgsAndGoUnit, HF14AAntiCollArgsUnit, DeviceRequiredU
                 print(f'- {"Write mode:":40}{CR}invalid value!{C0}')
             print(
                 f'- {"Log (mfkey32) mode:":40}{f"{CG}enabled{C0}" if detection else f"{CR}disabled{C0}"}')
+            print(
+                f'- {"Fast Crypto1:":40}{f"{CG}enabled{C0}" if fast_crypto1 else f"{CR}disabled{C0}"}')
+
+
+@hf_mf.command('ebench')
+class HFMFEBench(DeviceRequiredUnit):
+    def args_parser(self) -> ArgumentParserNoExit:
+        parser = ArgumentParserNoExit()
+        parser.description = 'CPU cycles of the Crypto1 engines for each step of the Mifare Classic emulator. ' \
+                             'Keep readers away, the emulated session is dropped'
+        return parser
+
+    def on_exec(self, args: argparse.Namespace):
+        cycles = self.cmd.mf1_crypto1_bench()
+        print(f'  {"Step":28}{"bit-serial":>12}{"fast":>12}{"speedup":>10}')
+        for step, (bit_serial, fast) in zip(MifareClassicBenchStep, cycles):
+            speedup = f'{bit_serial / fast:.1f}x' if fast else '-'
+            print(f'  {str(step):28}{bit_serial:>12}{fast:>12}{CG}{speedup:>10}{C0}')
 
 
 @hf_mfu.command('rdpg')
@@ -2,13 +2,21 @@ import struct
 import ctypes
 
 import chameleon_com
-from chameleon_utils import expect_response
+from chameleon_utils import expect_response, UnexpectedResponseError
 from chameleon_enum import Command, Status, SlotNumber, TagSenseType, TagSpecificType
-from chameleon_enum import MifareClassicDarksideStatus
+from chameleon_enum import MifareClassicDarksideStatus, MfcKeyType
 from chameleon_enum import ButtonType, ButtonPressFunction
 
 CURRENT_VERSION_SETTINGS = 5
 
+# Sector mask of MF1_CHECK_KEYS_OF_SECTORS: 40 sectors, key A and key B
+MF1_SECTOR_MASK_SIZE = 10
+# Keys fitting in one frame next to the mask
+MF1_CHECK_KEYS_MAX = (512 - MF1_SECTOR_MASK_SIZE) // 6
+# HF14A_APDU: flags byte then APDU or response data, flag set while more data follows
+HF14A_APDU_FLAG_MORE = 0x01
+HF14A_APDU_PART_MAX = 512 - 1
+
 
 class ChameleonCMD:
     """
@@ -159,21 +167,53 @@ class ChameleonCMD:
         return resp
 
     @expect_response(Status.HF_TAG_OK)
-    def mf1_darkside_acquire(self, block_target, type_target, first_recover: int or bool, sync_max):
+    def mf1_nested_acquire_sectors(self, block_known, type_known, key_known, type_target,
+                                   sector_start, sector_count, set_count):
+        """
+        Measure the distance and collect set_count nested sets for each target sector in one call
+        :param sector_start: first target sector
+        :param sector_count: number of target sectors
+        :param set_count: sets per sector
+        :return: {'uid', 'dist', 'sectors'} with sectors a list of {'sector', 'nts'}.
+                 Fewer sectors than asked are returned when the frame is full, ask again for the remaining ones
+        """
+        data = struct.pack('!BB6sBBBB', type_known, block_known, key_known, type_target,
+                           sector_start, sector_count, set_count)
+        resp = self.device.send_cmd_sync(Command.MF1_NESTED_ACQUIRE_SECTORS, data, timeout=10)
+        if resp.status == Status.HF_TAG_OK:
+            uid, dist, sector_done = struct.unpack_from('!IIB', resp.data)
+            nts = [{'nt': nt, 'nt_enc': nt_enc, 'par': par}
+                   for nt, nt_enc, par in struct.iter_unpack('!IIB', resp.data[struct.calcsize('!IIB'):])]
+            resp.data = {'uid': uid, 'dist': dist,
+                         'sectors': [{'sector': sector_start + i, 'nts': nts[i * set_count:(i + 1) * set_count]}
+                                     for i in range(sector_done)]}
+        return resp
+
+    @expect_response(Status.HF_TAG_OK)
+    def mf1_darkside_acquire(self, block_target, type_target, first_recover: int or bool, sync_max, adaptive=False):
         """
         Collect the key parameters needed for Darkside decryption
         :param block_target:
         :param type_target:
         :param first_recover:
         :param sync_max:
+        :param adaptive: learn the shortest field-off time of the card, the result then also holds
+                         'field_off_us', 'attempts' and 'elapsed_ms' of the call
         :return:
         """
         data = struct.pack('!BBBB', type_target, block_target, first_recover, sync_max)
+        if adaptive:
+            data += struct.pack('!B', 0x01)
         resp = self.device.send_cmd_sync(Command.MF1_DARKSIDE_ACQUIRE, data, timeout=sync_max * 10)
         if resp.status == Status.HF_TAG_OK:
             if resp.data[0] == MifareClassicDarksideStatus.OK:
-                darkside_status, uid, nt1, par, ks1, nr, ar = struct.unpack('!BIIQQII', resp.data)
-                resp.data = (darkside_status, {'uid': uid, 'nt1': nt1, 'par': par, 'ks1': ks1, 'nr': nr, 'ar': ar})
+                darkside_status, uid, nt1, par, ks1, nr, ar = struct.unpack_from('!BIIQQII', resp.data)
+                result = {'uid': uid, 'nt1': nt1, 'par': par, 'ks1': ks1, 'nr': nr, 'ar': ar}
+                if adaptive:
+                    field_off_us, attempts, elapsed_ms = struct.unpack_from('!III', resp.data,
+                                                                            struct.calcsize('!BIIQQII'))
+                    result.update({'field_off_us': field_off_us, 'attempts': attempts, 'elapsed_ms': elapsed_ms})
+                resp.data = (darkside_status, result)
             else:
                 resp.data = (resp.data[0],)
         return resp
@@ -192,6 +232,64 @@ class ChameleonCMD:
         resp.data = resp.status == Status.HF_TAG_OK
         return resp
 
+    @expect_response(Status.HF_TAG_OK)
+    def mf1_check_keys_of_sectors(self, mask: bytes, keys: list):
+        """
+        Check a key list against the sectors selected by the mask, on the device
+        :param mask: 10 bytes, bit 2n (MSB first) selects key A of sector n, bit 2n+1 key B
+        :param keys: list of 6 bytes keys, at most MF1_CHECK_KEYS_MAX
+        :return: {(sector, MfcKeyType): key} for each key found
+        """
+        if len(keys) > MF1_CHECK_KEYS_MAX:
+            raise ValueError(f"At most {MF1_CHECK_KEYS_MAX} keys per call")
+        data = struct.pack(f'!{MF1_SECTOR_MASK_SIZE}s{6 * len(keys)}s', mask, b''.join(keys))
+        # a failed attempt costs the 25 ms auth timeout of the reader and a fast select
+        attempts = len(keys) * bin(int.from_bytes(mask, 'big')).count('1')
+        resp = self.device.send_cmd_sync(Command.MF1_CHECK_KEYS_OF_SECTORS, data, timeout=3 + attempts * 0.03)
+        if resp.status == Status.HF_TAG_OK:
+            found = int.from_bytes(resp.data[:MF1_SECTOR_MASK_SIZE], 'big')
+            offset = MF1_SECTOR_MASK_SIZE
+            result = {}
+            for i in range(MF1_SECTOR_MASK_SIZE * 8):
+                if found >> (MF1_SECTOR_MASK_SIZE * 8 - 1 - i) & 1:
+                    result[(i // 2, MfcKeyType.B if i & 1 else MfcKeyType.A)] = resp.data[offset:offset + 6]
+                    offset += 6
+            resp.data = result
+        return resp
+
+    @expect_response(Status.HF_TAG_OK)
+    def mf1_read_sectors(self, sector_start: int, keys: list):
+        """
+        Read whole sectors with one authentication each, as many as fit in one response frame
+        :param sector_start: first sector to read
+        :param keys: (key type, 6 bytes key) of each sector from sector_start, key type None skips the sector
+        :return: one {'sector', 'status', 'blocks'} per sector read, blocks holds None for unreadable blocks.
+                 Fewer sectors than keys are returned when the frame is full, ask again for the remaining ones
+        """
+        data = struct.pack('!B', sector_start)
+        for key_type, key in keys:
+            data += struct.pack('!B6s', key_type if key_type is not None else 0, key if key is not None else b'')
+        resp = self.device.send_cmd_sync(Command.MF1_READ_SECTORS, data, timeout=10)
+        if resp.status == Status.HF_TAG_OK:
+            sectors = []
+            offset = 1
+            for sector in range(sector_start, sector_start + resp.data[0]):
+                block_count = 4 if sector < 32 else 16
+                status = resp.data[offset]
+                offset += 1
+                blocks = []
+                if status == Status.HF_TAG_OK:
+                    read_mask, = struct.unpack_from('<H', resp.data, offset)
+                    offset += 2
+                    for i in range(block_count):
+                        blocks.append(resp.data[offset:offset + 16] if read_mask >> i & 1 else None)
+                        offset += 16
+                else:
+                    blocks = [None] * block_count
+                sectors.append({'sector': sector, 'status': status, 'blocks': blocks})
+            resp.data = sectors
+        return resp
+
     @expect_response(Status.HF_TAG_OK)
     def mf1_read_one_block(self, block, type_value, key):
         """
@@ -219,6 +317,69 @@ class ChameleonCMD:
         resp.data = resp.status == Status.HF_TAG_OK
         return resp
 
+    @expect_response(Status.SUCCESS)
+    def hf14a_session_open(self, idle_timeout_ms=0):
+        """
+        Open a reader session: the field stays on and the tag stays selected between HF commands,
+        the single block commands on the same sector and key skip the auth.
+        Opening again only changes the idle timeout
+        :param idle_timeout_ms: the session closes after this time without HF command, 0 for the default
+        :return:
+        """
+        data = struct.pack('!H', idle_timeout_ms)
+        return self.device.send_cmd_sync(Command.HF14A_SESSION_OPEN, data)
+
+    @expect_response(Status.SUCCESS)
+    def hf14a_session_close(self):
+        """
+        Close the reader session and turn the field off
+        :return:
+        """
+        return self.device.send_cmd_sync(Command.HF14A_SESSION_CLOSE)
+
+    @expect_response(Status.HF_TAG_OK)
+    def hf14a_select(self, uid: bytes):
+        """
+        Select one of the tags of the field by its UID, in a reader session
+        the following HF commands address this tag until the session closes
+        :param uid: UID of 4, 7 or 10 bytes
+        :return: SAK of the tag
+        """
+        resp = self.device.send_cmd_sync(Command.HF14A_SELECT, uid)
+        if resp.status == Status.HF_TAG_OK:
+            resp.data = resp.data[0]
+        return resp
+
+    @expect_response(Status.HF_TAG_OK)
+    def hf14a_apdu_part(self, flags: int, data: bytes = b''):
+        """
+        Send one part of an APDU to the ISO14443-4 tag, see hf14a_apdu
+        :param flags: HF14A_APDU_FLAG_MORE when more APDU data follows
+        :param data: part of the APDU, empty to fetch the rest of a response
+        :return: (flags, response part)
+        """
+        resp = self.device.send_cmd_sync(Command.HF14A_APDU, struct.pack('!B', flags) + bytes(data))
+        if resp.status == Status.HF_TAG_OK:
+            resp.data = (resp.data[0], resp.data[1:])
+        return resp
+
+    def hf14a_apdu(self, apdu: bytes):
+        """
+        Exchange an APDU with the ISO14443-4 tag, the device handles the block protocol
+        (chaining, waiting time extensions, retransmissions).
+        APDUs or responses larger than one frame need an open reader session
+        :param apdu: command APDU
+        :return: response APDU
+        """
+        parts = [apdu[i:i + HF14A_APDU_PART_MAX] for i in range(0, len(apdu), HF14A_APDU_PART_MAX)] or [b'']
+        for part in parts[:-1]:
+            self.hf14a_apdu_part(HF14A_APDU_FLAG_MORE, part)
+        flags, response = self.hf14a_apdu_part(0, parts[-1])
+        while flags & HF14A_APDU_FLAG_MORE:
+            flags, more = self.hf14a_apdu_part(0)
+            response += more
+        return response
+
     @expect_response(Status.HF_TAG_OK)
     def hf14a_raw(self, options, resp_timeout_ms=100, data=[], bitlen=None):
         """
@@ -427,6 +588,29 @@ class ChameleonCMD:
             resp.data, = struct.unpack('!I', resp.data)
         return resp
 
+    @staticmethod
+    def parse_detection_log(data: bytes):
+        """
+        Convert detection logs as the device packs them
+        :param data: logs of 18 bytes each
+        :return: list of dict
+        """
+        result_list = []
+        pos = 0
+        while pos < len(data):
+            block, bitfield, uid, nt, nr, ar = struct.unpack_from('!BB4s4s4s4s', data, pos)
+            result_list.append({
+                'block': block,
+                'type': ['A', 'B'][bitfield & 0x01],
+                'is_nested': bool(bitfield & 0x02),
+                'uid': uid.hex(),
+                'nt': nt.hex(),
+                'nr': nr.hex(),
+                'ar': ar.hex()
+            })
+            pos += struct.calcsize('!BB4s4s4s4s')
+        return result_list
+
     @expect_response(Status.SUCCESS)
     def mf1_get_detection_log(self, index: int):
         """
@@ -437,24 +621,27 @@ class ChameleonCMD:
         data = struct.pack('!I', index)
         resp = self.device.send_cmd_sync(Command.MF1_GET_DETECTION_LOG, data)
         if resp.status == Status.SUCCESS:
-            # convert
-            result_list = []
-            pos = 0
-            while pos < len(resp.data):
-                block, bitfield, uid, nt, nr, ar = struct.unpack_from('!BB4s4s4s4s', resp.data, pos)
-                result_list.append({
-                    'block': block,
-                    'type': ['A', 'B'][bitfield & 0x01],
-                    'is_nested': bool(bitfield & 0x02),
-                    'uid': uid.hex(),
-                    'nt': nt.hex(),
-                    'nr': nr.hex(),
-                    'ar': ar.hex()
-                })
-                pos += struct.calcsize('!BB4s4s4s4s')
-            resp.data = result_list
+            resp.data = self.parse_detection_log(resp.data)
         return resp
 
+    def mf1_stream_detection_log(self, index: int = 0):
+        """
+        Get detection logs from the specified index position to the end, the device sends them without waiting
+        for further requests
+        :param index: start index
+        :return: generator of (index, list of logs), one per frame
+        """
+        data = struct.pack('!I', index)
+        for resp in self.device.send_cmd_stream(Command.MF1_STREAM_DETECTION_LOG, data):
+            if resp.status != Status.SUCCESS:
+                raise UnexpectedResponseError(str(Status(resp.status)))
+            cursor, = struct.unpack_from('!I', resp.data)
+            logs = self.parse_detection_log(resp.data[4:])
+            if len(logs) == 0:
+                # the empty frame ends the export
+                return
+            yield cursor, logs
+
     @expect_response(Status.SUCCESS)
     def mf1_write_emu_block_data(self, block_start: int, block_data: bytes):
         """
@@ -534,16 +721,18 @@ class ChameleonCMD:
             [2] - mf1_is_gen2_magic_mode
             [3] - mf1_is_use_mf1_coll_res (use UID/BCC/SAK/ATQA from 0 block)
             [4] - mf1_get_write_mode
+            [5] - mf1_is_fast_crypto1 (not sent by older firmwares)
         :return:
         """
         resp = self.device.send_cmd_sync(Command.MF1_GET_EMULATOR_CONFIG)
         if resp.status == Status.SUCCESS:
-            b1, b2, b3, b4, b5 = struct.unpack('!????B', resp.data)
+            b1, b2, b3, b4, b5 = struct.unpack('!????B', resp.data[:5])
             resp.data = {'detection': b1,
                          'gen1a_mode': b2,
                          'gen2_mode': b3,
                          'block_anti_coll_mode': b4,
-                         'write_mode': b5}
+                         'write_mode': b5,
+                         'fast_crypto1': len(resp.data) > 5 and resp.data[5] == 1}
         return resp
 
     @expect_response(Status.SUCCESS)
@@ -578,6 +767,54 @@ class ChameleonCMD:
         data = struct.pack('!B', mode)
         return self.device.send_cmd_sync(Command.MF1_SET_WRITE_MODE, data)
 
+    @expect_response(Status.SUCCESS)
+    def mf1_set_fast_crypto1_mode(self, enabled: bool):
+        """
+        Set fast (table driven) Crypto1 engine instead of the bit-serial one
+        """
+        data = struct.pack('!B', enabled)
+        return self.device.send_cmd_sync(Command.MF1_SET_FAST_CRYPTO1_MODE, data)
+
+    @expect_response(Status.SUCCESS)
+    def mf1_crypto1_bench(self):
+        """
+        Measure the Crypto1 work of each emulator state machine step on both engines.
+        Do not run while a reader talks to the emulated card.
+        :return: list of (bit_serial, fast) CPU cycles, indexed by MifareClassicBenchStep
+        """
+        resp = self.device.send_cmd_sync(Command.MF1_CRYPTO1_BENCH)
+        if resp.status == Status.SUCCESS:
+            resp.data = list(struct.iter_unpack('!II', resp.data))
+        return resp
+
+    @expect_response(Status.SUCCESS)
+    def hf14a_get_emu_stats(self, reset=False):
+        """
+        Get the counters of the 14A emulator, kept since boot or the last reset.
+        :param reset: clear the counters after reading them
+        :return: dict of the counters, the histogram bucket bounds and one dict per command
+        """
+        data = struct.pack('!B', 1 if reset else 0)
+        resp = self.device.send_cmd_sync(Command.HF14A_GET_EMU_STATS, data)
+        if resp.status == Status.SUCCESS:
+            keys = ['rx_frames', 'rx_errors', 'crc_errors', 'responses', 'fdt_misses', 'overflow']
+            stats = dict(zip(keys, struct.unpack_from('!6I', resp.data)))
+            pos = 24
+            bucket_count = resp.data[pos]
+            stats['bucket_us'] = list(struct.unpack_from(f'!{bucket_count - 1}H', resp.data, pos + 1))
+            pos += 1 + (bucket_count - 1) * 2
+            entry_count = resp.data[pos]
+            pos += 1
+            entry_fmt = f'!BBIIH{bucket_count}H'
+            stats['commands'] = []
+            for _ in range(entry_count):
+                cmd, length, count, fdt_misses, max_us, *hist = struct.unpack_from(entry_fmt, resp.data, pos)
+                pos += struct.calcsize(entry_fmt)
+                stats['commands'].append({'cmd': cmd, 'length': length, 'count': count,
+                                          'fdt_misses': fdt_misses, 'max_us': max_us, 'hist': hist})
+            resp.data = stats
+        return resp
+
     @expect_response(Status.SUCCESS)
     def slot_data_config_save(self):
         """
@@ -210,7 +210,12 @@ class ChameleonCom:
                                     status_string = f"{CR}{data_status:30x}{C0}"
                                 print(f'<= {CC}{command_string:40}{C0}{status_string}'
                                       f'{CY}{data_response.hex() if data_response is not None else ""}{C0}')
-                            if data_cmd in self.wait_response_map:
+                            if data_cmd in self.wait_response_map and 'stream' in self.wait_response_map[data_cmd]:
+                                # streamed frames keep the task waiting, each one extends its timeout
+                                task = self.wait_response_map[data_cmd]
+                                task['end_time'] = time.time() + task['timeout']
+                                task['stream'].put(Response(data_cmd, data_status, data_response))
+                            elif data_cmd in self.wait_response_map:
                                 # call processor
                                 if 'callback' in self.wait_response_map[data_cmd]:
                                     fn_call = self.wait_response_map[data_cmd]['callback']
@@ -249,6 +254,8 @@ class ChameleonCom:
             # register to wait map
             if 'callback' in task and callable(task['callback']):
                 self.wait_response_map[task_cmd] = {'callback': task['callback']}  # The callback for this task
+            elif 'stream' in task:
+                self.wait_response_map[task_cmd] = {'stream': task['stream'], 'timeout': task_timeout}
             else:
                 self.wait_response_map[task_cmd] = {'response': None}
             # set start time
@@ -303,7 +310,7 @@ class ChameleonCom:
         return frame
 
     def send_cmd_auto(self, cmd: int, data: bytearray = None, status: int = 0, callback=None, timeout: int = 3,
-                      close: bool = False):
+                      close: bool = False, stream: queue.Queue = None):
         """
             Send cmd to device
         :param cmd: cmd
@@ -312,6 +319,7 @@ class ChameleonCom:
         :param callback: call on response
         :param timeout: wait response timeout
         :param close: close connection after executing
+        :param stream: queue to put every response in, for commands answered with several frames
         :return:
         """
         self.check_open()
@@ -332,6 +340,8 @@ class ChameleonCom:
         task = {'cmd': cmd, 'frame': data_frame, 'timeout': timeout, 'close': close}
         if callable(callback):
             task['callback'] = callback
+        elif stream is not None:
+            task['stream'] = stream
         self.send_data_queue.put(task)
         return self
 
@@ -369,6 +379,40 @@ class ChameleonCom:
             raise CMDInvalidException(f"Device unsupported cmd: {cmd}")
         return data_response
 
+    def send_cmd_stream(self, cmd: int, data: bytearray or bytes or list or int = None, status: int = 0,
+                        timeout: int = 3):
+        """
+            Send cmd to device, and yield the responses it streams back until the caller stops.
+        :param cmd: cmd
+        :param data: bytes data (optional)
+        :param status: status (optional)
+        :param timeout: wait timeout for each response
+        :return: generator of response data
+        """
+        if isinstance(data, int):
+            data = [data]  # warp array.
+        if len(self.commands):
+            if cmd not in self.commands:
+                raise CMDInvalidException(f"This device doesn't declare that it can support this command: {cmd}.\nMake "
+                                          f"sure firmware is up to date and matches client")
+        frames = queue.Queue()
+        self.send_cmd_auto(cmd, data, status, None, timeout, stream=frames)
+        try:
+            while True:
+                try:
+                    data_response = frames.get(timeout=0.01)
+                except queue.Empty:
+                    task = self.wait_response_map.get(cmd)
+                    if task is not None and task.get('is_timeout'):
+                        raise TimeoutError(f"CMD {cmd} exec timeout")
+                    continue
+                if data_response.status == Status.INVALID_CMD:
+                    raise CMDInvalidException(f"Device unsupported cmd: {cmd}")
+                yield data_response
+        finally:
+            # stop waiting for frames nobody reads
+            self.wait_response_map.pop(cmd, None)
+
 
 if __name__ == '__main__':
     try:
@@ -0,0 +1,160 @@
+import ctypes
+import sys
+from pathlib import Path
+
+# Largest candidate list nested returns (TRY_KEYS in nested_util.h)
+NESTED_MAX_KEYS = 50
+# Same cap as the darkside tool
+DARKSIDE_MAX_KEYS = 0x10000
+
+
+class NestedNonce(ctypes.Structure):
+    _fields_ = [('nt', ctypes.c_uint32),
+                ('nt_enc', ctypes.c_uint32),
+                ('par', ctypes.c_uint8)]
+
+
+class DarksideNonce(ctypes.Structure):
+    _fields_ = [('nt', ctypes.c_uint32),
+                ('ks_list', ctypes.c_uint64),
+                ('par_list', ctypes.c_uint64),
+                ('nr', ctypes.c_uint32),
+                ('ar', ctypes.c_uint32)]
+
+
+class Mfkey32v2Nonce(ctypes.Structure):
+    _fields_ = [('uid', ctypes.c_uint32),
+                ('nt0', ctypes.c_uint32),
+                ('nr0_enc', ctypes.c_uint32),
+                ('ar0_enc', ctypes.c_uint32),
+                ('nt1', ctypes.c_uint32),
+                ('nr1_enc', ctypes.c_uint32),
+                ('ar1_enc', ctypes.c_uint32)]
+
+
+class Mf1AuthLogEntry(ctypes.Structure):
+    _fields_ = [('uid', ctypes.c_uint32),
+                ('nt', ctypes.c_uint32),
+                ('nr_enc', ctypes.c_uint32),
+                ('ar_enc', ctypes.c_uint32),
+                ('block', ctypes.c_uint8),
+                ('is_key_b', ctypes.c_uint8)]
+
+
+class Mf1LogKey(ctypes.Structure):
+    _fields_ = [('uid', ctypes.c_uint32),
+                ('block', ctypes.c_uint8),
+                ('is_key_b', ctypes.c_uint8),
+                ('key', ctypes.c_uint64)]
+
+
+def library_name():
+    if sys.platform == "win32":
+        return "chameleon_crypto.dll"
+    if sys.platform == "darwin":
+        return "libchameleon_crypto.dylib"
+    return "libchameleon_crypto.so"
+
+
+class ChameleonCrypto:
+    """
+        In-process access to the key recovery tools (libchameleon_crypto)
+    """
+
+    def __init__(self, lib_path: Path):
+        self._lib = ctypes.CDLL(str(lib_path))
+        key_p = ctypes.POINTER(ctypes.c_uint64)
+        self._lib.mf1_nested_recover.argtypes = [ctypes.c_uint32, ctypes.c_uint32, ctypes.POINTER(NestedNonce),
+                                                 ctypes.c_uint32, key_p, ctypes.c_uint32]
+        self._lib.mf1_nested_recover.restype = ctypes.c_int
+        self._lib.mf1_static_nested_recover.argtypes = [ctypes.c_uint32, ctypes.c_uint8, ctypes.POINTER(NestedNonce),
+                                                        ctypes.c_uint32, key_p, ctypes.c_uint32]
+        self._lib.mf1_static_nested_recover.restype = ctypes.c_int
+        self._lib.mf1_darkside_recover.argtypes = [ctypes.c_uint32, ctypes.POINTER(DarksideNonce),
+                                                   ctypes.c_uint32, key_p, ctypes.c_uint32]
+        self._lib.mf1_darkside_recover.restype = ctypes.c_int
+        self._lib.mf1_mfkey32v2_batch.argtypes = [ctypes.POINTER(Mfkey32v2Nonce), ctypes.c_uint32, key_p,
+                                                  ctypes.POINTER(ctypes.c_int)]
+        self._lib.mf1_mfkey32v2_batch.restype = ctypes.c_uint32
+        self._lib.mf1_mfkey32v2_log.argtypes = [ctypes.POINTER(Mf1AuthLogEntry), ctypes.c_uint32,
+                                                ctypes.POINTER(Mf1LogKey), ctypes.c_uint32]
+        self._lib.mf1_mfkey32v2_log.restype = ctypes.c_int
+
+    @staticmethod
+    def _keys(keys, count: int):
+        return [keys[i] for i in range(min(count, len(keys)))]
+
+    def nested(self, uid: int, dist: int, nts: list):
+        """
+            Recover candidate keys from nested acquisitions
+        :param nts: list of {'nt', 'nt_enc', 'par'}
+        :return: candidate keys, most likely first
+        """
+        nonces = (NestedNonce * len(nts))(*[NestedNonce(item['nt'], item['nt_enc'], item['par']) for item in nts])
+        keys = (ctypes.c_uint64 * NESTED_MAX_KEYS)()
+        count = self._lib.mf1_nested_recover(uid, dist, nonces, len(nts), keys, NESTED_MAX_KEYS)
+        return self._keys(keys, count)
+
+    def static_nested(self, uid: int, key_type: int, nts: list):
+        """
+            Recover candidate keys from static nested acquisitions
+        :param nts: list of {'nt', 'nt_enc'}
+        :return: candidate keys, most likely first
+        """
+        nonces = (NestedNonce * len(nts))(*[NestedNonce(item['nt'], item['nt_enc'], 0) for item in nts])
+        keys = (ctypes.c_uint64 * NESTED_MAX_KEYS)()
+        count = self._lib.mf1_static_nested_recover(uid, key_type, nonces, len(nts), keys, NESTED_MAX_KEYS)
+        return self._keys(keys, count)
+
+    def darkside(self, uid: int, darkside_list: list):
+        """
+            Recover candidate keys from darkside acquisitions
+        :param darkside_list: list of {'nt1', 'ks1', 'par', 'nr', 'ar'}
+        :return: candidate keys
+        """
+        nonces = (DarksideNonce * len(darkside_list))(
+            *[DarksideNonce(item['nt1'], item['ks1'], item['par'], item['nr'], item['ar']) for item in darkside_list])
+        keys = (ctypes.c_uint64 * DARKSIDE_MAX_KEYS)()
+        count = self._lib.mf1_darkside_recover(uid, nonces, len(darkside_list), keys, DARKSIDE_MAX_KEYS)
+        return self._keys(keys, count)
+
+    def mfkey32v2(self, pairs: list):
+        """
+            Recover keys from pairs of reader authentications in one call
+        :param pairs: list of (uid, nt0, nr0_enc, ar0_enc, nt1, nr1_enc, ar1_enc) integer tuples
+        :return: one key or None per pair
+        """
+        nonces = (Mfkey32v2Nonce * len(pairs))(*[Mfkey32v2Nonce(*pair) for pair in pairs])
+        keys = (ctypes.c_uint64 * len(pairs))()
+        found = (ctypes.c_int * len(pairs))()
+        self._lib.mf1_mfkey32v2_batch(nonces, len(pairs), keys, found)
+        return [keys[i] if found[i] == 1 else None for i in range(len(pairs))]
+
+    def mfkey32v2_log(self, records: list):
+        """
+            Recover the keys of a whole detection log in one call
+        :param records: detection log records as returned by mf1_get_detection_log
+        :return: list of {'uid', 'block', 'type', 'key'} with hex uid/key, same format as the records
+        """
+        entries = (Mf1AuthLogEntry * len(records))(
+            *[Mf1AuthLogEntry(int(item['uid'], 16), int(item['nt'], 16), int(item['nr'], 16), int(item['ar'], 16),
+                              item['block'], item['type'] == 'B') for item in records])
+        # every key explains at least two records
+        keys = (Mf1LogKey * max(len(records) // 2, 1))()
+        count = self._lib.mf1_mfkey32v2_log(entries, len(records), keys, len(keys))
+        return [{'uid': f"{keys[i].uid:08x}", 'block': keys[i].block, 'type': ['A', 'B'][keys[i].is_key_b],
+                 'key': f"{keys[i].key:012x}"} for i in range(min(count, len(keys)))]
+
+
+def load(lib_dir: Path):
+    """
+        Load the crypto library from lib_dir
+    :return: ChameleonCrypto instance, or None when the library is missing
+    """
+    lib_path = lib_dir / library_name()
+    if not lib_path.exists():
+        return None
+    try:
+        return ChameleonCrypto(lib_path)
+    except OSError:
+        return None
@@ -66,6 +66,13 @@ class Command(enum.IntEnum):
     MF1_READ_ONE_BLOCK = 2008
     MF1_WRITE_ONE_BLOCK = 2009
     HF14A_RAW = 2010
+    MF1_CHECK_KEYS_OF_SECTORS = 2011
+    MF1_READ_SECTORS = 2012
+    HF14A_SESSION_OPEN = 2013
+    HF14A_SESSION_CLOSE = 2014
+    HF14A_SELECT = 2015
+    HF14A_APDU = 2016
+    MF1_NESTED_ACQUIRE_SECTORS = 2017
 
     EM410X_SCAN = 3000
     EM410X_WRITE_TO_T55XX = 3001
@@ -92,6 +99,11 @@ class Command(enum.IntEnum):
     MF1_GET_WRITE_MODE = 4016
     MF1_SET_WRITE_MODE = 4017
     HF14A_GET_ANTI_COLL_DATA = 4018
+    MF1_GET_FAST_CRYPTO1_MODE = 4019
+    MF1_SET_FAST_CRYPTO1_MODE = 4020
+    MF1_CRYPTO1_BENCH = 4021
+    HF14A_GET_EMU_STATS = 4022
+    MF1_STREAM_DETECTION_LOG = 4023
 
     EM410X_SET_EMU_ID = 5000
     EM410X_GET_EMU_ID = 5001
@@ -305,6 +317,37 @@ class TagSpecificType(enum.IntEnum):
         return "Invalid"
 
 
+@enum.unique
+class MifareClassicBenchStep(enum.IntEnum):
+    AUTH = 0
+    AUTH_NESTED = 1
+    READER_AUTH = 2
+    COMMAND = 3
+    READ = 4
+    ACK = 5
+    WRITE = 6
+    VALUE = 7
+
+    def __str__(self):
+        if self == MifareClassicBenchStep.AUTH:
+            return "Auth setup"
+        elif self == MifareClassicBenchStep.AUTH_NESTED:
+            return "Nested auth setup"
+        elif self == MifareClassicBenchStep.READER_AUTH:
+            return "Reader auth (NR/AR)"
+        elif self == MifareClassicBenchStep.COMMAND:
+            return "Command decryption"
+        elif self == MifareClassicBenchStep.READ:
+            return "Read response encryption"
+        elif self == MifareClassicBenchStep.ACK:
+            return "ACK/NAK encryption"
+        elif self == MifareClassicBenchStep.WRITE:
+            return "Write data decryption"
+        elif self == MifareClassicBenchStep.VALUE:
+            return "Value operand decryption"
+        return "None"
+
+
 @enum.unique
 class MifareClassicWriteMode(enum.IntEnum):
     # Normal write
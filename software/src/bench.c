@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+#include "parity.h"
+#include "crapto1.h"
+#include "common.h"
+#include "nested_util.h"
+#include "crypto1_batch.h"
+#include "chameleon_crypto.h"
+#include "nfc_14a_frame.h"
+
+// Benchmarks of the crypto primitives and of the attacks on canned inputs.
+// All fixtures are derived from fixed keys/nonces, so every run does exactly the same work
+// and each recovery is checked against the key the fixture was built from.
+
+#define BENCH_UID           0x1d2f3e4c
+#define BENCH_KEY           0xa0a1a2a3a4a5ULL
+#define BENCH_DARKSIDE_KEY  0xffffffffffffULL
+#define BENCH_NESTED_DIST   340
+
+typedef struct {
+    const char *name;
+    uint32_t iterations;
+    uint64_t elapsed_ns;
+    uint64_t states;        // states produced by all iterations, 0 when it doesn't apply
+    int ok;
+} BenchResult;
+
+static uint64_t now_ns(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Peak resident set size of the process so far, in KiB
+static uint64_t peak_rss_kb(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.PeakWorkingSetSize / 1024;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return (uint64_t)usage.ru_maxrss / 1024;   // bytes on macOS
+#else
+    return (uint64_t)usage.ru_maxrss;
+#endif
+#endif
+}
+
+static void print_result(const BenchResult *r) {
+    double ns_op = (double)r->elapsed_ns / r->iterations;
+    printf("%-22s %8" PRIu32 " %16.1f ", r->name, r->iterations, ns_op);
+    if (r->states) {
+        printf("%14.0f ", (double)r->states * 1e9 / (double)r->elapsed_ns);
+    } else {
+        printf("%14s ", "-");
+    }
+    printf("%12" PRIu64 "  %s\n", peak_rss_kb(), r->ok ? "ok" : "FAIL");
+}
+
+// Number of states in a list terminated by an all zero state
+static uint64_t count_states(const struct Crypto1State *s) {
+    uint64_t n = 0;
+    for (; s->odd | s->even; s++) {
+        n++;
+    }
+    return n;
+}
+
+static int keys_contain(const uint64_t *keys, int count, uint32_t max_keys, uint64_t key) {
+    for (int i = 0; i < count && (uint32_t)i < max_keys; i++) {
+        if (keys[i] == key) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* ---------------------------------------------------------------- primitives */
+
+// Keeps the results of the primitive loops alive
+static volatile uint32_t bench_sink;
+
+static void bench_crypto1_word(BenchResult *r) {
+    struct Crypto1State s;
+    uint32_t acc = 0;
+    uint64_t key;
+    crypto1_init(&s, BENCH_KEY);
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        acc ^= crypto1_word(&s, i, 0);
+    }
+    r->elapsed_ns = now_ns() - start;
+    bench_sink = acc;
+    // rolling the word back must give the key again
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID, 0);
+    lfsr_rollback_word(&s, BENCH_UID, 0);
+    crypto1_get_lfsr(&s, &key);
+    r->ok = key == BENCH_KEY;
+}
+
+// Candidate states as lfsr_recovery32 gives them, rolled back through the nested nonce
+#define BENCH_ROLLBACK_STATES   (1 << 16)
+
+static struct Crypto1State *rollback_fixture(void) {
+    struct Crypto1State *states = malloc(BENCH_ROLLBACK_STATES * sizeof(struct Crypto1State));
+    if (states != NULL) {
+        for (uint32_t i = 0; i < BENCH_ROLLBACK_STATES; i++) {
+            crypto1_init(&states[i], BENCH_KEY * (i + 1));
+        }
+    }
+    return states;
+}
+
+static void bench_rollback_scalar(BenchResult *r) {
+    struct Crypto1State *states = rollback_fixture();
+    r->ok = states != NULL;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; r->ok && i < r->iterations; i++) {
+        for (uint32_t j = 0; j < BENCH_ROLLBACK_STATES; j++) {
+            lfsr_rollback_word(&states[j], BENCH_UID, 0);
+        }
+        r->states += BENCH_ROLLBACK_STATES;
+    }
+    r->elapsed_ns = now_ns() - start;
+    free(states);
+}
+
+// Rolls back like bench_rollback_scalar with one of the engines, checked against the scalar code
+static void bench_rollback_batch(BenchResult *r, const char *const *engines) {
+    struct Crypto1State *states = rollback_fixture();
+    struct Crypto1State check;
+    Crypto1BatchOp ops[] = {
+        { .in = BENCH_UID, .rollback = 1, .fb = 0 },
+        { .in = 0x12345678, .rollback = 0, .fb = 1 },
+    };
+    uint32_t ks[2];
+
+    while (*engines != NULL && !crypto1_batch_select(*engines)) {
+        engines++;
+    }
+    if (*engines == NULL) {
+        // not built in, or not supported by this CPU
+        r->name = "(engine n/a)";
+        r->ok = 1;
+        free(states);
+        return;
+    }
+    r->ok = states != NULL;
+    if (r->ok) {
+        check = states[1];
+        crypto1_batch_run(states, 2, ops, 2, ks);
+        lfsr_rollback_word(&check, BENCH_UID, 0);
+        r->ok = crypto1_word(&check, 0x12345678, 1) == ks[1] &&
+                (check.odd & 0xffffff) == states[1].odd && (check.even & 0xffffff) == states[1].even;
+    }
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; r->ok && i < r->iterations; i++) {
+        crypto1_batch_run(states, BENCH_ROLLBACK_STATES, ops, 1, NULL);
+        r->states += BENCH_ROLLBACK_STATES;
+    }
+    r->elapsed_ns = now_ns() - start;
+    free(states);
+    crypto1_batch_select(NULL);
+}
+
+static void bench_rollback_avx2(BenchResult *r) {
+    static const char *const engines[] = { "avx2", NULL };
+    bench_rollback_batch(r, engines);
+}
+
+static void bench_rollback_v128(BenchResult *r) {
+    static const char *const engines[] = { "sse2", "neon", "vec128", NULL };
+    bench_rollback_batch(r, engines);
+}
+
+static void bench_rollback_portable(BenchResult *r) {
+    static const char *const engines[] = { "portable", NULL };
+    bench_rollback_batch(r, engines);
+}
+
+// The single step loop prng_successor used before the jump-ahead, as the reference
+static uint32_t swap_endian(uint32_t x) {
+    return x >> 24 | (x >> 8 & 0xff00) | (x & 0xff00) << 8 | x << 24;
+}
+
+static uint32_t prng_successor_loop(uint32_t x, uint32_t n) {
+    x = swap_endian(x);
+    while (n--)
+        x = x >> 1 | (x >> 16 ^ x >> 18 ^ x >> 19 ^ x >> 21) << 31;
+
+    return swap_endian(x);
+}
+
+// Distances of the nested dist +-14 window, and some far ones
+#define BENCH_PRNG_STEPS(i) (BENCH_NESTED_DIST - 14 + ((i) % 29) + ((i) & 0x100 ? 40000 : 0))
+
+static int prng_successor_matches_loop(void) {
+    uint32_t x = 0x01200145;
+    for (uint32_t i = 0; i < 0x1000; i++, x = x * 1103515245 + 12345) {
+        // arbitrary 32 bit values, short steps included
+        if (prng_successor(x, i % 70) != prng_successor_loop(x, i % 70) ||
+                prng_successor(x, BENCH_PRNG_STEPS(i)) != prng_successor_loop(x, BENCH_PRNG_STEPS(i))) {
+            return 0;
+        }
+    }
+    // zero state and more than a cycle
+    return prng_successor(0xffff0000, 100) == prng_successor_loop(0xffff0000, 100) &&
+           prng_successor(0x01200145, 65535 * 2 + 20) == prng_successor_loop(0x01200145, 65535 * 2 + 20);
+}
+
+static void bench_prng_successor(BenchResult *r) {
+    uint32_t nt = 0x01200145;
+    prng_position_table();
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        nt = prng_successor(nt, BENCH_PRNG_STEPS(i));
+    }
+    r->elapsed_ns = now_ns() - start;
+    bench_sink = nt;
+    r->ok = prng_successor_matches_loop();
+}
+
+static void bench_prng_successor_loop(BenchResult *r) {
+    uint32_t nt = 0x01200145;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        nt = prng_successor_loop(nt, BENCH_PRNG_STEPS(i));
+    }
+    r->elapsed_ns = now_ns() - start;
+    bench_sink = nt;
+    r->ok = 1;
+}
+
+static void bench_nonce_distance(BenchResult *r) {
+    uint32_t nt = 0x01200145, acc = 0;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        acc += nonce_distance_signed(nt, nt ^ (i << 16));
+    }
+    r->elapsed_ns = now_ns() - start;
+    bench_sink = acc;
+    // the distance between a nonce and its successor is the number of steps taken, either way
+    r->ok = nonce_distance(0x01200145, prng_successor(0x01200145, 160)) == 160 &&
+            nonce_distance_signed(0x01200145, prng_successor(0x01200145, 160)) == 160 &&
+            nonce_distance_signed(prng_successor(0x01200145, 160), 0x01200145) == -160;
+}
+
+// Same layout as mfkey32v2: recover the state behind {ar} and roll it back to the key
+static int recovery32_has_key(struct Crypto1State *list, uint32_t nt, uint32_t nr_enc) {
+    for (struct Crypto1State *s = list; s->odd | s->even; s++) {
+        struct Crypto1State t = *s;
+        uint64_t key;
+        lfsr_rollback_word(&t, 0, 0);
+        lfsr_rollback_word(&t, nr_enc, 1);
+        lfsr_rollback_word(&t, BENCH_UID ^ nt, 0);
+        crypto1_get_lfsr(&t, &key);
+        if (key == BENCH_KEY) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void bench_lfsr_recovery32(BenchResult *r) {
+    uint32_t nt = 0x01200145, nr = 0x12345678;
+    struct Crypto1State s;
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID ^ nt, 0);
+    uint32_t nr_enc = crypto1_word(&s, nr, 0) ^ nr;
+    uint32_t ks2 = crypto1_word(&s, 0, 0);
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        struct Crypto1State *list = lfsr_recovery32(ks2, 0);
+        if (list == NULL) {
+            r->ok = 0;
+            break;
+        }
+        r->states += count_states(list);
+        if (i == 0) {
+            uint64_t paused = now_ns();
+            r->ok = recovery32_has_key(list, nt, nr_enc);
+            start += now_ns() - paused;
+        }
+        free(list);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+static void bench_lfsr_recovery32_ctx(BenchResult *r) {
+    uint32_t nt = 0x01200145, nr = 0x12345678;
+    struct Crypto1State s;
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID ^ nt, 0);
+    uint32_t nr_enc = crypto1_word(&s, nr, 0) ^ nr;
+    uint32_t ks2 = crypto1_word(&s, 0, 0);
+
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+    r->ok = ctx != NULL;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; r->ok && i < r->iterations; i++) {
+        struct Crypto1State *list = lfsr_recovery32_with_ctx(ctx, ks2, 0);
+        if (list == NULL) {
+            r->ok = 0;
+            break;
+        }
+        r->states += count_states(list);
+        if (i == 0) {
+            uint64_t paused = now_ns();
+            r->ok = recovery32_has_key(list, nt, nr_enc);
+            start += now_ns() - paused;
+        }
+    }
+    r->elapsed_ns = now_ns() - start;
+    lfsr_recovery32_ctx_destroy(ctx);
+}
+
+// Same layout as mfkey64: both {ar} and {at} are known
+static void bench_lfsr_recovery64(BenchResult *r) {
+    uint32_t nt = 0x01200145, nr = 0x12345678;
+    struct Crypto1State s;
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID ^ nt, 0);
+    crypto1_word(&s, nr, 0);
+    uint32_t ks2 = crypto1_word(&s, 0, 0);
+    uint32_t ks3 = crypto1_word(&s, 0, 0);
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        struct Crypto1State *list = lfsr_recovery64(ks2, ks3);
+        if (list == NULL) {
+            r->ok = 0;
+            break;
+        }
+        r->states += count_states(list);
+        if (i == 0) {
+            struct Crypto1State t = *list;
+            uint64_t key;
+            lfsr_rollback_word(&t, 0, 0);
+            lfsr_rollback_word(&t, 0, 0);
+            lfsr_rollback_word(&t, nr, 0);
+            lfsr_rollback_word(&t, BENCH_UID ^ nt, 0);
+            crypto1_get_lfsr(&t, &key);
+            r->ok = key == BENCH_KEY;
+        }
+        free(list);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+/* ---------------------------------------------------------------- fixtures */
+
+// Eight darkside tries with the same nr prefix, like the device collects them
+static void darkside_fixture(DarksideNonce *dn, uint8_t ks[8], uint8_t par[8][8]) {
+    uint32_t nt = 0x01200145, nr = 0x11223300, ar = 0x55667788;
+
+    dn->nt = nt;
+    dn->nr = nr;
+    dn->ar = ar;
+    dn->ks_list = 0;
+    dn->par_list = 0;
+    for (int c = 0; c < 8; c++) {
+        struct Crypto1State s;
+        uint32_t n = (nr & 0xFFFFFF1F) | c << 5;
+        uint8_t p = 0;
+        int k = 0;
+
+        crypto1_init(&s, BENCH_DARKSIDE_KEY);
+        crypto1_word(&s, BENCH_UID ^ nt, 0);
+        for (int b = 3; b >= 0; b--, k++) {
+            uint8_t by = n >> (8 * b);
+            uint8_t plain = by ^ crypto1_byte(&s, by, 1);
+            par[c][k] = oddparity8(plain) ^ filter(s.odd);
+            p |= par[c][k] << k;
+        }
+        for (int b = 3; b >= 0; b--, k++) {
+            uint8_t by = ar >> (8 * b);
+            uint8_t plain = by ^ crypto1_byte(&s, 0, 0);
+            par[c][k] = oddparity8(plain) ^ filter(s.odd);
+            p |= par[c][k] << k;
+        }
+        ks[c] = 0;
+        for (int i = 0; i < 4; i++) {
+            ks[c] |= crypto1_bit(&s, 0, 0) << i;
+        }
+        dn->ks_list |= (uint64_t)ks[c] << (8 * (7 - c));
+        dn->par_list |= (uint64_t)p << (8 * (7 - c));
+    }
+}
+
+static void bench_lfsr_common_prefix(BenchResult *r) {
+    DarksideNonce dn;
+    uint8_t ks[8], par[8][8];
+    darkside_fixture(&dn, ks, par);
+
+    r->ok = 0;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        struct Crypto1State *list = lfsr_common_prefix(dn.nr & 0xFFFFFF1F, dn.ar, ks, par, 0);
+        if (list == NULL) {
+            r->ok = 0;
+            break;
+        }
+        r->states += count_states(list);
+        if (i == 0) {
+            for (struct Crypto1State *s = list; s->odd | s->even; s++) {
+                struct Crypto1State t = *s;
+                uint64_t key;
+                lfsr_rollback_word(&t, BENCH_UID ^ dn.nt, 0);
+                crypto1_get_lfsr(&t, &key);
+                r->ok |= key == BENCH_DARKSIDE_KEY;
+            }
+        }
+        free(list);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+// Encrypted nested nonce nt_enc and its parity bits, for an auth that follows ntp by dist steps
+static void nested_nonce(uint32_t ntp, uint32_t dist, NestedNonce *nn) {
+    struct Crypto1State s;
+    uint32_t nt = prng_successor(ntp, dist);
+    crypto1_init(&s, BENCH_KEY);
+    uint32_t ks1 = crypto1_word(&s, BENCH_UID ^ nt, 0);
+
+    nn->nt = ntp;
+    nn->nt_enc = nt ^ ks1;
+    nn->par = 0;
+    for (int m = 0; m < 3; m++) {
+        int sh = 24 - 8 * m;
+        nn->par |= (oddparity8((nt >> sh) & 0xff) ^ oddparity8((nn->nt_enc >> sh) & 0xff) ^ BIT(ks1, 16 - 8 * m)) << m;
+    }
+}
+
+/* ---------------------------------------------------------------- attacks */
+
+static void bench_nested(BenchResult *r) {
+    NestedNonce nonces[2];
+    uint64_t keys[TRY_KEYS];
+    nested_nonce(prng_successor(0xa55a1234, 7), BENCH_NESTED_DIST, &nonces[0]);
+    nested_nonce(prng_successor(0x5e3f0102, 7), BENCH_NESTED_DIST + 3, &nonces[1]);
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        int count = mf1_nested_recover(BENCH_UID, BENCH_NESTED_DIST, nonces, 2, keys, TRY_KEYS);
+        r->ok &= keys_contain(keys, count, TRY_KEYS, BENCH_KEY);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+static void bench_staticnested(BenchResult *r) {
+    NestedNonce nonces[2];
+    uint64_t keys[TRY_KEYS];
+    // gen1 static nonce tag, the nested auths are 160 and 320 steps after it
+    for (uint32_t i = 0; i < 2; i++) {
+        uint32_t ntp = prng_successor(0x01200145, 160 * (i + 1));
+        struct Crypto1State s;
+        crypto1_init(&s, BENCH_KEY);
+        nonces[i].nt = 0x01200145;
+        nonces[i].nt_enc = ntp ^ crypto1_word(&s, BENCH_UID ^ ntp, 0);
+        nonces[i].par = 0;
+    }
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        int count = mf1_static_nested_recover(BENCH_UID, 0x60, nonces, 2, keys, TRY_KEYS);
+        r->ok &= keys_contain(keys, count, TRY_KEYS, BENCH_KEY);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+static void bench_darkside(BenchResult *r) {
+    DarksideNonce dn;
+    uint8_t ks[8], par[8][8];
+    uint64_t keys[0x100];
+    darkside_fixture(&dn, ks, par);
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        int count = mf1_darkside_recover(BENCH_UID, &dn, 1, keys, 0x100);
+        r->ok &= keys_contain(keys, count, 0x100, BENCH_DARKSIDE_KEY);
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+static void bench_mfkey32v2(BenchResult *r) {
+    Mfkey32v2Nonce n = { .uid = BENCH_UID, .nt0 = 0x01200145, .nt1 = 0x7a1bc2d3 };
+    uint32_t nr0 = 0x12345678, nr1 = 0x9abcdef0;
+    struct Crypto1State s;
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID ^ n.nt0, 0);
+    n.nr0_enc = crypto1_word(&s, nr0, 0) ^ nr0;
+    n.ar0_enc = crypto1_word(&s, 0, 0) ^ prng_successor(n.nt0, 64);
+    crypto1_init(&s, BENCH_KEY);
+    crypto1_word(&s, BENCH_UID ^ n.nt1, 0);
+    n.nr1_enc = crypto1_word(&s, nr1, 0) ^ nr1;
+    n.ar1_enc = crypto1_word(&s, 0, 0) ^ prng_successor(n.nt1, 64);
+
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < r->iterations; i++) {
+        uint64_t key = 0;
+        r->ok &= mf1_mfkey32v2_recover(&n, &key) == 1 && key == BENCH_KEY;
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+// The 14A frame packers of the firmware as they were before packing a byte at a time, the reference
+static uint8_t byte_mirror[256];
+
+static void byte_mirror_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t m = 0;
+        for (int b = 0; b < 8; b++) {
+            m |= ((i >> b) & 1) << (7 - b);
+        }
+        byte_mirror[i] = m;
+    }
+}
+
+static uint8_t wrap_frame_ref(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame) {
+    uint8_t btData;
+    uint32_t uiBitPos;
+    uint32_t uiDataPos = 0;
+    size_t szBitsLeft = szTxBits;
+    size_t szFrameBits = 0;
+
+    if (szBitsLeft == 0)
+        return 0;
+    if (szBitsLeft < 9) {
+        *pbtFrame = *pbtTx;
+        return szTxBits;
+    }
+    szFrameBits = szTxBits + (szTxBits / 8);
+    while (1) {
+        uint8_t btFrame = 0;
+        for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
+            btData = byte_mirror[pbtTx[uiDataPos]];
+            btFrame |= (btData >> uiBitPos);
+            *pbtFrame = byte_mirror[btFrame];
+            btFrame = (btData << (8 - uiBitPos));
+            btFrame |= ((pbtTxPar[uiDataPos] & 0x01) << (7 - uiBitPos));
+            pbtFrame++;
+            *pbtFrame = byte_mirror[btFrame];
+            uiDataPos++;
+            if (szBitsLeft < 9)
+                return szFrameBits;
+            szBitsLeft -= 8;
+        }
+        pbtFrame++;
+    }
+}
+
+static uint8_t unwrap_frame_ref(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar) {
+    uint8_t btFrame;
+    uint8_t btData;
+    uint8_t uiBitPos;
+    uint32_t uiDataPos = 0;
+    uint8_t *pbtFramePos = (uint8_t *)pbtFrame;
+    size_t szBitsLeft = szFrameBits;
+    size_t szRxBits = 0;
+
+    if (szBitsLeft == 0)
+        return 0;
+    if (szBitsLeft < 9) {
+        *pbtRx = *pbtFrame;
+        return szFrameBits;
+    }
+    szRxBits = szFrameBits - (szFrameBits / 9);
+    while (1) {
+        for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
+            btFrame = byte_mirror[pbtFramePos[uiDataPos]];
+            btData = (btFrame << uiBitPos);
+            btFrame = byte_mirror[pbtFramePos[uiDataPos + 1]];
+            btData |= (btFrame >> (8 - uiBitPos));
+            pbtRx[uiDataPos] = byte_mirror[btData];
+            if (pbtRxPar != NULL)
+                pbtRxPar[uiDataPos] = ((btFrame >> (7 - uiBitPos)) & 0x01);
+            uiDataPos++;
+            if (szBitsLeft < 9)
+                return szRxBits;
+            szBitsLeft -= 9;
+        }
+        pbtFramePos++;
+    }
+}
+
+// The table driven packer asked for, kept to compare against: each 9 bits pattern comes
+// out of a table already shifted to its position in the group of 8 data bytes
+static uint16_t frame_table[8][512];
+
+static void frame_table_init(void) {
+    for (int k = 0; k < 8; k++) {
+        for (int x = 0; x < 512; x++) {
+            frame_table[k][x] = (uint16_t)(x << k);
+        }
+    }
+}
+
+static uint8_t wrap_frame_table(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame) {
+    uint8_t btCarry = 0, uiPos = 0;
+
+    if (szTxBits == 0)
+        return 0;
+    if (szTxBits < 9) {
+        *pbtFrame = *pbtTx;
+        return szTxBits;
+    }
+    for (size_t i = 0; i < (szTxBits + 7) / 8; i++) {
+        uint16_t uiBits = frame_table[uiPos][pbtTx[i] | (pbtTxPar[i] & 0x01) << 8];
+        *pbtFrame++ = btCarry | (uint8_t)uiBits;
+        btCarry = uiBits >> 8;
+        if (++uiPos == 8) {
+            *pbtFrame++ = btCarry;
+            btCarry = 0;
+            uiPos = 0;
+        }
+    }
+    if (uiPos != 0)
+        *pbtFrame = btCarry;
+    return szTxBits + (szTxBits / 8);
+}
+
+// An 18 bytes MF1 read response, 16 data bytes and the CRC
+#define BENCH_FRAME_BITS    144
+#define BENCH_FRAME_BYTES   256
+// A frame takes tens of ns, so one preemption skews a whole run: time the iterations
+// in rounds and keep the fastest round
+#define BENCH_FRAME_ROUNDS  64
+
+static uint32_t frame_rand(uint32_t *x) {
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static void frame_fixture(uint8_t *data, uint8_t *par, uint32_t seed) {
+    for (int i = 0; i < BENCH_FRAME_BYTES; i++) {
+        data[i] = frame_rand(&seed);
+        par[i] = frame_rand(&seed) & 1;
+    }
+}
+
+static void bench_wrap_frame(BenchResult *r, uint8_t (*wrap)(const uint8_t *, const size_t, const uint8_t *, uint8_t *)) {
+    uint8_t data[BENCH_FRAME_BYTES], par[BENCH_FRAME_BYTES], frame[BENCH_FRAME_BYTES];
+    frame_fixture(data, par, 0x14a14a);
+    byte_mirror_init();
+    frame_table_init();
+    uint32_t sum = 0;
+    uint32_t round = r->iterations / BENCH_FRAME_ROUNDS;
+    uint64_t best = UINT64_MAX;
+    for (int n = 0; n < BENCH_FRAME_ROUNDS; n++) {
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < round; i++) {
+            data[0] = i;
+            sum += wrap(data, BENCH_FRAME_BITS, par, frame);
+            sum += frame[i % 20];
+        }
+        uint64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    r->elapsed_ns = best * BENCH_FRAME_ROUNDS;
+    r->ok = sum != 0;
+}
+
+static void bench_wrap_frame_ref(BenchResult *r) {
+    bench_wrap_frame(r, wrap_frame_ref);
+}
+
+static void bench_wrap_frame_14a(BenchResult *r) {
+    bench_wrap_frame(r, nfc_tag_14a_wrap_frame);
+}
+
+static void bench_wrap_frame_table(BenchResult *r) {
+    bench_wrap_frame(r, wrap_frame_table);
+}
+
+static void bench_unwrap_frame(BenchResult *r, uint8_t (*unwrap)(const uint8_t *, const size_t, uint8_t *, uint8_t *)) {
+    uint8_t data[BENCH_FRAME_BYTES], par[BENCH_FRAME_BYTES], frame[BENCH_FRAME_BYTES];
+    frame_fixture(frame, par, 0x14a14a);
+    byte_mirror_init();
+    uint32_t sum = 0;
+    uint32_t round = r->iterations / BENCH_FRAME_ROUNDS;
+    uint64_t best = UINT64_MAX;
+    for (int n = 0; n < BENCH_FRAME_ROUNDS; n++) {
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < round; i++) {
+            frame[0] = i;
+            sum += unwrap(frame, BENCH_FRAME_BITS + BENCH_FRAME_BITS / 8, data, par);
+            sum += data[i % 18] + par[i % 18];
+        }
+        uint64_t elapsed = now_ns() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    r->elapsed_ns = best * BENCH_FRAME_ROUNDS;
+    r->ok = sum != 0;
+}
+
+static void bench_unwrap_frame_ref(BenchResult *r) {
+    bench_unwrap_frame(r, unwrap_frame_ref);
+}
+
+static void bench_unwrap_frame_14a(BenchResult *r) {
+    bench_unwrap_frame(r, nfc_tag_14a_unwrap_frame);
+}
+
+// Each iteration checks a random frame of the firmware and table packers against the reference:
+// wrap, unwrap to a separate buffer and unwrap in place, as the RX path does
+static void bench_frame_14a_check(BenchResult *r) {
+    uint8_t data[BENCH_FRAME_BYTES], par[BENCH_FRAME_BYTES];
+    uint8_t out[BENCH_FRAME_BYTES], out_ref[BENCH_FRAME_BYTES];
+    uint8_t out_par[BENCH_FRAME_BYTES], out_par_ref[BENCH_FRAME_BYTES];
+    uint32_t seed = 0x14a;
+    byte_mirror_init();
+    frame_table_init();
+    r->ok = 1;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; r->ok && i < r->iterations; i++) {
+        frame_fixture(data, par, frame_rand(&seed));
+        // wrap, up to 200 data bits
+        size_t bits = 1 + frame_rand(&seed) % 200;
+        size_t bytes = (bits + bits / 8 + 7) / 8;
+        memset(out, 0, sizeof(out));
+        memset(out_ref, 0, sizeof(out_ref));
+        r->ok &= nfc_tag_14a_wrap_frame(data, bits, par, out) == wrap_frame_ref(data, bits, par, out_ref);
+        r->ok &= memcmp(out, out_ref, bytes) == 0;
+        memset(out, 0, sizeof(out));
+        r->ok &= wrap_frame_table(data, bits, par, out) == wrap_frame_ref(data, bits, par, out_ref);
+        r->ok &= memcmp(out, out_ref, bytes) == 0;
+        // unwrap, up to 220 frame bits, the reference reads a byte past the frame.
+        // The bits past the data of a short last byte are undefined, so is its missing parity
+        bits = 1 + frame_rand(&seed) % 220;
+        size_t rx_bits = bits < 9 ? bits : bits - bits / 9;
+        uint8_t last_mask = rx_bits % 8 ? (1 << (rx_bits % 8)) - 1 : 0xff;
+        bytes = (rx_bits + 7) / 8;
+        r->ok &= nfc_tag_14a_unwrap_frame(data, bits, out, out_par) == unwrap_frame_ref(data, bits, out_ref, out_par_ref);
+        r->ok &= memcmp(out, out_ref, bytes - 1) == 0 && ((out[bytes - 1] ^ out_ref[bytes - 1]) & last_mask) == 0;
+        r->ok &= bits < 9 || memcmp(out_par, out_par_ref, bits / 9) == 0;
+        memcpy(out_ref, data, sizeof(data));
+        nfc_tag_14a_unwrap_frame(out_ref, bits, out_ref, NULL);
+        r->ok &= memcmp(out, out_ref, bytes - 1) == 0 && ((out[bytes - 1] ^ out_ref[bytes - 1]) & last_mask) == 0;
+    }
+    r->elapsed_ns = now_ns() - start;
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(BenchResult *r);
+    uint32_t iterations;
+} BenchCase;
+
+static const BenchCase bench_cases[] = {
+    { "crypto1_word",           bench_crypto1_word,         1 << 22 },
+    { "prng_successor",         bench_prng_successor,       1 << 22 },
+    { "prng_successor_loop",    bench_prng_successor_loop,  1 << 12 },
+    { "nonce_distance",         bench_nonce_distance,       1 << 22 },
+    { "rollback_scalar",        bench_rollback_scalar,      16 },
+    { "rollback_avx2",          bench_rollback_avx2,        16 },
+    { "rollback_v128",          bench_rollback_v128,        16 },
+    { "rollback_portable",      bench_rollback_portable,    16 },
+    { "lfsr_recovery32",        bench_lfsr_recovery32,      8 },
+    { "lfsr_recovery32_ctx",    bench_lfsr_recovery32_ctx,  8 },
+    { "lfsr_recovery64",        bench_lfsr_recovery64,      8 },
+    { "lfsr_common_prefix",     bench_lfsr_common_prefix,   8 },
+    { "nested",                 bench_nested,               1 },
+    { "staticnested",           bench_staticnested,         1 },
+    { "darkside",               bench_darkside,             4 },
+    { "mfkey32v2",              bench_mfkey32v2,            8 },
+    { "wrap_frame_ref",         bench_wrap_frame_ref,       1 << 20 },
+    { "wrap_frame_14a",         bench_wrap_frame_14a,       1 << 20 },
+    { "wrap_frame_table",       bench_wrap_frame_table,     1 << 20 },
+    { "unwrap_frame_ref",       bench_unwrap_frame_ref,     1 << 20 },
+    { "unwrap_frame_14a",       bench_unwrap_frame_14a,     1 << 20 },
+    { "frame_14a_check",        bench_frame_14a_check,      300000 },
+};
+
+int main(int argc, char *const argv[]) {
+    uint32_t scale = 1;
+    int failed = 0;
+
+    // usage: bench [-t <threads>] [iteration scale] [case name]
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        nested_set_thread_count((uint32_t)atoui(argv[2]));
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc > 1) {
+        scale = (uint32_t)atoui(argv[1]);
+        if (scale == 0) {
+            scale = 1;
+        }
+    }
+    const char *only = argc > 2 ? argv[2] : NULL;
+
+    printf("threads: %" PRIu32 ", crypto1 batch engine: %s\n", nested_get_thread_count(), crypto1_batch_engine());
+    printf("%-22s %8s %16s %14s %12s\n", "case", "iters", "ns/op", "states/s", "peak RSS KiB");
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+        if (only != NULL && strcmp(only, bench_cases[i].name) != 0) {
+            continue;
+        }
+        BenchResult r = { .name = bench_cases[i].name, .iterations = bench_cases[i].iterations * scale };
+        bench_cases[i].run(&r);
+        print_result(&r);
+        fflush(stdout);
+        failed |= !r.ok;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
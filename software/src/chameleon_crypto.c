@@ -0,0 +1,467 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pthread.h"
+#include "crapto1.h"
+#include "mfkey.h"
+#include "nested_util.h"
+#include "crypto1_batch.h"
+#include "chameleon_crypto.h"
+
+// Copy the candidates to the caller buffer and release them
+static int copy_keys(uint64_t *src, uint32_t count, uint64_t *keys, uint32_t max_keys) {
+    if (src != NULL && keys != NULL) {
+        memcpy(keys, src, (count < max_keys ? count : max_keys) * sizeof(uint64_t));
+    }
+    free(src);
+    return (int)count;
+}
+
+int mf1_nested_recover(uint32_t uid, uint32_t dist, const NestedNonce *nonces, uint32_t count,
+                       uint64_t *keys, uint32_t max_keys) {
+    NtpKs1 *pNK = NULL;
+    uint32_t i, j, m;
+    uint32_t nttest, ks1;
+    uint8_t par_arr[3];
+
+    for (i = 0, j = 0; i < count; i++) {
+        for (m = 0; m < 3; m++) {
+            par_arr[m] = (nonces[i].par >> m) & 0x01;
+        }
+        // Try to recover the keystream1
+        nttest = prng_successor(nonces[i].nt, dist - 14);
+        for (m = dist - 14; m <= dist + 14; m += 1) {
+            ks1 = nonces[i].nt_enc ^ nttest;
+            if (valid_nonce(nttest, nonces[i].nt_enc, ks1, par_arr)) {
+                ++j;
+                // append to list
+                void *tmp = realloc(pNK, sizeof(NtpKs1) * j);
+                if (tmp == NULL) {
+                    free(pNK);
+                    return -1;
+                }
+                pNK = tmp;
+                pNK[j - 1].ntp = nttest;
+                pNK[j - 1].ks1 = ks1;
+            }
+            nttest = prng_successor(nttest, 1);
+        }
+    }
+
+    uint32_t keyCount = 0;
+    uint64_t *result = nested(pNK, j, uid, &keyCount);
+    free(pNK);
+    return copy_keys(result, keyCount, keys, max_keys);
+}
+
+int mf1_static_nested_recover(uint32_t uid, uint8_t type, const NestedNonce *nonces, uint32_t count,
+                              uint64_t *keys, uint32_t max_keys) {
+    uint32_t i, dist;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    // Which generation of static tag is detected.
+    if (nonces[0].nt == 0x01200145) {
+        // There is no loophole in this generation.
+        // This tag can be decrypted with the default parameter value 160!
+        dist = 160; // st gen1
+    } else if (nonces[0].nt == 0x009080A2) {   // st gen2
+        // We found that the gen2 tag is vulnerable too but parameter must be adapted depending on the attacked key
+        if (type == 0x61) {
+            dist = 161;
+        } else if (type == 0x60) {
+            dist = 160;
+        } else {
+            // can't be here!!!
+            return -1;
+        }
+    } else {
+        // can't be here!!!
+        return -1;
+    }
+
+    NtpKs1 *pNK = calloc(count, sizeof(NtpKs1));
+    if (pNK == NULL) {
+        return -1;
+    }
+    for (i = 0; i < count; i++, dist += 160) {
+        pNK[i].ntp = prng_successor(nonces[i].nt, dist);
+        pNK[i].ks1 = nonces[i].nt_enc ^ pNK[i].ntp;
+    }
+
+    uint32_t keyCount = 0;
+    uint64_t *result = nested(pNK, count, uid, &keyCount);
+    free(pNK);
+    return copy_keys(result, keyCount, keys, max_keys);
+}
+
+// Append a -1 terminated candidate list behind the keys already written
+static void append_keys(const uint64_t *src, uint32_t count, uint64_t *keys, uint32_t max_keys, uint32_t *total) {
+    for (uint32_t i = 0; i < count; i++, (*total)++) {
+        if (keys != NULL && *total < max_keys) {
+            keys[*total] = src[i];
+        }
+    }
+}
+
+int mf1_darkside_recover(uint32_t uid, const DarksideNonce *nonces, uint32_t count,
+                         uint64_t *keys, uint32_t max_keys) {
+    uint64_t *keylist, *last_keylist = NULL;
+    uint32_t i, keycount, last_count = 0, total = 0;
+
+    for (i = 0; i < count; i++) {
+        keylist = NULL;
+        // only parity zero attack: keep what this run has in common with the last one, pruned as the keys stream out
+        if (nonces[i].par_list == 0 && last_keylist != NULL) {
+            keycount = nonce2key_filtered(uid, nonces[i].nt, nonces[i].nr, nonces[i].ar,
+                                          nonces[i].par_list, nonces[i].ks_list, last_keylist, last_count, &keylist);
+            if (keycount != 0) {
+                free(last_keylist);
+                last_keylist = keylist;
+                last_count = keycount;
+                append_keys(last_keylist, keycount, keys, max_keys, &total);
+                continue;
+            }
+            free(keylist);
+            keylist = NULL;
+        }
+
+        // start decrypting
+        keycount = nonce2key(uid, nonces[i].nt, nonces[i].nr, nonces[i].ar,
+                             nonces[i].par_list, nonces[i].ks_list, &keylist);
+        if (keycount == 0) {
+            free(keylist);
+            continue;
+        }
+
+        // nothing in common with the last run, or the first one: this run is the new reference
+        if (nonces[i].par_list == 0) {
+            free(last_keylist);
+            last_keylist = keylist;
+            last_count = keycount;
+            continue;
+        }
+        append_keys(keylist, keycount, keys, max_keys, &total);
+        free(keylist);
+    }
+    free(last_keylist);
+    return (int)total;
+}
+
+// Candidates of mfkey32v2 checked per crypto1_batch_run, a match stops the search early
+#define MFKEY32V2_CHUNK     1024
+
+static int mfkey32v2_with_ctx(struct Recovery32Ctx *ctx, const Mfkey32v2Nonce *nonce, uint64_t *key) {
+    struct Crypto1State *t;
+    struct Crypto1State keys[MFKEY32V2_CHUNK];
+    uint32_t ar1[MFKEY32V2_CHUNK];
+    uint32_t p64 = prng_successor(nonce->nt0, 64);
+    uint32_t p64b = prng_successor(nonce->nt1, 64);
+    // back to the key with the first auth, then forward through the second one
+    Crypto1BatchOp rollback[] = {
+        { .in = 0, .rollback = 1, .fb = 0 },
+        { .in = nonce->nr0_enc, .rollback = 1, .fb = 1 },
+        { .in = nonce->uid ^ nonce->nt0, .rollback = 1, .fb = 0 },
+    };
+    Crypto1BatchOp forward[] = {
+        { .in = nonce->uid ^ nonce->nt1, .rollback = 0, .fb = 0 },
+        { .in = nonce->nr1_enc, .rollback = 0, .fb = 1 },
+        { .in = 0, .rollback = 0, .fb = 0 },
+    };
+
+    t = lfsr_recovery32_with_ctx(ctx, nonce->ar0_enc ^ p64, 0);
+    while (t->odd | t->even) {
+        size_t n = 0;
+        while (n < MFKEY32V2_CHUNK && (t[n].odd | t[n].even)) {
+            n++;
+        }
+        crypto1_batch_run(t, n, rollback, 3, NULL);
+        memcpy(keys, t, n * sizeof(struct Crypto1State));
+        crypto1_batch_run(t, n, forward, 3, ar1);
+        for (size_t i = 0; i < n; i++) {
+            if (nonce->ar1_enc == (ar1[i] ^ p64b)) {
+                crypto1_get_lfsr(&keys[i], key);
+                return 1;
+            }
+        }
+        t += n;
+    }
+    return 0;
+}
+
+int mf1_mfkey32v2_recover(const Mfkey32v2Nonce *nonce, uint64_t *key) {
+    int key_count = -1;
+    mf1_mfkey32v2_batch(nonce, 1, key, &key_count);
+    return key_count;
+}
+
+uint32_t mf1_nested_batch(const NestedSet *sets, uint32_t set_count,
+                          uint64_t *keys, uint32_t max_keys, int *key_counts) {
+    uint32_t solved = 0;
+    for (uint32_t i = 0; i < set_count; i++) {
+        key_counts[i] = mf1_nested_recover(sets[i].uid, sets[i].dist, sets[i].nonces, sets[i].count,
+                                           keys + (size_t)i * max_keys, max_keys);
+        solved += key_counts[i] > 0;
+    }
+    return solved;
+}
+
+uint32_t mf1_static_nested_batch(const StaticNestedSet *sets, uint32_t set_count,
+                                 uint64_t *keys, uint32_t max_keys, int *key_counts) {
+    uint32_t solved = 0;
+    for (uint32_t i = 0; i < set_count; i++) {
+        key_counts[i] = mf1_static_nested_recover(sets[i].uid, sets[i].type, sets[i].nonces, sets[i].count,
+                                                  keys + (size_t)i * max_keys, max_keys);
+        solved += key_counts[i] > 0;
+    }
+    return solved;
+}
+
+uint32_t mf1_darkside_batch(const DarksideSet *sets, uint32_t set_count,
+                            uint64_t *keys, uint32_t max_keys, int *key_counts) {
+    uint32_t solved = 0;
+    for (uint32_t i = 0; i < set_count; i++) {
+        key_counts[i] = mf1_darkside_recover(sets[i].uid, sets[i].nonces, sets[i].count,
+                                             keys + (size_t)i * max_keys, max_keys);
+        solved += key_counts[i] > 0;
+    }
+    return solved;
+}
+
+uint32_t mf1_mfkey32v2_batch(const Mfkey32v2Nonce *nonces, uint32_t count,
+                             uint64_t *keys, int *key_counts) {
+    uint32_t solved = 0;
+    // one set of recovery tables for the whole batch
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+    for (uint32_t i = 0; i < count; i++) {
+        key_counts[i] = ctx == NULL ? -1 : mfkey32v2_with_ctx(ctx, &nonces[i], &keys[i]);
+        solved += key_counts[i] > 0;
+    }
+    lfsr_recovery32_ctx_destroy(ctx);
+    return solved;
+}
+
+// Sort key of a detection log record
+typedef struct {
+    uint32_t uid;
+    uint8_t block;
+    uint8_t is_key_b;
+    uint32_t index;
+} LogRef;
+
+// State shared by the workers of mf1_mfkey32v2_log, guarded by lock
+typedef struct {
+    const Mf1AuthLogEntry *entries;
+    uint32_t *order;        // record indices, grouped by uid/block/key type
+    uint32_t *group_start;  // group g is order[group_start[g]] .. order[group_start[g + 1] - 1]
+    uint32_t group_count;
+    bool *explained;        // per position in order: a found key matches this record
+
+    Mf1LogKey *found;
+    uint32_t found_count;
+    uint32_t found_size;
+
+    // next pair to try: positions i < j of group g
+    uint32_t g, i, j;
+    bool oom;
+    pthread_mutex_t lock;
+} LogSolver;
+
+static int compare_log_ref(const void *a, const void *b) {
+    const LogRef *ra = a, *rb = b;
+    if (ra->uid != rb->uid) return ra->uid < rb->uid ? -1 : 1;
+    if (ra->block != rb->block) return ra->block < rb->block ? -1 : 1;
+    if (ra->is_key_b != rb->is_key_b) return ra->is_key_b < rb->is_key_b ? -1 : 1;
+    if (ra->index != rb->index) return ra->index < rb->index ? -1 : 1;
+    return 0;
+}
+
+static int compare_log_key(const void *a, const void *b) {
+    const Mf1LogKey *ka = a, *kb = b;
+    if (ka->uid != kb->uid) return ka->uid < kb->uid ? -1 : 1;
+    if (ka->block != kb->block) return ka->block < kb->block ? -1 : 1;
+    if (ka->is_key_b != kb->is_key_b) return ka->is_key_b < kb->is_key_b ? -1 : 1;
+    if (ka->key != kb->key) return ka->key < kb->key ? -1 : 1;
+    return 0;
+}
+
+// true when the reader answer of this record was made with key
+static bool log_key_matches(const Mf1AuthLogEntry *entry, uint64_t key) {
+    struct Crypto1State s;
+    crypto1_init(&s, key);
+    crypto1_word(&s, entry->uid ^ entry->nt, 0);
+    crypto1_word(&s, entry->nr_enc, 1);
+    return entry->ar_enc == (crypto1_word(&s, 0, 0) ^ prng_successor(entry->nt, 64));
+}
+
+// Take the next pair of records that no known key explains yet, call with the lock held
+static bool log_take_pair(LogSolver *sv, uint32_t *group, uint32_t *a, uint32_t *b) {
+    while (sv->g < sv->group_count) {
+        uint32_t end = sv->group_start[sv->g + 1];
+        if (sv->i + 1 >= end) {
+            // this group is done, move on to the next one
+            if (++sv->g < sv->group_count) {
+                sv->i = sv->group_start[sv->g];
+                sv->j = sv->i + 1;
+            }
+            continue;
+        }
+        if (sv->explained[sv->i] || sv->j >= end) {
+            sv->i++;
+            sv->j = sv->i + 1;
+            continue;
+        }
+        if (sv->explained[sv->j]) {
+            sv->j++;
+            continue;
+        }
+        *group = sv->g;
+        *a = sv->i;
+        *b = sv->j++;
+        return true;
+    }
+    return false;
+}
+
+// Record a key of group g and mark every record of the group it explains, call with the lock held
+static void log_add_key(LogSolver *sv, uint32_t g, uint64_t key) {
+    const Mf1AuthLogEntry *first = &sv->entries[sv->order[sv->group_start[g]]];
+
+    for (uint32_t k = 0; k < sv->found_count; k++) {
+        if (sv->found[k].uid == first->uid && sv->found[k].block == first->block &&
+                sv->found[k].is_key_b == first->is_key_b && sv->found[k].key == key) {
+            return;
+        }
+    }
+    if (sv->found_count == sv->found_size) {
+        uint32_t size = sv->found_size ? sv->found_size * 2 : 16;
+        void *tmp = realloc(sv->found, size * sizeof(Mf1LogKey));
+        if (tmp == NULL) {
+            sv->oom = true;
+            return;
+        }
+        sv->found = tmp;
+        sv->found_size = size;
+    }
+    sv->found[sv->found_count].uid = first->uid;
+    sv->found[sv->found_count].block = first->block;
+    sv->found[sv->found_count].is_key_b = first->is_key_b;
+    sv->found[sv->found_count].key = key;
+    sv->found_count++;
+
+    for (uint32_t pos = sv->group_start[g]; pos < sv->group_start[g + 1]; pos++) {
+        if (!sv->explained[pos] && log_key_matches(&sv->entries[sv->order[pos]], key)) {
+            sv->explained[pos] = true;
+        }
+    }
+}
+
+static void *log_worker(void *args) {
+    LogSolver *sv = args;
+    uint32_t group, a, b;
+    uint64_t key;
+
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+    pthread_mutex_lock(&sv->lock);
+    if (ctx == NULL) {
+        sv->oom = true;
+    }
+    while (ctx != NULL && !sv->oom && log_take_pair(sv, &group, &a, &b)) {
+        const Mf1AuthLogEntry *e0 = &sv->entries[sv->order[a]];
+        const Mf1AuthLogEntry *e1 = &sv->entries[sv->order[b]];
+        Mfkey32v2Nonce nonce = {
+            .uid = e0->uid, .nt0 = e0->nt, .nr0_enc = e0->nr_enc, .ar0_enc = e0->ar_enc,
+            .nt1 = e1->nt, .nr1_enc = e1->nr_enc, .ar1_enc = e1->ar_enc
+        };
+        pthread_mutex_unlock(&sv->lock);
+        int found = mfkey32v2_with_ctx(ctx, &nonce, &key);
+        pthread_mutex_lock(&sv->lock);
+        if (found == 1) {
+            log_add_key(sv, group, key);
+        }
+    }
+    pthread_mutex_unlock(&sv->lock);
+    lfsr_recovery32_ctx_destroy(ctx);
+    return NULL;
+}
+
+int mf1_mfkey32v2_log(const Mf1AuthLogEntry *entries, uint32_t count, Mf1LogKey *keys, uint32_t max_keys) {
+    LogSolver sv = { .entries = entries };
+    LogRef *refs = NULL;
+    pthread_t *threads = NULL;
+    uint32_t i, thread_count = 0, started = 0;
+    int result = -1;
+
+    if (count < 2) {
+        return 0;
+    }
+
+    refs = malloc(count * sizeof(LogRef));
+    sv.order = malloc(count * sizeof(uint32_t));
+    sv.group_start = malloc((count + 1) * sizeof(uint32_t));
+    sv.explained = calloc(count, sizeof(bool));
+    if (refs == NULL || sv.order == NULL || sv.group_start == NULL || sv.explained == NULL) {
+        goto out;
+    }
+
+    // group the records by uid, block and key type
+    for (i = 0; i < count; i++) {
+        refs[i].uid = entries[i].uid;
+        refs[i].block = entries[i].block;
+        refs[i].is_key_b = entries[i].is_key_b;
+        refs[i].index = i;
+    }
+    qsort(refs, count, sizeof(LogRef), compare_log_ref);
+    for (i = 0; i < count; i++) {
+        sv.order[i] = refs[i].index;
+        if (i == 0 || refs[i].uid != refs[i - 1].uid || refs[i].block != refs[i - 1].block ||
+                refs[i].is_key_b != refs[i - 1].is_key_b) {
+            sv.group_start[sv.group_count++] = i;
+        }
+    }
+    sv.group_start[sv.group_count] = count;
+    sv.g = 0;
+    sv.i = 0;
+    sv.j = 1;
+
+    thread_count = nested_get_thread_count();
+    if (thread_count > count) {
+        thread_count = count;
+    }
+    threads = calloc(thread_count, sizeof(pthread_t));
+    if (threads == NULL) {
+        goto out;
+    }
+    pthread_mutex_init(&sv.lock, NULL);
+    for (; started < thread_count; started++) {
+        if (pthread_create(&threads[started], NULL, log_worker, &sv) != 0) {
+            break;
+        }
+    }
+    // The workers share one queue, so the caller can drain it alone
+    if (started == 0) {
+        log_worker(&sv);
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&sv.lock);
+
+    if (!sv.oom) {
+        if (sv.found_count > 0) {
+            qsort(sv.found, sv.found_count, sizeof(Mf1LogKey), compare_log_key);
+            memcpy(keys, sv.found, (sv.found_count < max_keys ? sv.found_count : max_keys) * sizeof(Mf1LogKey));
+        }
+        result = (int)sv.found_count;
+    }
+out:
+    free(threads);
+    free(sv.found);
+    free(sv.explained);
+    free(sv.group_start);
+    free(sv.order);
+    free(refs);
+    return result;
+}
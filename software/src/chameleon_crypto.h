@@ -0,0 +1,110 @@
+#ifndef CHAMELEON_CRYPTO_H__
+#define CHAMELEON_CRYPTO_H__
+
+#include <stdint.h>
+
+// Entry points of the libchameleon_crypto shared library, also used by the command line tools.
+// All structures only hold fixed size fields so they can be mirrored with ctypes.
+#if defined(_WIN32) && defined(CHAMELEON_CRYPTO_EXPORTS)
+#define CHAMELEON_CRYPTO_API __declspec(dllexport)
+#else
+#define CHAMELEON_CRYPTO_API
+#endif
+
+// One nonce pair of a nested or static nested acquisition
+typedef struct {
+    uint32_t nt;        // plain tag nonce of the auth with the known key
+    uint32_t nt_enc;    // encrypted tag nonce of the nested auth
+    uint8_t par;        // parity bits of nt_enc, bit n for byte n (nested only)
+} NestedNonce;
+
+// One darkside acquisition
+typedef struct {
+    uint32_t nt;
+    uint64_t ks_list;
+    uint64_t par_list;
+    uint32_t nr;
+    uint32_t ar;
+} DarksideNonce;
+
+// Two reader authentications for the same uid/block/key type
+typedef struct {
+    uint32_t uid;
+    uint32_t nt0;
+    uint32_t nr0_enc;
+    uint32_t ar0_enc;
+    uint32_t nt1;
+    uint32_t nr1_enc;
+    uint32_t ar1_enc;
+} Mfkey32v2Nonce;
+
+// One record of the MF1 detection log (nfc_tag_mf1_auth_log_t)
+typedef struct {
+    uint32_t uid;
+    uint32_t nt;
+    uint32_t nr_enc;
+    uint32_t ar_enc;
+    uint8_t block;
+    uint8_t is_key_b;
+} Mf1AuthLogEntry;
+
+// A key recovered from the detection log
+typedef struct {
+    uint32_t uid;
+    uint8_t block;
+    uint8_t is_key_b;
+    uint64_t key;
+} Mf1LogKey;
+
+typedef struct {
+    uint32_t uid;
+    uint32_t dist;
+    const NestedNonce *nonces;
+    uint32_t count;
+} NestedSet;
+
+typedef struct {
+    uint32_t uid;
+    uint8_t type;       // 0x60 or 0x61, selects the distance of gen2 tags
+    const NestedNonce *nonces;
+    uint32_t count;
+} StaticNestedSet;
+
+typedef struct {
+    uint32_t uid;
+    const DarksideNonce *nonces;
+    uint32_t count;
+} DarksideSet;
+
+// Single set calls: return the number of candidate keys found, or -1 when the input
+// is invalid or memory runs out. Only the first max_keys of them are written to keys.
+CHAMELEON_CRYPTO_API int mf1_nested_recover(uint32_t uid, uint32_t dist, const NestedNonce *nonces, uint32_t count,
+                                            uint64_t *keys, uint32_t max_keys);
+CHAMELEON_CRYPTO_API int mf1_static_nested_recover(uint32_t uid, uint8_t type, const NestedNonce *nonces, uint32_t count,
+                                                   uint64_t *keys, uint32_t max_keys);
+CHAMELEON_CRYPTO_API int mf1_darkside_recover(uint32_t uid, const DarksideNonce *nonces, uint32_t count,
+                                              uint64_t *keys, uint32_t max_keys);
+// Returns 1 and sets key when the key was recovered, 0 when not, -1 when out of memory
+CHAMELEON_CRYPTO_API int mf1_mfkey32v2_recover(const Mfkey32v2Nonce *nonce, uint64_t *key);
+
+// Batch calls: keys is a set_count x max_keys matrix, key_counts[i] receives the
+// result of set i as returned by the single set call. Return the number of sets with keys.
+// Nested never yields more than TRY_KEYS (50) candidates per set.
+CHAMELEON_CRYPTO_API uint32_t mf1_nested_batch(const NestedSet *sets, uint32_t set_count,
+                                               uint64_t *keys, uint32_t max_keys, int *key_counts);
+CHAMELEON_CRYPTO_API uint32_t mf1_static_nested_batch(const StaticNestedSet *sets, uint32_t set_count,
+                                                      uint64_t *keys, uint32_t max_keys, int *key_counts);
+CHAMELEON_CRYPTO_API uint32_t mf1_darkside_batch(const DarksideSet *sets, uint32_t set_count,
+                                                 uint64_t *keys, uint32_t max_keys, int *key_counts);
+// mfkey32v2 yields at most one key per nonce, keys[i] is valid when key_counts[i] == 1
+CHAMELEON_CRYPTO_API uint32_t mf1_mfkey32v2_batch(const Mfkey32v2Nonce *nonces, uint32_t count,
+                                                  uint64_t *keys, int *key_counts);
+
+// Solve a whole detection log: records are grouped by uid/block/key type and the pairs of each
+// group are tried in parallel. A recovered key is checked against the other records of its group
+// and the records it explains are not paired again, so a group stops once all its records are explained.
+// Returns the number of keys found (only the first max_keys are written, sorted by group), -1 when out of memory.
+CHAMELEON_CRYPTO_API int mf1_mfkey32v2_log(const Mf1AuthLogEntry *entries, uint32_t count,
+                                           Mf1LogKey *keys, uint32_t max_keys);
+
+#endif
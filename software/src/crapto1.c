@@ -126,15 +126,65 @@ recover(uint32_t *o_head, uint32_t *o_tail, uint32_t oks,
 
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
-/** lfsr_recovery
- * recover the state of the lfsr given 32 bits of the keystream
- * additionally you can use the in parameter to specify the value
- * that was fed into the lfsr at the time the keystream was generated
+/** Recovery32Ctx
+ * scratch memory used by lfsr_recovery32, kept alive between calls so that
+ * callers recovering many nonces don't pay for malloc/free and page faults every time
  */
-struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
+struct Recovery32Ctx {
+    uint32_t *odd;
+    uint32_t *even;
+    uint32_t *bucket_mem;
     struct Crypto1State *statelist;
-    uint32_t *odd_head = 0, *odd_tail = 0, oks = 0;
-    uint32_t *even_head = 0, *even_tail = 0, eks = 0;
+    bucket_array_t bucket;
+};
+
+/** lfsr_recovery32_ctx_create
+ * allocate the tables needed by lfsr_recovery32_with_ctx, returns NULL when out of memory
+ */
+struct Recovery32Ctx *lfsr_recovery32_ctx_create(void) {
+    struct Recovery32Ctx *ctx = calloc(1, sizeof(struct Recovery32Ctx));
+    if (!ctx)
+        return NULL;
+
+    ctx->odd = malloc(sizeof(uint32_t) << 21);
+    ctx->even = malloc(sizeof(uint32_t) << 21);
+    ctx->statelist = malloc(sizeof(struct Crypto1State) << 18);
+    // one block for all 2 * 256 buckets of the out of place bucket_sort
+    ctx->bucket_mem = malloc((sizeof(uint32_t) << 14) * 2 * 0x100);
+    if (!ctx->odd || !ctx->even || !ctx->statelist || !ctx->bucket_mem) {
+        lfsr_recovery32_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < 2; i++)
+        for (uint32_t j = 0; j <= 0xff; j++)
+            ctx->bucket[i][j].head = ctx->bucket_mem + ((i << 8 | j) << 14);
+
+    return ctx;
+}
+
+/** lfsr_recovery32_ctx_destroy
+ * release a context created by lfsr_recovery32_ctx_create, NULL is accepted
+ */
+void lfsr_recovery32_ctx_destroy(struct Recovery32Ctx *ctx) {
+    if (!ctx)
+        return;
+    free(ctx->odd);
+    free(ctx->even);
+    free(ctx->bucket_mem);
+    free(ctx->statelist);
+    free(ctx);
+}
+
+/** lfsr_recovery32_with_ctx
+ * same as lfsr_recovery32, but works in the memory of ctx.
+ * The returned statelist belongs to ctx and is only valid until the next call,
+ * it must not be freed by the caller.
+ */
+struct Crypto1State *lfsr_recovery32_with_ctx(struct Recovery32Ctx *ctx, uint32_t ks2, uint32_t in) {
+    struct Crypto1State *statelist = ctx->statelist;
+    uint32_t *odd_head = ctx->odd, *odd_tail = ctx->odd - 1, oks = 0;
+    uint32_t *even_head = ctx->even, *even_tail = ctx->even - 1, eks = 0;
     int i;
 
     // split the keystream into an odd and even part
@@ -143,29 +193,8 @@ struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     for (i = 30; i >= 0; i -= 2)
         eks = eks << 1 | BEBIT(ks2, i);
 
-    odd_head = odd_tail = malloc(sizeof(uint32_t) << 21);
-    even_head = even_tail = malloc(sizeof(uint32_t) << 21);
-    statelist =  malloc(sizeof(struct Crypto1State) << 18);
-    if (!odd_tail-- || !even_tail-- || !statelist) {
-        free(statelist);
-        statelist = 0;
-        goto out;
-    }
-
     statelist->odd = statelist->even = 0;
 
-    // allocate memory for out of place bucket_sort
-    bucket_array_t bucket;
-
-    for (i = 0; i < 2; i++) {
-        for (uint32_t j = 0; j <= 0xff; j++) {
-            bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
-            if (!bucket[i][j].head) {
-                goto out;
-            }
-        }
-    }
-
     // initialize statelists: add all possible states which would result into the rightmost 2 bits of the keystream
     for (i = 1 << 20; i >= 0; --i) {
         if (filter(i) == (oks & 1))
@@ -184,14 +213,26 @@ struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
     // 22 bits to go to recover 32 bits in total. From now on, we need to take the "in"
     // parameter into account.
     in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
-    recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, bucket);
+    recover(odd_head, odd_tail, oks, even_head, even_tail, eks, 11, statelist, in << 1, ctx->bucket);
 
-out:
-    for (i = 0; i < 2; i++)
-        for (uint32_t j = 0; j <= 0xff; j++)
-            free(bucket[i][j].head);
-    free(odd_head);
-    free(even_head);
+    return statelist;
+}
+
+/** lfsr_recovery
+ * recover the state of the lfsr given 32 bits of the keystream
+ * additionally you can use the in parameter to specify the value
+ * that was fed into the lfsr at the time the keystream was generated
+ */
+struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in) {
+    struct Crypto1State *statelist = NULL;
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+
+    if (ctx) {
+        statelist = lfsr_recovery32_with_ctx(ctx, ks2, in);
+        // hand the statelist over to the caller, it will be released with free()
+        ctx->statelist = NULL;
+    }
+    lfsr_recovery32_ctx_destroy(ctx);
     return statelist;
 }
 
@@ -374,22 +415,24 @@ uint32_t lfsr_rollback_word(struct Crypto1State *s, uint32_t in, int fb) {
 /** nonce_distance
  * x,y valid tag nonces, then prng_successor(x, nonce_distance(x, y)) = y
  */
-static uint16_t *dist = 0;
 int nonce_distance(uint32_t from, uint32_t to) {
-    if (!dist) {
-        // allocation 2bytes * 0xFFFF times.
-        dist = calloc(2 << 16,  sizeof(uint8_t));
-        if (!dist)
-            return -1;
-        uint16_t x = 1;
-        for (uint16_t i = 1; i; ++i) {
-            dist[(x & 0xff) << 8 | x >> 8] = i;
-            x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
-        }
-    }
+    const uint16_t *dist = prng_position_table();
+    if (!dist)
+        return -1;
     return (65535 + dist[to >> 16] - dist[from >> 16]) % 65535;
 }
 
+/** nonce_distance_signed
+ * shortest way between two valid tag nonces, backwards when negative:
+ * prng_successor(x, nonce_distance_signed(x, y) mod 65535) = y, in -32767 to 32767
+ */
+int nonce_distance_signed(uint32_t from, uint32_t to) {
+    int d = nonce_distance(from, to);
+    if (d < 0)
+        return 0;
+    return d > 32767 ? d - 65535 : d;
+}
+
 /** validate_prng_nonce
  * Determine if nonce is deterministic. ie: Suspectable to Darkside attack.
  * returns
@@ -398,7 +441,8 @@ int nonce_distance(uint32_t from, uint32_t to) {
  */
 bool validate_prng_nonce(uint32_t nonce) {
     // init prng table:
-    if (nonce_distance(nonce, nonce) == -1)
+    const uint16_t *dist = prng_position_table();
+    if (!dist)
         return false;
     return ((65535 - dist[nonce >> 16] + dist[nonce & 0xffff]) % 65535) == 16;
 }
@@ -421,9 +465,20 @@ uint32_t *lfsr_prefix_ks(uint8_t ks[8], int isodd) {
     uint32_t *candidates = calloc(4 << 10, sizeof(uint8_t));
     if (!candidates) return 0;
 
-    int size = 0;
+    uint32_t size = lfsr_prefix_ks_range(ks, isodd, 0, 1 << 21, candidates, (1 << 10) - 1);
+    candidates[size] = -1;
 
-    for (int i = 0; i < 1 << 21; ++i) {
+    return candidates;
+}
+
+/** lfsr_prefix_ks_range
+ * lfsr_prefix_ks over the partial states from to to - 1 only, so the search can be split.
+ * Writes at most max candidates to out, returns how many were written
+ */
+uint32_t lfsr_prefix_ks_range(uint8_t ks[8], int isodd, uint32_t from, uint32_t to, uint32_t *out, uint32_t max) {
+    uint32_t size = 0;
+
+    for (uint32_t i = from; i < to && size < max; ++i) {
         int good = 1;
         for (uint32_t c = 0; good && c < 8; ++c) {
             uint32_t entry = i ^ fastfwd[isodd][c];
@@ -431,12 +486,10 @@ uint32_t *lfsr_prefix_ks(uint8_t ks[8], int isodd) {
             good &= (BIT(ks[c], isodd + 2) == filter(entry));
         }
         if (good)
-            candidates[size++] = i;
+            out[size++] = i;
     }
 
-    candidates[size] = -1;
-
-    return candidates;
+    return size;
 }
 
 /** check_pfx_parity
@@ -472,6 +525,20 @@ static struct Crypto1State *check_pfx_parity(uint32_t prefix, uint32_t rresp, ui
     return sl + good;
 }
 
+/** lfsr_common_prefix_odd
+ * the common prefix attack for a single odd half against all the -1 terminated even halves,
+ * with all 8 x 8 values of their top 3 bits. Independent per odd half, so the search can be split.
+ * sl needs room for 64 states per even half, plus one. Returns the end of the states written
+ */
+struct Crypto1State *lfsr_common_prefix_odd(uint32_t pfx, uint32_t rr, uint8_t par[8][8], uint32_t no_par,
+                                            uint32_t odd, const uint32_t *even, struct Crypto1State *sl) {
+    for (const uint32_t *e = even; *e + 1; ++e)
+        for (uint32_t top = 0; top < 64; ++top)
+            sl = check_pfx_parity(pfx, rr, par, odd | (top & 7) << 21, *e | (top >> 3) << 21, sl, no_par);
+
+    return sl;
+}
+
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
 /** lfsr_common_prefix
  * Implentation of the common prefix attack.
@@ -484,28 +551,38 @@ static struct Crypto1State *check_pfx_parity(uint32_t prefix, uint32_t rresp, ui
  */
 
 struct Crypto1State *lfsr_common_prefix(uint32_t pfx, uint32_t rr, uint8_t ks[8], uint8_t par[8][8], uint32_t no_par) {
-    struct Crypto1State *statelist, *s;
-    uint32_t *odd, *even, *o, *e, top;
+    struct Crypto1State *statelist = NULL;
+    uint32_t *odd, *even, *o;
+    size_t even_count = 0, size = 0, capacity;
 
     odd = lfsr_prefix_ks(ks, 1);
     even = lfsr_prefix_ks(ks, 0);
+    if (!odd || !even)
+        goto out;
 
-    s = statelist = malloc((sizeof * statelist) << 24); // was << 20. Need more for no_par special attack. Enough???
-    if (!s || !odd || !even) {
-        free(statelist);
-        statelist = 0;
+    // grown as the odd halves are checked, instead of the worst case up front
+    while (even[even_count] + 1)
+        even_count++;
+    capacity = even_count * 64 + 1;
+    statelist = malloc(capacity * sizeof * statelist);
+    if (!statelist)
         goto out;
-    }
 
-    for (o = odd; *o + 1; ++o)
-        for (e = even; *e + 1; ++e)
-            for (top = 0; top < 64; ++top) {
-                *o += 1 << 21;
-                *e += (!(top & 7) + 1) << 21;
-                s = check_pfx_parity(pfx, rr, par, *o, *e, s, no_par);
+    for (o = odd; *o + 1; ++o) {
+        if (capacity - size < even_count * 64 + 1) {
+            capacity = capacity * 2 + even_count * 64;
+            struct Crypto1State *tmp = realloc(statelist, capacity * sizeof * statelist);
+            if (!tmp) {
+                free(statelist);
+                statelist = 0;
+                goto out;
             }
+            statelist = tmp;
+        }
+        size = lfsr_common_prefix_odd(pfx, rr, par, no_par, *o, even, statelist + size) - statelist;
+    }
 
-    s->odd = s->even = 0;
+    statelist[size].odd = statelist[size].even = 0;
 out:
     free(odd);
     free(even);
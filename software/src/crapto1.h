@@ -36,20 +36,29 @@ uint8_t crypto1_bit(struct Crypto1State *, uint8_t, int);
 uint8_t crypto1_byte(struct Crypto1State *, uint8_t, int);
 uint32_t crypto1_word(struct Crypto1State *, uint32_t, int);
 uint32_t prng_successor(uint32_t x, uint32_t n);
+const uint16_t *prng_position_table(void);
 
 #if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks malloc()/free()
+struct Recovery32Ctx;
+struct Recovery32Ctx *lfsr_recovery32_ctx_create(void);
+void lfsr_recovery32_ctx_destroy(struct Recovery32Ctx *ctx);
+struct Crypto1State *lfsr_recovery32_with_ctx(struct Recovery32Ctx *ctx, uint32_t ks2, uint32_t in);
 struct Crypto1State *lfsr_recovery32(uint32_t ks2, uint32_t in);
 struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3);
 struct Crypto1State *
 lfsr_common_prefix(uint32_t pfx, uint32_t rr, uint8_t ks[8], uint8_t par[8][8], uint32_t no_par);
 #endif
 uint32_t *lfsr_prefix_ks(uint8_t ks[8], int isodd);
+uint32_t lfsr_prefix_ks_range(uint8_t ks[8], int isodd, uint32_t from, uint32_t to, uint32_t *out, uint32_t max);
+struct Crypto1State *lfsr_common_prefix_odd(uint32_t pfx, uint32_t rr, uint8_t par[8][8], uint32_t no_par,
+                                            uint32_t odd, const uint32_t *even, struct Crypto1State *sl);
 
 
 uint8_t lfsr_rollback_bit(struct Crypto1State *s, uint32_t in, int fb);
 uint8_t lfsr_rollback_byte(struct Crypto1State *s, uint32_t in, int fb);
 uint32_t lfsr_rollback_word(struct Crypto1State *s, uint32_t in, int fb);
 int nonce_distance(uint32_t from, uint32_t to);
+int nonce_distance_signed(uint32_t from, uint32_t to);
 bool validate_prng_nonce(uint32_t nonce);
 #define FOREACH_VALID_NONCE(N, FILTER, FSIZE)\
     uint32_t __n = 0,__M = 0, N = 0;\
@@ -18,6 +18,7 @@
     Copyright (C) 2008-2008 bla <blapost@gmail.com>
 */
 #include <stdlib.h>
+#include <pthread.h>
 #include "crapto1.h"
 #include "parity.h"
 
@@ -143,10 +144,46 @@ uint32_t crypto1_word(struct Crypto1State *s, uint32_t in, int is_encrypted) {
     return ret;
 }
 
+/* prng tables
+ * the 16 bit PRNG runs through one cycle of 65535 states. prng_pos holds the position (1 to 65535)
+ * of each state and prng_state the state at each position, states as they appear in the nonce.
+ * Built once on first use, under pthread_once as the recovery threads share them.
+ */
+static uint16_t prng_pos[1 << 16];
+static uint16_t prng_state[1 << 16];
+static pthread_once_t prng_tables_once = PTHREAD_ONCE_INIT;
+
+static void prng_tables_build(void) {
+    uint16_t x = 1;
+    for (uint16_t i = 1; i; ++i) {
+        prng_pos[(x & 0xff) << 8 | x >> 8] = i;
+        prng_state[i] = (x & 0xff) << 8 | x >> 8;
+        x = x >> 1 | (x ^ x >> 2 ^ x >> 3 ^ x >> 5) << 15;
+    }
+}
+
+const uint16_t *prng_position_table(void) {
+    pthread_once(&prng_tables_once, prng_tables_build);
+    return prng_pos;
+}
+
 /* prng_successor
  * helper used to obscure the keystream during authentication
+ * from 16 steps on, the upper half of the shift register has pushed the whole input out,
+ * so the result is two states of the 16 bit cycle: jump to them through the prng tables.
  */
 uint32_t prng_successor(uint32_t x, uint32_t n) {
+    if (n >= 16) {
+        uint32_t p = prng_position_table()[x & 0xffff];
+        if (!p) {
+            // zero state, it never leaves it
+            return 0;
+        }
+        // position of the upper half, n - 16 steps later, the lower half is 16 steps further
+        p = (p - 1 + (n - 16) % 65535) % 65535 + 1;
+        return (uint32_t)prng_state[p] << 16 | prng_state[p + 16 > 65535 ? p + 16 - 65535 : p + 16];
+    }
+
     SWAPENDIAN(x);
     while (n--)
         x = x >> 1 | (x >> 16 ^ x >> 18 ^ x >> 19 ^ x >> 21) << 31;
@@ -0,0 +1,146 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "crypto1_batch.h"
+
+// Transpose a 32x32 bit matrix: bit j of a[31 - i] and bit i of a[31 - j] swap places
+static void transpose32(uint32_t a[32]) {
+    uint32_t m = 0x0000FFFF;
+    for (int j = 16; j != 0; j >>= 1, m ^= m << j) {
+        for (int k = 0; k < 32; k = (k + j + 1) & ~j) {
+            uint32_t t = (a[k] ^ (a[k + j] >> j)) & m;
+            a[k] ^= t;
+            a[k + j] ^= t << j;
+        }
+    }
+}
+
+// Portable engine: 64 states in a uint64_t
+#define LANE_T          uint64_t
+#define LANE_WORDS      1
+#define BATCH_FN(name)  batch_##name##_u64
+#define BATCH_ATTR
+#include "crypto1_batch_impl.h"
+#undef LANE_T
+#undef LANE_WORDS
+#undef BATCH_FN
+#undef BATCH_ATTR
+
+#if defined(__GNUC__)
+// 128 states in a vector, SSE2 on x86-64 and NEON on arm64 are part of the base ISA
+typedef uint64_t batch_lane128_t __attribute__((vector_size(16)));
+#define LANE_T          batch_lane128_t
+#define LANE_WORDS      2
+#define BATCH_FN(name)  batch_##name##_v128
+#define BATCH_ATTR
+#include "crypto1_batch_impl.h"
+#undef LANE_T
+#undef LANE_WORDS
+#undef BATCH_FN
+#undef BATCH_ATTR
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// 256 states in an AVX2 register, only used when the CPU has it
+#define CRYPTO1_BATCH_AVX2
+typedef uint64_t batch_lane256_t __attribute__((vector_size(32)));
+#define LANE_T          batch_lane256_t
+#define LANE_WORDS      4
+#define BATCH_FN(name)  batch_##name##_avx2
+#define BATCH_ATTR      __attribute__((target("avx2")))
+#include "crypto1_batch_impl.h"
+#undef LANE_T
+#undef LANE_WORDS
+#undef BATCH_FN
+#undef BATCH_ATTR
+#endif
+
+typedef void (*batch_run_t)(struct Crypto1State *, size_t, const Crypto1BatchOp *, size_t, uint32_t *);
+
+static const struct {
+    const char *name;
+    batch_run_t run;
+} batch_engines[] = {
+#if defined(CRYPTO1_BATCH_AVX2)
+    { "avx2", batch_run_avx2 },
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    { "sse2", batch_run_v128 },
+#elif defined(__GNUC__) && defined(__aarch64__)
+    { "neon", batch_run_v128 },
+#elif defined(__GNUC__)
+    { "vec128", batch_run_v128 },
+#endif
+    { "portable", batch_run_u64 },
+};
+
+// The widest engine the CPU runs, resolved once under pthread_once as the recovery threads share it.
+// batch_engine, when set by crypto1_batch_select, overrides it
+static int batch_engine_widest;
+static pthread_once_t batch_engine_once = PTHREAD_ONCE_INIT;
+static int batch_engine = -1;
+
+static bool batch_engine_supported(int i) {
+#if defined(CRYPTO1_BATCH_AVX2)
+    if (batch_engines[i].run == batch_run_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return i >= 0;
+}
+
+static void batch_engine_resolve(void) {
+    int i = 0;
+    while (!batch_engine_supported(i)) {
+        i++;
+    }
+    batch_engine_widest = i;
+}
+
+// The selected engine, else the widest this CPU runs
+static int batch_engine_get(void) {
+    if (batch_engine >= 0) {
+        return batch_engine;
+    }
+    pthread_once(&batch_engine_once, batch_engine_resolve);
+    return batch_engine_widest;
+}
+
+/** crypto1_batch_engine
+ * name of the engine crypto1_batch_run uses
+ */
+const char *crypto1_batch_engine(void) {
+    return batch_engines[batch_engine_get()].name;
+}
+
+/** crypto1_batch_select
+ * use the named engine, false when it is not built in or the CPU lacks it.
+ * NULL goes back to the widest engine the CPU runs.
+ * Not thread safe, select before starting the threads that run batches
+ */
+bool crypto1_batch_select(const char *engine) {
+    if (engine == NULL) {
+        batch_engine = -1;
+        return true;
+    }
+    for (int i = 0; i < (int)(sizeof(batch_engines) / sizeof(batch_engines[0])); i++) {
+        if (strcmp(batch_engines[i].name, engine) == 0 && batch_engine_supported(i)) {
+            batch_engine = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** crypto1_batch_run
+ * apply the ops in order to every state, like crypto1_word and lfsr_rollback_word would one state at a time.
+ * The states keep their 24 bit odd and even halves only.
+ * out, when not NULL, gets the keystream word of the last op for each state
+ */
+void crypto1_batch_run(struct Crypto1State *states, size_t count,
+                       const Crypto1BatchOp *ops, size_t op_count, uint32_t *out) {
+    if (op_count == 0) {
+        return;
+    }
+    batch_engines[batch_engine_get()].run(states, count, ops, op_count, out);
+}
@@ -0,0 +1,19 @@
+#ifndef CRYPTO1_BATCH_H__
+#define CRYPTO1_BATCH_H__
+
+#include "crapto1.h"
+
+// One word of a batch, applied to every state like crypto1_word(s, in, fb)
+// or, with rollback set, like lfsr_rollback_word(s, in, fb)
+typedef struct {
+    uint32_t in;
+    uint8_t rollback;
+    uint8_t fb;
+} Crypto1BatchOp;
+
+const char *crypto1_batch_engine(void);
+bool crypto1_batch_select(const char *engine);
+void crypto1_batch_run(struct Crypto1State *states, size_t count,
+                       const Crypto1BatchOp *ops, size_t op_count, uint32_t *out);
+
+#endif
@@ -0,0 +1,190 @@
+// Bitsliced Crypto1 engine, included by crypto1_batch.c once per lane type:
+//   LANE_T          holds one bit of LANE_WORDS * 64 states
+//   LANE_WORDS      number of uint64_t in LANE_T
+//   BATCH_FN(name)  names the functions of this instance
+//   BATCH_ATTR      function attributes of this instance, e.g. the target ISA
+// Each register bit of all the states of a chunk is one LANE_T, so every step is a few bitwise
+// operations for the whole chunk. Shifting the registers is done by moving the ring pointers.
+
+#define LANES           (LANE_WORDS * 64)
+// The registers shift 16 times per word, either way from the middle of the ring
+#define RING_MID        16
+#define RING_SIZE       (RING_MID + 24 + 16)
+
+static BATCH_ATTR inline LANE_T BATCH_FN(mux)(LANE_T x, LANE_T y, LANE_T s) {
+    return x ^ ((x ^ y) & s);
+}
+
+// Truth table t of a 4 input function, input a is the lowest bit of the index
+static BATCH_ATTR inline LANE_T BATCH_FN(lut4)(uint32_t t, LANE_T a, LANE_T b, LANE_T c, LANE_T d) {
+    LANE_T zero = {0};
+    LANE_T v[8];
+    for (int k = 0; k < 8; k++) {
+        switch (t >> (2 * k) & 3) {
+            case 0:
+                v[k] = zero;
+                break;
+            case 1:
+                v[k] = ~a;
+                break;
+            case 2:
+                v[k] = a;
+                break;
+            default:
+                v[k] = ~zero;
+                break;
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        v[k] = BATCH_FN(mux)(v[2 * k], v[2 * k + 1], b);
+    }
+    for (int k = 0; k < 2; k++) {
+        v[k] = BATCH_FN(mux)(v[2 * k], v[2 * k + 1], c);
+    }
+    return BATCH_FN(mux)(v[0], v[1], d);
+}
+
+static BATCH_ATTR inline LANE_T BATCH_FN(lut5)(uint32_t t, LANE_T a, LANE_T b, LANE_T c, LANE_T d, LANE_T e) {
+    return BATCH_FN(mux)(BATCH_FN(lut4)(t & 0xffff, a, b, c, d), BATCH_FN(lut4)(t >> 16, a, b, c, d), e);
+}
+
+// filter() of crapto1.h: the nibble functions of its tables, then the output function
+static BATCH_ATTR inline LANE_T BATCH_FN(filter)(const LANE_T *o) {
+    LANE_T f4 = BATCH_FN(lut4)(0xf22c, o[0], o[1], o[2], o[3]);
+    LANE_T f3 = BATCH_FN(lut4)(0xd938, o[4], o[5], o[6], o[7]);
+    LANE_T f2 = BATCH_FN(lut4)(0xf22c, o[8], o[9], o[10], o[11]);
+    LANE_T f1 = BATCH_FN(lut4)(0xf22c, o[12], o[13], o[14], o[15]);
+    LANE_T f0 = BATCH_FN(lut4)(0xd938, o[16], o[17], o[18], o[19]);
+    return BATCH_FN(lut5)(0xEC57E80A, f0, f1, f2, f3, f4);
+}
+
+static BATCH_ATTR inline LANE_T BATCH_FN(taps)(const LANE_T *r, uint32_t poly) {
+    LANE_T x = {0};
+    for (int i = 0; i < 24; i++) {
+        if (poly >> i & 1) {
+            x ^= r[i];
+        }
+    }
+    return x;
+}
+
+// One op on the rings, both start and end at RING_MID. out gets the 32 keystream bits, as crypto1_word returns them
+static BATCH_ATTR void BATCH_FN(word)(LANE_T *odd, LANE_T *even, const Crypto1BatchOp *op, LANE_T *out) {
+    LANE_T *o = odd + RING_MID, *e = even + RING_MID, *t;
+    LANE_T ret, fb;
+
+    if (!op->rollback) {
+        for (int k = 0; k < 32; k++) {
+            ret = BATCH_FN(filter)(o);
+            fb = BATCH_FN(taps)(o, LF_POLY_ODD) ^ BATCH_FN(taps)(e, LF_POLY_EVEN);
+            if (op->fb) {
+                fb ^= ret;
+            }
+            if (BEBIT(op->in, k)) {
+                fb = ~fb;
+            }
+            // even = even << 1 | fb, then swap
+            *--e = fb;
+            t = o, o = e, e = t;
+            out[24 ^ k] = ret;
+        }
+    } else {
+        for (int k = 31; k >= 0; k--) {
+            t = o, o = e, e = t;
+            // even >>= 1, the bit shifted in is computed below
+            fb = *e++;
+            fb ^= BATCH_FN(taps)(e, LF_POLY_EVEN & 0x7fffff) ^ BATCH_FN(taps)(o, LF_POLY_ODD);
+            ret = BATCH_FN(filter)(o);
+            if (op->fb) {
+                fb ^= ret;
+            }
+            if (BEBIT(op->in, k)) {
+                fb = ~fb;
+            }
+            e[23] = fb;
+            out[24 ^ k] = ret;
+        }
+    }
+    memmove(odd + RING_MID, o, 24 * sizeof(LANE_T));
+    memmove(even + RING_MID, e, 24 * sizeof(LANE_T));
+}
+
+// Bits of 32 states starting at states[0]: lanes[i] bit j of word w is bit i of state 32 * w + j
+static void BATCH_FN(load)(const struct Crypto1State *states, size_t n, uint64_t ow[24][LANE_WORDS],
+                           uint64_t ew[24][LANE_WORDS], size_t w) {
+    uint32_t a[32], b[32];
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    for (size_t j = 0; j < n; j++) {
+        a[31 - j] = states[j].odd;
+        b[31 - j] = states[j].even;
+    }
+    transpose32(a);
+    transpose32(b);
+    for (int i = 0; i < 24; i++) {
+        ow[i][w / 2] |= (uint64_t)a[31 - i] << (32 * (w & 1));
+        ew[i][w / 2] |= (uint64_t)b[31 - i] << (32 * (w & 1));
+    }
+}
+
+// The other way round, for bits lanes of words
+static void BATCH_FN(store)(uint32_t *words, size_t n, uint64_t lanes[][LANE_WORDS], int bits, size_t w) {
+    uint32_t a[32];
+    memset(a, 0, sizeof(a));
+    for (int i = 0; i < bits; i++) {
+        a[31 - i] = (uint32_t)(lanes[i][w / 2] >> (32 * (w & 1)));
+    }
+    transpose32(a);
+    for (size_t j = 0; j < n; j++) {
+        words[j] = a[31 - j];
+    }
+}
+
+static BATCH_ATTR void BATCH_FN(run)(struct Crypto1State *states, size_t count,
+                                     const Crypto1BatchOp *ops, size_t op_count, uint32_t *out) {
+    LANE_T odd[RING_SIZE], even[RING_SIZE], ks[32];
+    uint64_t ow[24][LANE_WORDS], ew[24][LANE_WORDS], kw[32][LANE_WORDS];
+    uint32_t so[32], se[32];
+
+    for (size_t base = 0; base < count; base += LANES) {
+        size_t n = count - base < LANES ? count - base : LANES;
+
+        // transpose the states into the rings, 32 at a time
+        memset(ow, 0, sizeof(ow));
+        memset(ew, 0, sizeof(ew));
+        for (size_t w = 0; w * 32 < n; w++) {
+            BATCH_FN(load)(states + base + w * 32, n - w * 32 < 32 ? n - w * 32 : 32, ow, ew, w);
+        }
+        for (int i = 0; i < 24; i++) {
+            memcpy(&odd[RING_MID + i], ow[i], sizeof(LANE_T));
+            memcpy(&even[RING_MID + i], ew[i], sizeof(LANE_T));
+        }
+
+        for (size_t i = 0; i < op_count; i++) {
+            BATCH_FN(word)(odd, even, &ops[i], ks);
+        }
+
+        // and back
+        for (int i = 0; i < 24; i++) {
+            memcpy(ow[i], &odd[RING_MID + i], sizeof(LANE_T));
+            memcpy(ew[i], &even[RING_MID + i], sizeof(LANE_T));
+        }
+        memcpy(kw, ks, sizeof(kw));
+        for (size_t w = 0; w * 32 < n; w++) {
+            size_t m = n - w * 32 < 32 ? n - w * 32 : 32;
+            BATCH_FN(store)(so, m, ow, 24, w);
+            BATCH_FN(store)(se, m, ew, 24, w);
+            for (size_t j = 0; j < m; j++) {
+                states[base + w * 32 + j].odd = so[j];
+                states[base + w * 32 + j].even = se[j];
+            }
+            if (out != NULL) {
+                BATCH_FN(store)(out + base + w * 32, m, kw, 32, w);
+            }
+        }
+    }
+}
+
+#undef LANES
+#undef RING_MID
+#undef RING_SIZE
@@ -9,8 +9,19 @@
 //-----------------------------------------------------------------------------
 // MIFARE Darkside hack
 //-----------------------------------------------------------------------------
+#include <stdlib.h>
+#include <string.h>
+
+#include "pthread.h"
 #include "mfkey.h"
 #include "crapto1.h"
+#include "crypto1_batch.h"
+#include "nested_util.h"
+
+// Slices the 2^21 partial states of lfsr_prefix_ks are split in
+#define PREFIX_KS_SLICES        64
+// lfsr_prefix_ks candidates kept per slice, a whole search gives a few hundred
+#define PREFIX_KS_SLICE_MAX     1024
 
 // MIFARE
 extern int compare_uint64(const void *a, const void *b);
@@ -42,49 +53,215 @@ uint32_t intersection(uint64_t *listA, uint64_t *listB) {
     return p3 - listA;
 }
 
+// Work shared by the nonce2key workers, guarded by lock
+typedef struct {
+    uint8_t ks[8];
+    uint8_t par[8][8];
+    uint32_t pfx, rr, no_par;
+    uint32_t rollback_in;       // uid ^ nt, rolls the states back to the key
+
+    // stage 1, lfsr_prefix_ks: next slice to search, candidates of each slice
+    uint32_t next_slice;
+    uint32_t *slice_odd[PREFIX_KS_SLICES];
+    uint32_t slice_odd_count[PREFIX_KS_SLICES];
+    uint32_t *slice_even[PREFIX_KS_SLICES];
+    uint32_t slice_even_count[PREFIX_KS_SLICES];
+
+    // stage 2, lfsr_common_prefix: next odd half to check against all the even halves
+    uint32_t *odd, *even;
+    uint32_t odd_count, even_count, next_odd;
+
+    const uint64_t *filter;     // sorted, only the keys in it are kept when not NULL
+    uint32_t filter_count;
+
+    uint64_t *keys;
+    uint32_t key_count, key_size;
+    bool oom;
+    pthread_mutex_t lock;
+} PrefixScan;
+
+static void *prefix_ks_worker(void *arg) {
+    PrefixScan *ps = arg;
+    for (;;) {
+        pthread_mutex_lock(&ps->lock);
+        uint32_t slice = ps->next_slice++;
+        pthread_mutex_unlock(&ps->lock);
+        if (slice >= PREFIX_KS_SLICES) {
+            break;
+        }
+        uint32_t from = slice * ((1 << 21) / PREFIX_KS_SLICES), to = from + (1 << 21) / PREFIX_KS_SLICES;
+        ps->slice_odd_count[slice] = lfsr_prefix_ks_range(ps->ks, 1, from, to, ps->slice_odd[slice], PREFIX_KS_SLICE_MAX);
+        ps->slice_even_count[slice] = lfsr_prefix_ks_range(ps->ks, 0, from, to, ps->slice_even[slice], PREFIX_KS_SLICE_MAX);
+    }
+    return NULL;
+}
+
+// Checks one odd half at a time and streams the keys of its states out, no full state list is ever kept
+static void *common_prefix_worker(void *arg) {
+    PrefixScan *ps = arg;
+    Crypto1BatchOp op = { .in = ps->rollback_in, .rollback = 1, .fb = 0 };
+    struct Crypto1State *sl = malloc(((size_t)ps->even_count * 64 + 1) * sizeof(struct Crypto1State));
+    uint64_t *found = malloc(((size_t)ps->even_count * 64 + 1) * sizeof(uint64_t));
+
+    if (sl == NULL || found == NULL) {
+        pthread_mutex_lock(&ps->lock);
+        ps->oom = true;
+        pthread_mutex_unlock(&ps->lock);
+    }
+    while (sl != NULL && found != NULL) {
+        pthread_mutex_lock(&ps->lock);
+        bool done = ps->oom || ps->next_odd >= ps->odd_count;
+        uint32_t odd = done ? 0 : ps->odd[ps->next_odd++];
+        pthread_mutex_unlock(&ps->lock);
+        if (done) {
+            break;
+        }
+
+        size_t n = lfsr_common_prefix_odd(ps->pfx, ps->rr, ps->par, ps->no_par, odd, ps->even, sl) - sl;
+        crypto1_batch_run(sl, n, &op, 1, NULL);
+        uint32_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            crypto1_get_lfsr(&sl[i], &found[m]);
+            if (ps->filter == NULL || bsearch(&found[m], ps->filter, ps->filter_count, sizeof(uint64_t), compare_uint64) != NULL) {
+                m++;
+            }
+        }
+        if (m == 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&ps->lock);
+        if (ps->key_count + m + 1 > ps->key_size) {
+            uint32_t size = (ps->key_count + m + 1) * 2;
+            uint64_t *tmp = realloc(ps->keys, size * sizeof(uint64_t));
+            if (tmp == NULL) {
+                ps->oom = true;
+            } else {
+                ps->keys = tmp;
+                ps->key_size = size;
+            }
+        }
+        if (!ps->oom) {
+            memcpy(ps->keys + ps->key_count, found, m * sizeof(uint64_t));
+            ps->key_count += m;
+        }
+        pthread_mutex_unlock(&ps->lock);
+    }
+    free(sl);
+    free(found);
+    return NULL;
+}
+
+// Run worker on thread_count threads and wait for them
+static void prefix_scan_run(PrefixScan *ps, void *(*worker)(void *), uint32_t thread_count) {
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    uint32_t started = 0;
+    for (; threads != NULL && started < thread_count; started++) {
+        if (pthread_create(&threads[started], NULL, worker, ps) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        worker(ps);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+// Concatenate the per slice candidates into one -1 terminated list
+static uint32_t *prefix_ks_merge(uint32_t *slices[PREFIX_KS_SLICES], const uint32_t counts[PREFIX_KS_SLICES], uint32_t *total) {
+    *total = 0;
+    for (uint32_t i = 0; i < PREFIX_KS_SLICES; i++) {
+        *total += counts[i];
+    }
+    uint32_t *list = malloc((*total + 1) * sizeof(uint32_t));
+    if (list != NULL) {
+        uint32_t pos = 0;
+        for (uint32_t i = 0; i < PREFIX_KS_SLICES; i++) {
+            memcpy(list + pos, slices[i], counts[i] * sizeof(uint32_t));
+            pos += counts[i];
+        }
+        list[pos] = -1;
+    }
+    return list;
+}
+
 // Darkside attack (hf mf mifare)
 // if successful it will return a list of keys, not just one.
 uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info, uint64_t **keys) {
-    union {
-        struct Crypto1State *states;
-        uint64_t *keylist;
-    } unionstate;
+    return nonce2key_filtered(uid, nt, nr, ar, par_info, ks_info, NULL, 0, keys);
+}
+
+// nonce2key keeping only the keys of the sorted filter list, when not NULL: the intersection with an
+// earlier run is built while the candidates stream out, instead of after listing them all.
+// The search is split across nested_get_thread_count() threads, keys come back sorted.
+uint32_t nonce2key_filtered(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info,
+                            const uint64_t *filter, uint32_t filter_count, uint64_t **keys) {
+    uint32_t i, pos, threads = nested_get_thread_count();
+    PrefixScan *ps = calloc(1, sizeof(PrefixScan));
 
-    uint32_t i, pos;
-    uint8_t ks3x[8], par[8][8];
-    uint64_t key_recovered;
+    *keys = NULL;
+    if (ps == NULL) {
+        return 0;
+    }
 
     // Reset the last three significant bits of the reader nonce
-    nr &= 0xFFFFFF1F;
+    ps->pfx = nr & 0xFFFFFF1F;
+    ps->rr = ar;
+    ps->no_par = (par_info == 0);
+    ps->rollback_in = uid ^ nt;
+    ps->filter = filter;
+    ps->filter_count = filter_count;
+    pthread_mutex_init(&ps->lock, NULL);
 
     for (pos = 0; pos < 8; pos++) {
-        ks3x[7 - pos] = (ks_info >> (pos * 8)) & 0x0F;
+        ps->ks[7 - pos] = (ks_info >> (pos * 8)) & 0x0F;
         uint8_t bt = (par_info >> (pos * 8)) & 0xFF;
 
-        par[7 - pos][0] = (bt >> 0) & 1;
-        par[7 - pos][1] = (bt >> 1) & 1;
-        par[7 - pos][2] = (bt >> 2) & 1;
-        par[7 - pos][3] = (bt >> 3) & 1;
-        par[7 - pos][4] = (bt >> 4) & 1;
-        par[7 - pos][5] = (bt >> 5) & 1;
-        par[7 - pos][6] = (bt >> 6) & 1;
-        par[7 - pos][7] = (bt >> 7) & 1;
+        ps->par[7 - pos][0] = (bt >> 0) & 1;
+        ps->par[7 - pos][1] = (bt >> 1) & 1;
+        ps->par[7 - pos][2] = (bt >> 2) & 1;
+        ps->par[7 - pos][3] = (bt >> 3) & 1;
+        ps->par[7 - pos][4] = (bt >> 4) & 1;
+        ps->par[7 - pos][5] = (bt >> 5) & 1;
+        ps->par[7 - pos][6] = (bt >> 6) & 1;
+        ps->par[7 - pos][7] = (bt >> 7) & 1;
     }
 
-    unionstate.states = lfsr_common_prefix(nr, ar, ks3x, par, (par_info == 0));
-
-    if (!unionstate.states) {
-        *keys = NULL;
-        return 0;
+    for (i = 0; i < PREFIX_KS_SLICES; i++) {
+        ps->slice_odd[i] = malloc(PREFIX_KS_SLICE_MAX * sizeof(uint32_t));
+        ps->slice_even[i] = malloc(PREFIX_KS_SLICE_MAX * sizeof(uint32_t));
+        ps->oom |= ps->slice_odd[i] == NULL || ps->slice_even[i] == NULL;
+    }
+    if (!ps->oom) {
+        prefix_scan_run(ps, prefix_ks_worker, threads);
+        ps->odd = prefix_ks_merge(ps->slice_odd, ps->slice_odd_count, &ps->odd_count);
+        ps->even = prefix_ks_merge(ps->slice_even, ps->slice_even_count, &ps->even_count);
+        ps->oom = ps->odd == NULL || ps->even == NULL;
+    }
+    if (!ps->oom) {
+        prefix_scan_run(ps, common_prefix_worker, threads);
     }
 
-    for (i = 0; unionstate.keylist[i]; i++) {
-        lfsr_rollback_word(unionstate.states + i, uid ^ nt, 0);
-        crypto1_get_lfsr(unionstate.states + i, &key_recovered);
-        unionstate.keylist[i] = key_recovered;
+    uint32_t count = 0;
+    if (!ps->oom && ps->key_count != 0) {
+        qsort(ps->keys, ps->key_count, sizeof(uint64_t), compare_uint64);
+        ps->keys[ps->key_count] = -1;
+        *keys = ps->keys;
+        count = ps->key_count;
+    } else {
+        free(ps->keys);
     }
-    unionstate.keylist[i] = -1;
 
-    *keys = unionstate.keylist;
-    return i;
+    for (i = 0; i < PREFIX_KS_SLICES; i++) {
+        free(ps->slice_odd[i]);
+        free(ps->slice_even[i]);
+    }
+    free(ps->odd);
+    free(ps->even);
+    pthread_mutex_destroy(&ps->lock);
+    free(ps);
+    return count;
 }
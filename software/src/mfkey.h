@@ -16,6 +16,8 @@
 #include <stdint.h>
 
 uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info, uint64_t **keys);
+uint32_t nonce2key_filtered(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info,
+                            const uint64_t *filter, uint32_t filter_count, uint64_t **keys);
 
 int compare_uint64(const void *a, const void *b);
 uint32_t intersection(uint64_t *listA, uint64_t *listB);
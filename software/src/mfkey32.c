@@ -50,7 +50,12 @@ int main(int argc, char *argv[]) {
     ks2 = ar0_enc ^ p64;
     printf("  ks2: %08x\n", ks2);
 
-    s = lfsr_recovery32(ar0_enc ^ p64, 0);
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+    if (!ctx) {
+        printf("Memory allocation error for recovery context\n");
+        return 1;
+    }
+    s = lfsr_recovery32_with_ctx(ctx, ar0_enc ^ p64, 0);
 
     for (t = s; t->odd | t->even; ++t) {
         lfsr_rollback_word(t, 0, 0);
@@ -64,6 +69,6 @@ int main(int argc, char *argv[]) {
             break;
         }
     }
-    free(s);
+    lfsr_recovery32_ctx_destroy(ctx);
     return 0;
 }
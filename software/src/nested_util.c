@@ -14,240 +14,389 @@
 
 #include "pthread.h"
 #include "nested_util.h"
+#include "crypto1_batch.h"
 
 
-#define MEM_CHUNK               10000
-#define TRY_KEYS                50
+// initial slot count of a KeyCounter, grown x2 when 3/4 full
+#define COUNTER_INIT_SIZE       (1 << 16)
+// how many nonces a worker takes from the shared queue at once
+#define WORK_CHUNK              1
+// upper bound for the worker count, every worker holds its own recovery tables (~50MB)
+#define THREAD_LIMIT            256
+// environment variable used to override the detected core count
+#define THREAD_ENV              "NESTED_THREADS"
 
 
 typedef struct {
     uint64_t       key;
-    int            count;
+    uint32_t       count;
 } countKeys;
 
+// Work queue shared by all workers of a nested() run
 typedef struct {
     NtpKs1 *pNK;
+    uint32_t sizePNK;
     uint32_t authuid;
 
+    uint32_t nextPos;
+    pthread_mutex_t lock;
+} RecQueue;
+
+// Open addressing hash table counting how often each candidate key was seen
+typedef struct {
     uint64_t *keys;
-    uint32_t keyCount;
+    uint32_t *counts;   // 0 marks an empty slot
+    uint32_t capacity;  // always a power of two
+    uint32_t size;
+} KeyCounter;
+
+// Per worker state, each worker counts its own candidates
+typedef struct {
+    RecQueue *queue;
 
-    uint32_t startPos;
-    uint32_t endPos;
+    KeyCounter counter;
 } RecPar;
 
+static uint32_t thread_count_override = 0;
 
-int compar_int(const void *a, const void *b) {
-    return (*(uint64_t *)b - * (uint64_t *)a);
+void nested_set_thread_count(uint32_t count) {
+    thread_count_override = count;
 }
 
-// Compare countKeys structure
-int compar_special_int(const void *a, const void *b) {
-    return (((countKeys *)b)->count - ((countKeys *)a)->count);
+// Number of workers to use: explicit setting, then the env var, then the online core count
+uint32_t nested_get_thread_count(void) {
+    uint32_t count = thread_count_override;
+    if (count == 0) {
+        const char *env = getenv(THREAD_ENV);
+        if (env != NULL) {
+            count = (uint32_t)atoi(env);
+        }
+    }
+    if (count == 0) {
+#if WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        count = info.dwNumberOfProcessors;
+#else
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        count = online > 0 ? (uint32_t)online : 1;
+#endif
+    }
+    if (count > THREAD_LIMIT) {
+        count = THREAD_LIMIT;
+    }
+    return count;
 }
 
-// keys qsort and unique.
-countKeys *uniqsort(uint64_t *possibleKeys, uint32_t size) {
-    unsigned int i, j = 0;
-    int count = 0;
-    countKeys *our_counts;
+// Take the next range of nonces from the queue, returns false once the queue is drained
+static bool queue_take(RecQueue *queue, uint32_t *start, uint32_t *end) {
+    bool ok = false;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->nextPos < queue->sizePNK) {
+        *start = queue->nextPos;
+        queue->nextPos += WORK_CHUNK;
+        if (queue->nextPos > queue->sizePNK) {
+            queue->nextPos = queue->sizePNK;
+        }
+        *end = queue->nextPos;
+        ok = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok;
+}
 
-    qsort(possibleKeys, size, sizeof(uint64_t), compar_int);
 
-    our_counts = calloc(size, sizeof(countKeys));
-    if (our_counts == NULL) {
-        printf("Memory allocation error for our_counts");
-        exit(EXIT_FAILURE);
+static inline uint32_t counter_hash(uint64_t key) {
+    // splitmix64 finalizer, candidate keys share a lot of their bits
+    key ^= key >> 30;
+    key *= UINT64_C(0xbf58476d1ce4e5b9);
+    key ^= key >> 27;
+    key *= UINT64_C(0x94d049bb133111eb);
+    key ^= key >> 31;
+    return (uint32_t)key;
+}
+
+static bool counter_init(KeyCounter *counter, uint32_t capacity) {
+    counter->capacity = capacity;
+    counter->size = 0;
+    counter->keys = malloc(capacity * sizeof(uint64_t));
+    counter->counts = calloc(capacity, sizeof(uint32_t));
+    if (counter->keys == NULL || counter->counts == NULL) {
+        free(counter->keys);
+        free(counter->counts);
+        counter->keys = NULL;
+        counter->counts = NULL;
+        counter->capacity = 0;
+        return false;
     }
+    return true;
+}
 
-    for (i = 0; i < size; i++) {
-        if (possibleKeys[i + 1] == possibleKeys[i]) {
-            count++;
-        } else {
-            our_counts[j].key = possibleKeys[i];
-            our_counts[j].count = count;
-            j++;
-            count = 0;
+static void counter_free(KeyCounter *counter) {
+    free(counter->keys);
+    free(counter->counts);
+    counter->keys = NULL;
+    counter->counts = NULL;
+    counter->capacity = 0;
+    counter->size = 0;
+}
+
+// insert without growing, the caller makes sure there is a free slot
+static void counter_put(KeyCounter *counter, uint64_t key, uint32_t count) {
+    uint32_t mask = counter->capacity - 1;
+    uint32_t pos = counter_hash(key) & mask;
+    while (counter->counts[pos] != 0) {
+        if (counter->keys[pos] == key) {
+            counter->counts[pos] += count;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+    counter->keys[pos] = key;
+    counter->counts[pos] = count;
+    counter->size++;
+}
+
+static bool counter_add(KeyCounter *counter, uint64_t key, uint32_t count) {
+    if ((counter->size + 1) * 4 > counter->capacity * 3) {
+        KeyCounter bigger;
+        if (!counter_init(&bigger, counter->capacity * 2)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < counter->capacity; i++) {
+            if (counter->counts[i] != 0) {
+                counter_put(&bigger, counter->keys[i], counter->counts[i]);
+            }
+        }
+        counter_free(counter);
+        *counter = bigger;
+    }
+    counter_put(counter, key, count);
+    return true;
+}
+
+// Move every entry of src into dst, src is released as soon as it is merged
+static bool counter_merge(KeyCounter *dst, KeyCounter *src) {
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < src->capacity; i++) {
+        if (src->counts[i] != 0) {
+            ok = counter_add(dst, src->keys[i], src->counts[i]);
+        }
+    }
+    counter_free(src);
+    return ok;
+}
+
+// Heap order: the entry that should be dropped first is on top
+static inline bool count_keys_less(const countKeys *a, const countKeys *b) {
+    if (a->count != b->count) {
+        return a->count < b->count;
+    }
+    return a->key > b->key;
+}
+
+static void heap_sift_down(countKeys *heap, uint32_t size, uint32_t pos) {
+    for (;;) {
+        uint32_t least = pos, left = pos * 2 + 1, right = left + 1;
+        if (left < size && count_keys_less(&heap[left], &heap[least])) {
+            least = left;
+        }
+        if (right < size && count_keys_less(&heap[right], &heap[least])) {
+            least = right;
+        }
+        if (least == pos) {
+            return;
+        }
+        countKeys tmp = heap[pos];
+        heap[pos] = heap[least];
+        heap[least] = tmp;
+        pos = least;
+    }
+}
+
+static void heap_sift_up(countKeys *heap, uint32_t pos) {
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (!count_keys_less(&heap[pos], &heap[parent])) {
+            return;
         }
+        countKeys tmp = heap[pos];
+        heap[pos] = heap[parent];
+        heap[parent] = tmp;
+        pos = parent;
     }
-    qsort(our_counts, j, sizeof(countKeys), compar_special_int);
-    return (our_counts);
+}
+
+// Keep the max_keys most frequent keys seen at least twice, best first. Returns how many were written.
+static uint32_t counter_top_keys(KeyCounter *counter, uint64_t *keys, uint32_t max_keys) {
+    countKeys heap[TRY_KEYS];
+    uint32_t size = 0;
+
+    if (max_keys > TRY_KEYS) {
+        max_keys = TRY_KEYS;
+    }
+    for (uint32_t i = 0; i < counter->capacity; i++) {
+        // We don't known this key, try to break it
+        // This key can be found here two or more times
+        if (counter->counts[i] < 2) {
+            continue;
+        }
+        countKeys entry = { .key = counter->keys[i], .count = counter->counts[i] };
+        if (size < max_keys) {
+            heap[size] = entry;
+            heap_sift_up(heap, size++);
+        } else if (max_keys > 0 && count_keys_less(&heap[0], &entry)) {
+            heap[0] = entry;
+            heap_sift_down(heap, size, 0);
+        }
+    }
+    // pop the weakest entry to the back until the heap is empty
+    for (uint32_t n = size; n > 0; n--) {
+        keys[n - 1] = heap[0].key;
+        heap[0] = heap[n - 1];
+        heap_sift_down(heap, n - 1, 0);
+    }
+    return size;
 }
 
 // nested decrypt
 static void* nested_revover(void *args) {
-    struct Crypto1State *revstate, * revstate_start = NULL;
+    struct Crypto1State *revstate;
     uint64_t lfsr = 0;
-    uint32_t i, kcount = 0;
+    uint32_t i, start, end;
     bool is_ok = true;
 
     RecPar* rp = (RecPar*)args;
+    RecQueue* queue = rp->queue;
 
-    rp->keyCount = 0;
-    rp->keys = NULL;
-
-    //printf("Start pos is %d, End pos is %d\r\n", rp->startPos, rp->endPos);
-
-    for (i = rp->startPos; i < rp->endPos; i++) {
-        uint32_t nt_probe = rp->pNK[i].ntp ^ rp->authuid;
-        uint32_t ks1 = rp->pNK[i].ks1;
+    if (!counter_init(&rp->counter, COUNTER_INIT_SIZE)) {
+        printf("Memory allocation error for key counter");
+        return NULL;
+    }
 
-        /*
-        printf("     ntp = %"PRIu32"\r\n", nt_probe);
-        printf("     ks1 = %"PRIu32"\r\n", ks1);
-        printf("\r\n");
-        */
+    // the recovery tables are reused for every nonce this thread decrypts
+    struct Recovery32Ctx *ctx = lfsr_recovery32_ctx_create();
+    if (ctx == NULL) {
+        printf("Memory allocation error for recovery context");
+        counter_free(&rp->counter);
+        return NULL;
+    }
 
-        // And finally recover the first 32 bits of the key
-        revstate = lfsr_recovery32(ks1, nt_probe);
-        if (revstate_start == NULL) {
-            revstate_start = revstate;
-        }
+    while (is_ok && queue_take(queue, &start, &end)) {
+        for (i = start; is_ok && i < end; i++) {
+            uint32_t nt_probe = queue->pNK[i].ntp ^ queue->authuid;
+            uint32_t ks1 = queue->pNK[i].ks1;
+
+            /*
+            printf("     ntp = %"PRIu32"\r\n", nt_probe);
+            printf("     ks1 = %"PRIu32"\r\n", ks1);
+            printf("\r\n");
+            */
+
+            // And finally recover the first 32 bits of the key
+            revstate = lfsr_recovery32_with_ctx(ctx, ks1, nt_probe);
+
+            // roll all the candidates back at once
+            Crypto1BatchOp op = { .in = nt_probe, .rollback = 1, .fb = 0 };
+            size_t count = 0;
+            while (revstate[count].odd != 0x0 || revstate[count].even != 0x0) {
+                count++;
+            }
+            crypto1_batch_run(revstate, count, &op, 1, NULL);
 
-        while ((revstate->odd != 0x0) || (revstate->even != 0x0)) {
-            lfsr_rollback_word(revstate, nt_probe, 0);
-            crypto1_get_lfsr(revstate, &lfsr);
-            if (((kcount % MEM_CHUNK) == 0) || (kcount >= rp->keyCount)) {
-                rp->keyCount += MEM_CHUNK;
-                // printf("New chunk by %d, sizeof %lu\n", kcount, rp->keyCount * sizeof(uint64_t));
-                void* tmp = realloc(rp->keys, rp->keyCount * sizeof(uint64_t));
-                if (tmp == NULL) {
-                    printf("Memory allocation error for pk->possibleKeys");
-                    rp->keyCount = 0;
+            // a rolled back state can be {0, 0} (key 000000000000), so the end marker can't be used anymore
+            for (size_t j = 0; j < count; j++) {
+                crypto1_get_lfsr(&revstate[j], &lfsr);
+                if (!counter_add(&rp->counter, lfsr, 1)) {
+                    printf("Memory allocation error for key counter");
                     is_ok = false;
                     break;
                 }
-                rp->keys = (uint64_t*)tmp;
-            }
-            rp->keys[kcount] = lfsr;
-            kcount++;
-            revstate++;
-        }
-        --kcount;
-        free(revstate_start);
-        revstate_start = NULL;
-        if (!is_ok) {
-            break;
-        }
-    }
-    if (is_ok) {
-        if (kcount != 0) {
-            rp->keyCount = kcount;
-            void* tmp = (uint64_t*)realloc(rp->keys, rp->keyCount * sizeof(uint64_t));
-            if (tmp == NULL) {
-                printf("Memory allocation error for pk->possibleKeys");
-                rp->keyCount = 0;
-                free(rp->keys);
-            }
-            else {
-                rp->keys = tmp;
             }
         }
     }
-    else {
-        rp->keyCount = 0;
-        free(rp->keys);
+    if (!is_ok) {
+        counter_free(&rp->counter);
     }
+    lfsr_recovery32_ctx_destroy(ctx);
     return NULL;
 }
 
 uint64_t *nested(NtpKs1 *pNK, uint32_t sizePNK, uint32_t authuid, uint32_t *keyCount) {
-#define THREAD_MAX 4
-
     *keyCount = 0;
-    uint32_t i, j, manyThread;
+    uint32_t i, manyThread;
     uint64_t* keys = (uint64_t*)NULL;
 
-    manyThread = THREAD_MAX;
+    manyThread = nested_get_thread_count();
     if (manyThread > sizePNK) {
         manyThread = sizePNK;
     }
+    if (manyThread == 0) {
+        return NULL;
+    }
 
     // pthread handle
-    pthread_t* threads = calloc(sizePNK, sizeof(pthread_t));
+    pthread_t* threads = calloc(manyThread, sizeof(pthread_t));
     if (threads == NULL)  return NULL;
 
     // Param
-    RecPar* pRPs = calloc(sizePNK, sizeof(RecPar));
+    RecPar* pRPs = calloc(manyThread, sizeof(RecPar));
     if (pRPs == NULL) {
         free(threads);
         return NULL;
     }
 
-    uint32_t average = sizePNK / manyThread;
-    uint32_t modules = sizePNK % manyThread;
-
-    // Assign tasks
-    for (i = 0, j = 0; i < manyThread; i++, j += average) {
-        pRPs[i].pNK = pNK;
-        pRPs[i].authuid = authuid;
-        pRPs[i].startPos = j;
-        pRPs[i].endPos = j + average;
-        pRPs[i].keys = NULL;
-        // last thread can decrypt more pNK
-        if (i == (manyThread - 1) && modules > 0) {
-            (pRPs[i].endPos) += modules;
+    // Workers pull nonces from the queue until it is empty, so a slow nonce doesn't stall the others
+    RecQueue queue = { .pNK = pNK, .sizePNK = sizePNK, .authuid = authuid, .nextPos = 0 };
+    pthread_mutex_init(&queue.lock, NULL);
+
+    uint32_t started = 0;
+    for (; started < manyThread; started++) {
+        pRPs[started].queue = &queue;
+        if (pthread_create(&threads[started], NULL, nested_revover, &(pRPs[started])) != 0) {
+            break;
         }
-        pthread_create(&threads[i], NULL, nested_revover, &(pRPs[i]));
+    }
+    // The workers share one queue, so the caller can drain it alone, the unused params merge as empty
+    if (started == 0) {
+        nested_revover(&(pRPs[0]));
     }
 
-    for (i = 0; i < manyThread; i++) {
+    for (i = 0; i < started; i++) {
         // wait thread exit...
         pthread_join(threads[i], NULL);
-        *keyCount += pRPs[i].keyCount;
     }
     free(threads);
+    pthread_mutex_destroy(&queue.lock);
 
-    if (*keyCount != 0) {
-        keys = malloc((*keyCount) * sizeof(uint64_t));
-        if (keys != NULL) {
-            for (i = 0, j = 0; i < manyThread; i++) {
-                if (pRPs[i].keyCount > 0) {
-                    // printf("The thread %d recover %d keys.\r\n", i, pRPs[i].keyCount);
-                    if (pRPs[i].keys != NULL) {
-                        memcpy(
-                            keys + j,
-                            pRPs[i].keys,
-                            pRPs[i].keyCount * sizeof(uint64_t)
-                        );
-                        j += pRPs[i].keyCount;
-                        free(pRPs[i].keys);
-                    }
-                }
+    // Merge the per thread counts into the biggest table, releasing the others one by one
+    uint32_t base = 0;
+    for (i = 1; i < manyThread; i++) {
+        if (pRPs[i].counter.size > pRPs[base].counter.size) {
+            base = i;
+        }
+    }
+    for (i = 0; i < manyThread; i++) {
+        if (i != base && pRPs[i].counter.capacity != 0) {
+            if (!counter_merge(&pRPs[base].counter, &pRPs[i].counter)) {
+                printf("Cannot allocate memory to merge keys.\r\n");
             }
+        }
+    }
 
-            countKeys* ck = uniqsort(keys, *keyCount);
-            free(keys);
-            keys = (uint64_t*)NULL;
-            *keyCount = 0;
-
-            if (ck != NULL) {
-                for (i = 0; i < TRY_KEYS; i++) {
-                    // We don't known this key, try to break it
-                    // This key can be found here two or more times
-                    if (ck[i].count > 0) {
-                        *keyCount += 1;
-                        void* tmp = realloc(keys, sizeof(uint64_t) * (*keyCount));
-                        if (tmp != NULL) {
-                            keys = tmp;
-                            keys[*keyCount - 1] = ck[i].key;
-                        }
-                        else {
-                            printf("Cannot allocate memory for keys on merge.");
-                            free(keys);
-                            break;
-                        }
-                    }
-                }
-            }
-            else {
-                printf("Cannot allocate memory for ck on uniqsort.");
+    if (pRPs[base].counter.size != 0) {
+        keys = malloc(TRY_KEYS * sizeof(uint64_t));
+        if (keys != NULL) {
+            *keyCount = counter_top_keys(&pRPs[base].counter, keys, TRY_KEYS);
+            if (*keyCount == 0) {
+                free(keys);
+                keys = (uint64_t*)NULL;
             }
-        }
-        else {
-            printf("Cannot allocate memory to merge keys.\r\n");
+        } else {
+            printf("Cannot allocate memory for keys on merge.");
         }
     }
+    counter_free(&pRPs[base].counter);
     free(pRPs);
     return keys;
 }
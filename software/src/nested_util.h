@@ -3,12 +3,17 @@
 
 #include "crapto1.h"
 
+// nested() returns at most this many keys, the most frequent ones first
+#define TRY_KEYS                50
+
 typedef struct {
     uint32_t ntp;
     uint32_t ks1;
 } NtpKs1;
 
 uint8_t valid_nonce(uint32_t Nt, uint32_t NtEnc, uint32_t Ks1, uint8_t *parity);
+void nested_set_thread_count(uint32_t count);
+uint32_t nested_get_thread_count(void);
 uint64_t *nested(NtpKs1 *pNK, uint32_t sizePNK, uint32_t authuid, uint32_t *keyCount);
 
 #endif
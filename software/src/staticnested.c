@@ -4,70 +4,48 @@
 #include <inttypes.h>
 #include "common.h"
 #include "nested_util.h"
+#include "chameleon_crypto.h"
 
 int main(int argc, char *const argv[]) {
-    NtpKs1 *pNK = NULL;
-    uint32_t i, j, m;
-    uint32_t nt1, nt2, nttest, ks1, dist;
+    NestedNonce *nonces = NULL;
+    uint32_t i, j;
+    uint64_t keys[TRY_KEYS];
+
+    // optional "-t <count>" in front of the other params overrides the worker thread count
+    if (argc > 2 && strcmp(argv[1], "-t") == 0) {
+        nested_set_thread_count((uint32_t)atoui(argv[2]));
+        argc -= 2;
+        argv += 2;
+    }
 
     uint32_t authuid = atoui(argv[1]);   // uid
     uint8_t type = (uint8_t)atoui(argv[2]); // target key type
 
     // process all args.
-    bool check_st_level_at_first_run = false;
-    for (i = 3, j = 0; i < argc; i += 2) {
-        // nt + par
-        nt1 = atoui(argv[i]);
-        nt2 = atoui(argv[i + 1]);
-
-        // Which generation of static tag is detected.
-        if (!check_st_level_at_first_run) {
-            if (nt1 == 0x01200145) {
-                // There is no loophole in this generation.
-                // This tag can be decrypted with the default parameter value 160!
-                dist = 160; // st gen1
-            } else if (nt1 == 0x009080A2) {   // st gen2
-                // We found that the gen2 tag is vulnerable too but parameter must be adapted depending on the attacked key
-                if (type == 0x61) {
-                    dist = 161;
-                } else if (type == 0x60) {
-                    dist = 160;
-                } else {
-                    // can't be here!!!
-                    goto error;
-                }
-            } else {
-                // can't be here!!!
-                goto error;
-            }
-            check_st_level_at_first_run = true;
-        }
-
-        nttest = prng_successor(nt1, dist);
-        ks1 = nt2 ^ nttest;
-        ++j;
-        dist += 160;
-
-        void *tmp = realloc(pNK, sizeof(NtpKs1) * j);
+    for (i = 3, j = 0; i < argc; i += 2, j++) {
+        void *tmp = realloc(nonces, sizeof(NestedNonce) * (j + 1));
         if (tmp == NULL) {
             goto error;
         }
+        nonces = tmp;
+        // nt + nt_enc
+        nonces[j].nt = atoui(argv[i]);
+        nonces[j].nt_enc = atoui(argv[i + 1]);
+        nonces[j].par = 0;
+    }
 
-        pNK = tmp;
-        pNK[j - 1].ntp = nttest;
-        pNK[j - 1].ks1 = ks1;
+    // unknown static nonce generations are rejected here
+    int keyCount = mf1_static_nested_recover(authuid, type, nonces, j, keys, TRY_KEYS);
+    if (keyCount < 0) {
+        goto error;
     }
-    uint32_t keyCount = 0;
-    uint64_t *keys = nested(pNK, j, authuid, &keyCount);
 
-    if (keyCount > 0) {
-        for (i = 0; i < keyCount; i++) {
-            printf("Key %d... %" PRIx64 " \r\n", i + 1, keys[i]);
-            fflush(stdout);
-        }
+    for (i = 0; i < (uint32_t)keyCount; i++) {
+        printf("Key %d... %" PRIx64 " \r\n", i + 1, keys[i]);
+        fflush(stdout);
     }
     fflush(stdout);
-    free(keys);
+    free(nonces);
     exit(EXIT_SUCCESS);
 error:
     exit(EXIT_FAILURE);